@@ -0,0 +1,144 @@
+/* Copyright 2013 David Axmark
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "demangle.h"
+#include "demangle_cache.h"
+
+/* An open-addressing hash table with linear probing.
+ * The capacity is a power of two and at most half of it is used.
+ */
+typedef struct Entry {
+	unsigned hash;
+	int options;
+	char* mangled;	/* NULL if the slot is free. */
+	char* demangled;	/* == mangled if the name couldn't be demangled. */
+} Entry;
+
+static Entry* sTable = NULL;
+static unsigned sCapacity = 0;
+static unsigned sCount = 0;
+
+#define MIN_CAPACITY 256
+
+/* FNV-1a. */
+static unsigned hashName(const char* name, int options) {
+	unsigned h = 2166136261u ^ (unsigned)options;
+	while(*name) {
+		h ^= (unsigned char)*name++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+static Entry* findSlot(Entry* table, unsigned capacity, unsigned hash,
+	const char* mangled, int options)
+{
+	unsigned i = hash & (capacity - 1);
+	while(table[i].mangled) {
+		Entry* e = table + i;
+		if(e->hash == hash && e->options == options && strcmp(e->mangled, mangled) == 0)
+			return e;
+		i = (i + 1) & (capacity - 1);
+	}
+	return table + i;
+}
+
+/* Makes room for count more names. Returns 0 if out of memory. */
+static int reserve(unsigned count) {
+	unsigned newCapacity = sCapacity ? sCapacity : MIN_CAPACITY;
+	Entry* newTable;
+	unsigned i;
+	while((sCount + count) * 2 > newCapacity)
+		newCapacity *= 2;
+	if(newCapacity == sCapacity)
+		return 1;
+	newTable = (Entry*)calloc(newCapacity, sizeof(Entry));
+	if(!newTable)
+		return 0;
+	for(i = 0; i < sCapacity; i++) {
+		Entry* e = sTable + i;
+		if(e->mangled)
+			*findSlot(newTable, newCapacity, e->hash, e->mangled, e->options) = *e;
+	}
+	free(sTable);
+	sTable = newTable;
+	sCapacity = newCapacity;
+	return 1;
+}
+
+static char* copyString(const char* s) {
+	size_t len = strlen(s) + 1;
+	char* c = (char*)malloc(len);
+	if(c)
+		memcpy(c, s, len);
+	return c;
+}
+
+static const char* lookup(const char* mangled, int options) {
+	unsigned hash = hashName(mangled, options);
+	Entry* e = findSlot(sTable, sCapacity, hash, mangled, options);
+	if(e->mangled)
+		return e->demangled;
+
+	e->mangled = copyString(mangled);
+	if(!e->mangled)
+		return mangled;
+	e->demangled = cplus_demangle_v3(mangled, options);
+	if(!e->demangled)
+		e->demangled = e->mangled;
+	e->hash = hash;
+	e->options = options;
+	sCount++;
+	return e->demangled;
+}
+
+const char* demangle_cached(const char* mangled, int options) {
+	if(!reserve(1))
+		return mangled;
+	return lookup(mangled, options);
+}
+
+void demangle_batch(const char* const* mangled, const char** results, int count, int options) {
+	int i;
+	if(count <= 0)
+		return;
+	/* assume most names are new, so the table is grown at most once. */
+	if(!reserve((unsigned)count)) {
+		for(i = 0; i < count; i++)
+			results[i] = demangle_cached(mangled[i], options);
+		return;
+	}
+	for(i = 0; i < count; i++)
+		results[i] = lookup(mangled[i], options);
+}
+
+void demangle_cache_clear(void) {
+	unsigned i;
+	for(i = 0; i < sCapacity; i++) {
+		Entry* e = sTable + i;
+		if(e->mangled) {
+			if(e->demangled != e->mangled)
+				free(e->demangled);
+			free(e->mangled);
+		}
+	}
+	free(sTable);
+	sTable = NULL;
+	sCapacity = 0;
+	sCount = 0;
+}
@@ -0,0 +1,45 @@
+/* Copyright 2013 David Axmark
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef DEMANGLE_CACHE_H
+#define DEMANGLE_CACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A cache in front of cplus_demangle_v3().
+ * Each mangled name is demangled once per set of DMGL_* options; later calls
+ * return the same string. The strings are owned by the cache and stay valid
+ * until demangle_cache_clear() is called.
+ * Not thread-safe.
+ */
+
+/* Returns the demangled form of mangled, or a copy of mangled if it can't be demangled. */
+const char* demangle_cached(const char* mangled, int options);
+
+/* Demangles count names, for a whole symbol table at a time.
+ * results[i] is set as by demangle_cached(mangled[i], options).
+ */
+void demangle_batch(const char* const* mangled, const char** results, int count, int options);
+
+/* Frees all cached strings. */
+void demangle_cache_clear(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* DEMANGLE_CACHE_H */
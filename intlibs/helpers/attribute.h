@@ -23,10 +23,12 @@ limitations under the License.
 
 #define ATTRIB(a) __attribute__ ((a))
 #define GCCATTRIB(a) __attribute__ ((a))
+#define THREAD_LOCAL __thread
 #elif defined(_MSC_VER)
 #define ATTRIBUTE(a, func)  __declspec (a) func
 #define ATTRIB(a) __declspec (a)
 #define GCCATTRIB(a)
+#define THREAD_LOCAL __declspec (thread)
 #else
 #error Unsupported compiler!
 #endif
@@ -157,6 +157,9 @@ void streamIoctlFunction(ostream& stream, const Interface& inf, const Function&
 void streamCppDefs(ostream& stream, const Interface& inf, int ix, const string& headerName);
 
 void streamInvokeSyscall(ostream&, const Interface&, bool java, int argOffset = 0);
+//Like above, but each syscall's block is preceded by prefix instead of streamInvokePrefix.
+typedef void (*InvokePrefixFunc)(ostream&, const Function&);
+void streamInvokeSyscall(ostream&, const Interface&, bool java, int argOffset, InvokePrefixFunc prefix);
 void streamHeaderFunctions(ostream& stream, const Interface& inf, bool syscall);
 
 std::string getCSharpType(const Interface& maapi, const std::string& maapiType, bool in);
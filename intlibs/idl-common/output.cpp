@@ -954,9 +954,15 @@ void streamCppDefs(ostream& stream, const Interface& inf, int ix, const string&
 }
 
 void streamInvokeSyscall(ostream& stream, const Interface& maapi, bool java, int argOffset) {
+	streamInvokeSyscall(stream, maapi, java, argOffset, streamInvokePrefix);
+}
+
+void streamInvokeSyscall(ostream& stream, const Interface& maapi, bool java, int argOffset,
+	InvokePrefixFunc prefix)
+{
 	for(size_t i=0; i<maapi.functions.size(); i++) {
 		const Function& f(maapi.functions[i]);
-		streamInvokePrefix(stream, f);
+		prefix(stream, f);
 		stream << "{\n"
 		"\tLOGSC(\"\\t" << f.name << "(\");\n";
 		int ireg = argOffset;
@@ -14,6 +14,7 @@ limitations under the License.
 */
 
 #include <fstream>
+#include <sstream>
 #include <string>
 #include <stack>
 
@@ -34,6 +35,7 @@ limitations under the License.
 #include "stabs_symbols.h"
 #include "stabs_static.h"
 #include "stabs_typedefs.h"
+#include "stabs_index.h"
 
 using namespace std;
 
@@ -66,36 +68,59 @@ void addFile(int file,const std::string& fileName) {
 	addSymbolFile(file, fileName);
 }
 
+//Parses the lines of in. lineNumber is that of the first one, for error messages.
+static bool parseStabStream(istream& in, int lineNumber) {
+	string line;
+	while(in.good()) {
+		getline(in, line);
+		if(!in.good())
+			break;
+		bool ret = parseStabLine(line);
+		if(!ret) {
+			LOG("Invalid line %d in stabs.tab\n", lineNumber);
+			FAIL;
+		}
+		lineNumber++;
+	}
+	return in.eof();
+}
+
 bool loadStabs(const char* sld, const char* stabs) {
 	gCurrentFile = -1;
 	{
 		Timer t("loadSLD");
 		TEST(loadSLD(sld));
 	}
+	{
+		Timer t("loadStabsIndex");
+		if(loadStabsIndex(sld, stabs))
+			return sLoaded = true;
+	}
 	{
 		Timer t("parseStabs");
 		ifstream in(stabs);
-		string line;
-		int lineNumber = 1;
-		while(in.good()) {
-			getline(in, line);
-			if(!in.good())
-				break;
-			bool ret = parseStabLine(line);
-			if(!ret) {
-				LOG("Invalid line %d in stabs.tab\n", lineNumber);
-				FAIL;
-			}
-			lineNumber++;
-		}
+		bool ret = parseStabStream(in, 1);
 		gCurrentFile = -1;
-		TEST(in.eof());
+		TEST(ret);
 	}
 	Timer t("resolveAll");
 	TEST(DelayedType::resolveAll());
 	return sLoaded = true;
 }
 
+bool parseStabsFile(const std::string& text, int lineNumber) {
+	istringstream in(text);
+	gLastFunction = NULL;
+	while(!sBracStack.empty()) {
+		sBracStack.pop();
+	}
+	bool ret = parseStabStream(in, lineNumber);
+	checkLastFunctionIntegrity();
+	gLastFunction = NULL;
+	gCurrentFile = -1;
+	return ret;
+}
+
 bool stabsIsLoaded() {
 	return sLoaded;
 }
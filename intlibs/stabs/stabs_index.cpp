@@ -0,0 +1,491 @@
+/* Copyright 2013 David Axmark
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+//todo: cleanup
+#define LOGGING_ENABLED
+#define CONFIG_H
+
+#include "helpers/helpers.h"
+
+#include "sld.h"
+
+#include "stabs_index.h"
+#include "stabs_file.h"
+#include "stabs_typedefs.h"
+
+using std::map;
+using std::pair;
+using std::string;
+using std::vector;
+
+//The index file is all native ints:
+//	header
+//	files: file, begin, end, firstLine; in file order.
+//	functions: address, file; in address order.
+//	variables: address, file; in address order.
+//	globals: name, file; in name order.
+//	types: name, file; in name order, then file order.
+//	strings: zero-terminated. names are offsets into this block.
+#define STABS_INDEX_MAGIC 0x58445453	//STDX
+#define STABS_INDEX_VERSION 1
+
+struct IndexStamp {
+	int size, timeLow, timeHigh;
+	bool operator==(const IndexStamp& o) const {
+		return size == o.size && timeLow == o.timeLow && timeHigh == o.timeHigh;
+	}
+};
+
+struct IndexHeader {
+	int magic, version;
+	IndexStamp stabs, sld;
+	int nFiles, nFunctions, nVariables, nGlobals, nTypes, stringSize;
+};
+
+struct IndexFile {
+	int file, begin, end, firstLine;
+};
+
+struct IndexEntry {
+	int key, file;
+};
+
+static vector<int> sIndex;
+static const IndexHeader* sHeader = NULL;
+static const IndexFile* sFiles;
+static const IndexEntry* sFunctions;
+static const IndexEntry* sVariables;
+static const IndexEntry* sGlobals;
+static const IndexEntry* sTypes;
+static const char* sStrings;
+
+static string sStabsName;
+static vector<bool> sFileLoaded;
+static int sLoadDepth = 0;
+
+static bool getStamp(const char* filename, IndexStamp& stamp) {
+	struct stat st;
+	if(stat(filename, &st) != 0)
+		return false;
+	long long mtime = st.st_mtime;
+	stamp.size = (int)st.st_size;
+	stamp.timeLow = (int)mtime;
+	stamp.timeHigh = (int)(mtime >> 32);
+	return true;
+}
+
+static bool readWholeFile(const char* filename, string& data) {
+	FILE* file = fopen(filename, "rb");
+	if(!file)
+		return false;
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	bool ok = size >= 0;
+	if(ok) {
+		data.resize(size);
+		ok = size == 0 || fread(&data[0], size, 1, file) == 1;
+	}
+	fclose(file);
+	return ok;
+}
+
+//Collects the index while stabs.tab is scanned.
+class IndexBuilder {
+public:
+	vector<IndexFile> files;
+	vector<pair<int, int> > functions, variables, globals, types;
+
+	int addString(const char* s, size_t len) {
+		pair<map<string, int>::iterator, bool> res =
+			mStringMap.insert(pair<string, int>(string(s, len), (int)mStrings.size()));
+		if(res.second) {
+			mStrings.insert(mStrings.end(), s, s + len);
+			mStrings.push_back(0);
+		}
+		return res.first->second;
+	}
+	const vector<char>& strings() const { return mStrings; }
+private:
+	map<string, int> mStringMap;
+	vector<char> mStrings;
+};
+
+struct name_file_less {
+	const vector<char>& s;
+	name_file_less(const vector<char>& _s) : s(_s) {}
+	bool operator()(const pair<int, int>& a, const pair<int, int>& b) const {
+		int res = strcmp(&s[a.first], &s[b.first]);
+		if(res != 0)
+			return res < 0;
+		return a.second < b.second;
+	}
+};
+
+//Returns the length of the symbol name at the start of text; the part before its colon.
+//If doubleColons, a double colon is part of the name, as in parseLSym().
+static size_t nameLength(const char* text, const char* end, bool doubleColons) {
+	const char* colon = text;
+	while(colon < end) {
+		if(*colon == ':') {
+			if(!doubleColons || colon + 1 >= end || colon[1] != ':')
+				break;
+			colon++;
+		}
+		colon++;
+	}
+	return colon - text;
+}
+
+static bool stabIs(const char* line, size_t nameLen, const char* name) {
+	return nameLen == strlen(name) && strncmp(line, name, nameLen) == 0;
+}
+
+//Scans the stabs without parsing types; only what the index needs.
+//Anything unexpected fails, so that the full parser can report it.
+static bool scanStabs(const string& data, IndexBuilder& b) {
+	int file = -1;
+	int lineNumber = 1;
+	size_t pos = 0;
+	while(pos < data.size()) {
+		const char* line = data.c_str() + pos;
+		const char* nl = (const char*)memchr(line, '\n', data.size() - pos);
+		if(!nl)	//the full parser ignores an unterminated last line.
+			break;
+		size_t lineLen = nl - line;
+		size_t lineStart = pos;
+		pos += lineLen + 1;
+		lineNumber++;
+
+		FAILIF(lineLen < 4);
+		if(line[0] == '/')
+			continue;
+		const char* space = (const char*)memchr(line, ' ', lineLen);
+		FAILIF(!space);
+		size_t stabLen = space - line;
+		if(line[0] == '#') {	//N_LBRAC and friends only matter inside functions.
+			FAILIF(file < 0);
+			continue;
+		}
+		char* next;
+		int a = strtol(space, &next, 0);
+		FAILIF(next == space);
+		const char* bStart = next;
+		int bValue = strtol(bStart, &next, 0);
+		FAILIF(next == bStart);
+		while(*next == ' ')
+			next++;
+		FAILIF(*next != '\'' || nl[-1] != '\'' || next >= nl - 1);
+		const char* text = next + 1;
+		const char* textEnd = nl - 1;
+
+		if(stabIs(line, stabLen, "N_FILE")) {
+			if(!b.files.empty())
+				b.files.back().end = (int)lineStart;
+			IndexFile f;
+			f.file = a + 1;
+			f.begin = (int)lineStart;
+			f.end = (int)data.size();
+			f.firstLine = lineNumber - 1;
+			FAILIF(!b.files.empty() && b.files.back().file >= f.file);
+			b.files.push_back(f);
+			file = f.file;
+			continue;
+		}
+		FAILIF(file < 0);
+		if(stabIs(line, stabLen, "N_FUN")) {
+			size_t len = nameLength(text, textEnd, false);
+			FAILIF(text + len + 1 >= textEnd);
+			b.functions.push_back(pair<int, int>(bValue, file));
+			if(text[len + 1] == 'F')
+				b.globals.push_back(pair<int, int>(b.addString(text, len), file));
+		} else if(stabIs(line, stabLen, "N_THUNK")) {
+			b.functions.push_back(pair<int, int>(-(file*10000 + a), file));
+		} else if(stabIs(line, stabLen, "N_GSYM")) {
+			size_t len = nameLength(text, textEnd, false);
+			string name(text, len);
+			int address = mapVariable(name.c_str(), file - 1);
+			if(address >= 0) {	//parseGSym() skips the others.
+				b.variables.push_back(pair<int, int>(address, file));
+				b.globals.push_back(pair<int, int>(b.addString(text, len), file));
+			}
+		} else if(stabIs(line, stabLen, "N_STSYM") || stabIs(line, stabLen, "N_LCSYM")) {
+			size_t len = nameLength(text, textEnd, false);
+			FAILIF(text + len + 1 >= textEnd);
+			if(text[len + 1] == 'S')
+				b.variables.push_back(pair<int, int>(bValue, file));
+		} else if(stabIs(line, stabLen, "N_LSYM")) {
+			size_t len = nameLength(text, textEnd, true);
+			FAILIF(text + len + 1 >= textEnd);
+			char declType = text[len + 1];
+			if(declType == 't' || declType == 'T')
+				b.types.push_back(pair<int, int>(b.addString(text, len), file));
+		}
+	}
+	return true;
+}
+
+static void putEntries(vector<int>& dst, const vector<pair<int, int> >& src) {
+	for(size_t i=0; i<src.size(); i++) {
+		dst.push_back(src[i].first);
+		dst.push_back(src[i].second);
+	}
+}
+
+//Points the tables into sIndex. Returns false if it's the wrong size.
+static bool setupIndex() {
+	sHeader = NULL;
+	FAILIF(sIndex.size() * sizeof(int) < sizeof(IndexHeader));
+	const IndexHeader* h = (IndexHeader*)&sIndex[0];
+	FAILIF(h->nFiles < 0 || h->nFunctions < 0 || h->nVariables < 0 ||
+		h->nGlobals < 0 || h->nTypes < 0 || h->stringSize < 0);
+	size_t nInts = sizeof(IndexHeader) / sizeof(int) + (size_t)h->nFiles * 4 +
+		((size_t)h->nFunctions + h->nVariables + h->nGlobals + h->nTypes) * 2;
+	size_t nStringInts = (h->stringSize + sizeof(int) - 1) / sizeof(int);
+	FAILIF(sIndex.size() != nInts + nStringInts);
+
+	const int* p = &sIndex[0] + sizeof(IndexHeader) / sizeof(int);
+	sFiles = (IndexFile*)p;
+	p += h->nFiles * 4;
+	sFunctions = (IndexEntry*)p;
+	p += h->nFunctions * 2;
+	sVariables = (IndexEntry*)p;
+	p += h->nVariables * 2;
+	sGlobals = (IndexEntry*)p;
+	p += h->nGlobals * 2;
+	sTypes = (IndexEntry*)p;
+	p += h->nTypes * 2;
+	sStrings = (char*)p;
+	FAILIF(h->stringSize > 0 && sStrings[h->stringSize - 1] != 0);
+	for(int i=0; i<h->nGlobals; i++) {
+		FAILIF((uint)sGlobals[i].key >= (uint)h->stringSize);
+	}
+	for(int i=0; i<h->nTypes; i++) {
+		FAILIF((uint)sTypes[i].key >= (uint)h->stringSize);
+	}
+	sHeader = h;
+	return true;
+}
+
+static bool makeIndex(const char* sld, const char* stabs) {
+	IndexHeader h;
+	TEST(getStamp(stabs, h.stabs));
+	TEST(getStamp(sld, h.sld));
+	string data;
+	TEST(readWholeFile(stabs, data));
+	IndexBuilder b;
+	TEST(scanStabs(data, b));
+
+	std::sort(b.functions.begin(), b.functions.end());
+	std::sort(b.variables.begin(), b.variables.end());
+	std::sort(b.globals.begin(), b.globals.end(), name_file_less(b.strings()));
+	std::sort(b.types.begin(), b.types.end(), name_file_less(b.strings()));
+
+	h.magic = STABS_INDEX_MAGIC;
+	h.version = STABS_INDEX_VERSION;
+	h.nFiles = (int)b.files.size();
+	h.nFunctions = (int)b.functions.size();
+	h.nVariables = (int)b.variables.size();
+	h.nGlobals = (int)b.globals.size();
+	h.nTypes = (int)b.types.size();
+	h.stringSize = (int)b.strings().size();
+
+	sIndex.clear();
+	sIndex.insert(sIndex.end(), (int*)&h, (int*)(&h + 1));
+	for(size_t i=0; i<b.files.size(); i++) {
+		const IndexFile& f(b.files[i]);
+		sIndex.push_back(f.file);
+		sIndex.push_back(f.begin);
+		sIndex.push_back(f.end);
+		sIndex.push_back(f.firstLine);
+	}
+	putEntries(sIndex, b.functions);
+	putEntries(sIndex, b.variables);
+	putEntries(sIndex, b.globals);
+	putEntries(sIndex, b.types);
+	size_t stringStart = sIndex.size();
+	sIndex.resize(stringStart + (h.stringSize + sizeof(int) - 1) / sizeof(int), 0);
+	if(h.stringSize > 0)
+		memcpy(&sIndex[stringStart], &b.strings()[0], h.stringSize);
+	return setupIndex();
+}
+
+static string indexName(const char* stabs) {
+	return string(stabs) + ".idx";
+}
+
+static bool writeIndex(const char* stabs) {
+	string name = indexName(stabs);
+	FILE* file = fopen(name.c_str(), "wb");
+	if(!file)
+		return false;
+	bool ok = fwrite(&sIndex[0], sIndex.size() * sizeof(int), 1, file) == 1;
+	fclose(file);
+	if(!ok)
+		remove(name.c_str());
+	return ok;
+}
+
+//Returns false if the index is missing, stale or broken.
+static bool readIndex(const char* sld, const char* stabs) {
+	IndexStamp stabsStamp, sldStamp;
+	TEST(getStamp(stabs, stabsStamp));
+	TEST(getStamp(sld, sldStamp));
+
+	string name = indexName(stabs);
+	FILE* file = fopen(name.c_str(), "rb");
+	if(!file)
+		return false;
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	bool ok = size >= (long)sizeof(IndexHeader) && size % sizeof(int) == 0;
+	if(ok) {
+		sIndex.resize(size / sizeof(int));
+		ok = fread(&sIndex[0], size, 1, file) == 1;
+	}
+	fclose(file);
+	if(!ok)
+		return false;
+	const IndexHeader* h = (IndexHeader*)&sIndex[0];
+	if(h->magic != STABS_INDEX_MAGIC || h->version != STABS_INDEX_VERSION ||
+		!(h->stabs == stabsStamp) || !(h->sld == sldStamp))
+		return false;
+	return setupIndex();
+}
+
+bool buildStabsIndex(const char* sld, const char* stabs) {
+	TEST(makeIndex(sld, stabs));
+	return writeIndex(stabs);
+}
+
+bool loadStabsIndex(const char* sld, const char* stabs) {
+	if(!readIndex(sld, stabs)) {
+		if(!makeIndex(sld, stabs)) {
+			sIndex.clear();
+			sHeader = NULL;
+			return false;
+		}
+		if(!writeIndex(stabs)) {
+			LOG("Could not write %s\n", indexName(stabs).c_str());
+		}
+	}
+	sStabsName = stabs;
+	sFileLoaded.assign(sHeader->nFiles, false);
+	return true;
+}
+
+static void loadIndexedFile(int i) {
+	if(sFileLoaded[i])
+		return;
+	sFileLoaded[i] = true;
+	const IndexFile& f(sFiles[i]);
+
+	string text;
+	FILE* file = fopen(sStabsName.c_str(), "rb");
+	bool ok = file != NULL && f.end >= f.begin && fseek(file, f.begin, SEEK_SET) == 0;
+	if(ok) {
+		text.resize(f.end - f.begin);
+		ok = text.empty() || fread(&text[0], text.size(), 1, file) == 1;
+	}
+	if(file)
+		fclose(file);
+
+	//resolving one file's types may need another file's,
+	//whose delayed types are then resolved in the same pass.
+	int oldFile = gCurrentFile;
+	sLoadDepth++;
+	if(ok)
+		ok = parseStabsFile(text, f.firstLine);
+	if(sLoadDepth == 1)
+		DelayedType::resolveAll();
+	sLoadDepth--;
+	gCurrentFile = oldFile;
+	if(!ok) {
+		LOG("Could not load the stabs of file %i\n", f.file);
+	}
+}
+
+struct index_file_less {
+	bool operator()(const IndexFile& f, int file) const {
+		return f.file < file;
+	}
+};
+
+struct index_address_less {
+	bool operator()(const IndexEntry& e, int address) const {
+		return e.key < address;
+	}
+};
+
+struct index_name_less {
+	bool operator()(const IndexEntry& e, const char* name) const {
+		return strcmp(sStrings + e.key, name) < 0;
+	}
+};
+
+void stabsIndexLoadFile(int fileScope) {
+	if(!sHeader)
+		return;
+	const IndexFile* end = sFiles + sHeader->nFiles;
+	const IndexFile* f = std::lower_bound(sFiles, end, fileScope, index_file_less());
+	if(f != end && f->file == fileScope)
+		loadIndexedFile(int(f - sFiles));
+}
+
+static void loadByAddress(const IndexEntry* entries, int count, int address) {
+	const IndexEntry* end = entries + count;
+	const IndexEntry* e = std::lower_bound(entries, end, address, index_address_less());
+	if(e != end && e->key == address)
+		stabsIndexLoadFile(e->file);
+}
+
+void stabsIndexLoadFunction(int address) {
+	if(sHeader)
+		loadByAddress(sFunctions, sHeader->nFunctions, address);
+}
+
+void stabsIndexLoadVariable(int address) {
+	if(sHeader)
+		loadByAddress(sVariables, sHeader->nVariables, address);
+}
+
+//the first file with the name, which is the one findTypeByNameAndFileGlobal() would pick.
+static void loadByName(const IndexEntry* entries, int count, const string& name) {
+	const IndexEntry* end = entries + count;
+	const IndexEntry* e = std::lower_bound(entries, end, name.c_str(), index_name_less());
+	if(e != end && name == sStrings + e->key)
+		stabsIndexLoadFile(e->file);
+}
+
+void stabsIndexLoadGlobal(const string& name) {
+	if(sHeader)
+		loadByName(sGlobals, sHeader->nGlobals, name);
+}
+
+void stabsIndexLoadType(const string& name) {
+	if(sHeader)
+		loadByName(sTypes, sHeader->nTypes, name);
+}
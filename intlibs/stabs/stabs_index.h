@@ -0,0 +1,49 @@
+/* Copyright 2013 David Axmark
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef STABS_INDEX_H
+#define STABS_INDEX_H
+
+#include <string>
+
+//The stabs index, "<stabs>.idx", lets the debugger start without parsing stabs.tab.
+//It holds the byte range of each file's stabs (from its N_FILE to the next one),
+//and which file defines each function and variable address, each global symbol
+//and each type name. A file's functions, variables and types are parsed the first
+//time a lookup needs them.
+//
+//The index is rebuilt whenever the size or modification time of the stabs or the SLD
+//differs from the ones it was made from. The SLD must be loaded first.
+
+//Writes the index for stabs. Returns false on failure.
+bool buildStabsIndex(const char* sld, const char* stabs);
+
+//Loads the index for stabs, building it first if needed.
+//Returns false if the stabs can't be indexed; they must then be parsed in full.
+bool loadStabsIndex(const char* sld, const char* stabs);
+
+//Each of these parses the file that holds the requested symbol or type,
+//unless it has been parsed already. They do nothing if no index is loaded.
+void stabsIndexLoadFile(int fileScope);
+void stabsIndexLoadFunction(int address);
+void stabsIndexLoadVariable(int address);
+void stabsIndexLoadGlobal(const std::string& name);
+void stabsIndexLoadType(const std::string& name);
+
+//Parses the stabs of one file, starting at lineNumber in the stabs file.
+//Defined in stabs.cpp.
+bool parseStabsFile(const std::string& text, int lineNumber);
+
+#endif	//STABS_INDEX_H
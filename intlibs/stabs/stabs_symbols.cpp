@@ -24,6 +24,7 @@ limitations under the License.
 #include "stabs.h"
 #include "stabs_symbols.h"
 #include "stabs_file.h"
+#include "stabs_index.h"
 
 using namespace std;
 
@@ -104,6 +105,7 @@ void addVariable(Symbol* s) {
 }
 
 const Symbol* stabsGetSymbolByScopeAndName(int scope, const std::string& name) {
+	stabsIndexLoadFile(scope);
 	Symbol s(eNone);
 	s.fileScope = scope;
 	s.name = name;
@@ -125,6 +127,7 @@ static const Symbol* getSymbolByAddress(SymbolSet& ss, int address) {
 struct Function;
 
 const Function* stabsGetFunctionByAddress(int address) {
+	stabsIndexLoadFunction(address);
 	const Symbol* s = getSymbolByAddress(sFunctionSet, address);
 	if(!s)
 		return NULL;
@@ -135,6 +138,7 @@ const Function* stabsGetFunctionByAddress(int address) {
 struct StaticVariable;
 
 const StaticVariable* stabsGetVariableByAddress(int address) {
+	stabsIndexLoadVariable(address);
 	const Symbol* s = getSymbolByAddress(sVariableSet, address);
 	if(!s)
 		return NULL;
@@ -143,6 +147,7 @@ const StaticVariable* stabsGetVariableByAddress(int address) {
 }
 
 const Symbol* stabsGetSymbolGlobal(const std::string& name) {
+	stabsIndexLoadGlobal(name);
 	Symbol s(eNone);
 	s.name = name;
 	SymbolNameSet::const_iterator itr = sSymbolGlobalSet.find(&s);
@@ -25,6 +25,7 @@ limitations under the License.
 #include "stabs_types.h"
 #include "stabs_file.h"
 #include "stabs.h"
+#include "stabs_index.h"
 
 using namespace std;
 
@@ -100,7 +101,9 @@ void addTypeFile(int file, const std::string& fileName) {
 		sTypeTupleSets.resize(file + 1);
 		sTypeNameSets.resize(file + 1);
 		sTypeFiles.resize(file + 1);
-
+	}
+	//with the stabs index, files are not necessarily added in order.
+	if(!sTypeTupleSets[file]) {
 		sTypeTupleSets[file] = new TypeTupleSet;
 		sTypeNameSets[file] = new TypeNameSet;
 	}
@@ -163,8 +166,10 @@ const Type* stabsFindTypeByName(const std::string& name, int scope) {
 }
 
 const TypeBase* findTypeByNameAndFileGlobal(const std::string& name, int scope) {
+	stabsIndexLoadFile(scope);
 	const Type* type = stabsFindTypeByName(name, scope);
 	if(type) return type->type;
+	stabsIndexLoadType(name);
 
 	// okay we didn't find it in the local scope, let's
 	// search through all scopes. If we get multiple hits
@@ -94,17 +94,37 @@ public:
 	}
 };
 
-// Handle counters.
-static int gDatabaseHandle = 0;
-static int gCursorHandle = 0;
+// State of one Syscall. Created on first use.
+struct MoSyncDBState {
+	// Handle counters.
+	int databaseHandle;
+	int cursorHandle;
 
-// Object tables.
-static HashMapNoDelete<sqlite3> gDatabaseTable;
-static HashMap<MoDBCursor> gCursorTable;
+	// Object tables.
+	HashMapNoDelete<sqlite3> databaseTable;
+	HashMap<MoDBCursor> cursorTable;
+
+	MoSyncDBState() : databaseHandle(0), cursorHandle(0) {}
+};
+
+static VM_THREAD_LOCAL MoSyncDBState* gpDB = NULL;
+
+static MoSyncDBState& MoDBState() {
+	if(gpDB == NULL)
+		gpDB = new MoSyncDBState;
+	return *gpDB;
+}
+
+#define gDatabaseHandle (MoDBState().databaseHandle)
+#define gCursorHandle (MoDBState().cursorHandle)
+#define gDatabaseTable (MoDBState().databaseTable)
+#define gCursorTable (MoDBState().cursorTable)
 
 void MoSyncDBInit(void) {
 }
 void MoSyncDBClose(void) {
+	if(gpDB == NULL)
+		return;
 	gCursorTable.close();
 
 	HashMapNoDelete<sqlite3>::TIteratorC itr = gDatabaseTable.begin();
@@ -112,6 +132,9 @@ void MoSyncDBClose(void) {
 		sqlite3_close(itr.next().value);
 	}
 	gDatabaseTable.close();
+
+	delete gpDB;
+	gpDB = NULL;
 }
 
 static sqlite3* MoDBGetDatabase(MAHandle databaseHandle)
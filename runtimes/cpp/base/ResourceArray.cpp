@@ -60,6 +60,10 @@ namespace Base {
 		mDynResPoolSize(0),
 		mDynResPoolCapacity(0),
 		mDynResPool(NULL)
+#ifdef VM_SNAPSHOTS
+		, mLoadedRes(NULL)
+		, mLoadedResSize(0)
+#endif
 	{
 	}
 
@@ -122,6 +126,9 @@ namespace Base {
 		if(mDynResPool) {
 			delete[] mDynResPool;
 		}
+#ifdef VM_SNAPSHOTS
+		delete[] mLoadedRes;
+#endif
 	}
 
 	void ResourceArray::destroy(unsigned index) {
@@ -320,6 +327,28 @@ namespace Base {
 		return RES_OK;
 	}
 
+#ifdef RESOURCE_MEMORY_LIMIT
+	uint ResourceArray::getResmemOfType(byte type) {
+		uint total = 0;
+		for(unsigned i = 0; i < mResSize; i++) {
+			if(mResTypes[i] != type || mRes[i] == NULL)
+				continue;
+			switch(type) {
+#define CASE_SUMMEM(R, T, D) case R: total += size_##R((T*)mRes[i]); break;
+				TYPES(CASE_SUMMEM);
+			}
+		}
+		for(unsigned i = 0; i < mDynResSize; i++) {
+			if(mDynResTypes[i] != type || mDynRes[i] == NULL)
+				continue;
+			switch(type) {
+				TYPES(CASE_SUMMEM);
+			}
+		}
+		return total;
+	}
+#endif
+
 	void ResourceArray::logEverything() {
 #ifdef LOGGING_ENABLED
 #define RESOURCE_STRINGS(R, T, D) resourceStrings[R] = #R;
@@ -505,5 +534,127 @@ LOGD("%s: %s %s %i\n", #R, #D, #T, index); break;
 		res[index] = NULL;
 		types[index] = RT_PLACEHOLDER;
 	}
+
+#ifdef VM_SNAPSHOTS
+	void ResourceArray::markLoaded() {
+		delete[] mLoadedRes;
+		mLoadedRes = new void*[mResSize];
+		MYASSERT(mLoadedRes != NULL, ERR_OOM);
+		memcpy(mLoadedRes, mRes, mResSize * sizeof(void*));
+		mLoadedResSize = mResSize;
+	}
+
+	bool ResourceArray::saveSlot(Stream& out, ResourceSerializer& serializer,
+		void* obj, byte type)
+	{
+		TEST(out.writeObject(type));
+		byte hasObj = obj != NULL;
+		TEST(out.writeObject(hasObj));
+		if(hasObj) {
+			if(!serializer.save(out, type, obj)) {
+				LOG("Resource type %i can't be saved in a snapshot.\n", type);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool ResourceArray::loadSlot(Stream& in, ResourceSerializer& serializer, unsigned index) {
+		byte type, hasObj;
+		TEST(in.readObject(type));
+		TEST(in.readObject(hasObj));
+		if(hasObj) {
+			void* obj = serializer.load(in, type);
+			TEST(obj);
+			return _add(index, obj, type) == RES_OK;
+		}
+		if(index & DYNAMIC_PLACEHOLDER_BIT)
+			mDynResTypes[index & ~DYNAMIC_PLACEHOLDER_BIT] = type;
+		else
+			mResTypes[index] = type;
+		return true;
+	}
+
+	//Loaded binaries that live in memory can be changed in place,
+	//by maWriteData and others, so they are always saved.
+	static bool isWritable(void* obj, byte type) {
+		return type == RT_BINARY && obj != NULL && ((RT_BINARY_Type*)obj)->ptr() != NULL;
+	}
+
+	bool ResourceArray::saveSnapshot(Stream& out, ResourceSerializer& serializer) {
+		TEST(mLoadedRes);
+		TEST(out.writeObject(mLoadedResSize));
+		for(unsigned i=1; i<mResSize; i++) {
+			if(i < mLoadedResSize && mRes[i] == mLoadedRes[i] &&
+				!isWritable(mRes[i], mResTypes[i]))
+				continue;
+			TEST(out.writeObject(i));
+			TEST(saveSlot(out, serializer, mRes[i], mResTypes[i]));
+		}
+		unsigned end = 0;
+		TEST(out.writeObject(end));
+
+		TEST(out.writeObject(mDynResSize));
+		for(unsigned i=1; i<mDynResSize; i++) {
+			TEST(saveSlot(out, serializer, mDynRes[i], mDynResTypes[i]));
+		}
+		TEST(out.writeObject(mDynResPoolSize));
+		TEST(out.write(mDynResPool, mDynResPoolSize * sizeof(unsigned)));
+		return true;
+	}
+
+	bool ResourceArray::loadSnapshot(Stream& in, ResourceSerializer& serializer) {
+		unsigned resSize;
+		TEST(in.readObject(resSize));
+		if(resSize != mResSize) {
+			LOG("Snapshot has %i resources; the resource file has %i.\n", resSize, mResSize);
+			FAIL;
+		}
+		while(true) {
+			unsigned i;
+			TEST(in.readObject(i));
+			if(i == 0)
+				break;
+			TESTINDEX(i, mResSize);
+			if(mRes[i] != NULL)
+				_destroy(i);
+			TEST(loadSlot(in, serializer, i));
+		}
+
+		//replace the dynamic arrays.
+		for(unsigned i=1; i<mDynResSize; ++i) {
+			if(mDynRes[i] != NULL)
+				_destroy(i | DYNAMIC_PLACEHOLDER_BIT);
+		}
+		delete[] mDynRes;
+		delete[] mDynResTypes;
+		delete[] mDynResPool;
+		mDynRes = NULL;
+		mDynResTypes = NULL;
+		mDynResPool = NULL;
+
+		TEST(in.readObject(mDynResSize));
+		TEST(mDynResSize >= 1);
+		mDynResCapacity = mDynResSize;
+		mDynRes = new void*[mDynResCapacity];
+		MYASSERT(mDynRes != NULL, ERR_OOM);
+		mDynResTypes = new byte[mDynResCapacity];
+		MYASSERT(mDynResTypes != NULL, ERR_OOM);
+		memset(mDynRes, 0, mDynResCapacity * sizeof(void*));
+		memset(mDynResTypes, RT_PLACEHOLDER, mDynResCapacity);
+		for(unsigned i=1; i<mDynResSize; i++) {
+			TEST(loadSlot(in, serializer, i | DYNAMIC_PLACEHOLDER_BIT));
+		}
+
+		TEST(in.readObject(mDynResPoolSize));
+		mDynResPoolCapacity = mDynResPoolSize;
+		if(mDynResPoolCapacity > 0) {
+			mDynResPool = new unsigned[mDynResPoolCapacity];
+			MYASSERT(mDynResPool != NULL, ERR_OOM);
+			TEST(in.read(mDynResPool, mDynResPoolSize * sizeof(unsigned)));
+		}
+		return true;
+	}
+#endif	//VM_SNAPSHOTS
 }
 // End of namespace Base
@@ -37,6 +37,10 @@ using namespace MoSyncError;
 // should be found in the main cpp directory for the platform.
 #include "ResourceDefs.h"
 
+#ifdef VM_SNAPSHOTS
+#include "Stream.h"
+#endif
+
 namespace Base {
 
 	/**
@@ -80,6 +84,27 @@ namespace Base {
 
 #define ROOM(func) if((func) == RES_OUT_OF_MEMORY) { BIG_PHAT_ERROR(ERR_RES_OOM); }
 
+#ifdef VM_SNAPSHOTS
+	/**
+	 * Converts resource objects to and from a VM snapshot.
+	 * Implemented by the platform, as object types differ.
+	 */
+	class ResourceSerializer {
+	public:
+		virtual ~ResourceSerializer() {}
+
+		/**
+		 * @return false if the object can't be saved.
+		 */
+		virtual bool save(Stream& out, byte type, void* obj) = 0;
+
+		/**
+		 * @return A new object, or NULL on failure.
+		 */
+		virtual void* load(Stream& in, byte type) = 0;
+	};
+#endif
+
 	/**
 	 * Class that holds resources.
 	 * Internally, "resource" and "object" are used interchangably.
@@ -98,6 +123,12 @@ namespace Base {
 #ifdef RESOURCE_MEMORY_LIMIT
 		uint getResmemMax() const { return mResmemMax; }
 		uint getResmem() const { return mResmem; }
+
+		/**
+		 * Adds up the sizes of all objects of the given type.
+		 * Slow; it visits every object.
+		 */
+		uint getResmemOfType(byte type);
 #endif
 
 		/**
@@ -164,7 +195,36 @@ namespace Base {
 
 		void logEverything();
 
+#ifdef VM_SNAPSHOTS
+		/**
+		 * Remembers the static objects loaded from the resource file.
+		 * saveSnapshot() skips the ones that are still there and can't have been written to.
+		 */
+		void markLoaded();
+
+		/**
+		 * Writes all static slots that have changed since markLoaded(),
+		 * all writable static binaries, all dynamic slots and the placeholder pool.
+		 * @return false if an object can't be saved.
+		 */
+		bool saveSnapshot(Stream& out, ResourceSerializer& serializer);
+
+		/**
+		 * Applies a snapshot made by saveSnapshot() on top of a freshly
+		 * loaded resource file.
+		 */
+		bool loadSnapshot(Stream& in, ResourceSerializer& serializer);
+#endif
+
 	private:
+#ifdef VM_SNAPSHOTS
+		bool saveSlot(Stream& out, ResourceSerializer& serializer, void* obj, byte type);
+		bool loadSlot(Stream& in, ResourceSerializer& serializer, unsigned index);
+
+		// Static objects as they were after loading the resource file.
+		void** mLoadedRes;
+		unsigned mLoadedResSize;
+#endif
 
 		/**
 		 * Delete and add a resource ("dadd").
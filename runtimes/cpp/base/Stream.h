@@ -55,6 +55,9 @@ namespace Base {
 		template<class T> bool readObject(T& obj) {
 			return read(&obj, sizeof(T));
 		}
+		template<class T> bool writeObject(const T& obj) {
+			return write(&obj, sizeof(T));
+		}
 
 		//reads from this stream into all of dst. ignores dst's position.
 		bool readFully(MemStream& dst);
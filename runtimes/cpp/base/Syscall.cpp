@@ -23,6 +23,7 @@ limitations under the License.
 #include "Syscall.h"
 #include "FileStream.h"
 #include "MemStream.h"
+#include "TimelineTrace.h"
 #include <helpers/smartie.h>
 #include <filelist/filelist.h>
 
@@ -122,20 +123,36 @@ namespace Base {
 #endif	//_WIN32_WCE
 	typedef std::map<int, FileList> FileListMap;
 	typedef FileListMap::iterator FileListItr;
-	static FileListMap sFileListings;
-	static int sFileListNextHandle = 1;
+
+	struct Syscall::FileListings {
+		FileListMap lists;
+		int nextHandle;
+
+		//used by fileListCallback during maFileListStart.
+		FileList scan;
+		std::string scanRealDir;
+		int scanSorting;
+
+		FileListings() : nextHandle(1), scanSorting(0) {}
+	};
 #endif	//SYMBIAN
 
 	void Syscall::init() {
 		mPanicOnProgrammerError = true;
 		gStoreNextId = 1;
 		gFileNextHandle = 1;
+#ifndef SYMBIAN
+		gFileListings = new FileListings;
+#endif
 	}
 
 	Syscall::~Syscall() {
 		LOGD("~Syscall\n");
 		gStores.close();
 		gFileHandles.close();
+#ifndef SYMBIAN
+		delete gFileListings;
+#endif
 		platformDestruct();
 	}
 
@@ -143,6 +160,7 @@ namespace Base {
 	* Loads all resources from the given buffer.
 	*/
 	bool Syscall::loadResourcesFromBuffer(Stream& file, const char* aFilename)  {
+		TRACE_SPAN("loadResourcesFromBuffer", "resources");
 		bool hasResources = true;
 		if(!file.isOpen())
 			hasResources = false;
@@ -1462,10 +1480,7 @@ namespace Base {
 	}
 
 #ifndef SYMBIAN
-	static FileList sFileList;
-	static std::string sFileListRealDir;
 #ifndef _WIN32_WCE
-	static int sFileListSorting;
 #ifdef _WIN32
 	typedef ino_t _ino_t;
 #endif
@@ -1474,25 +1489,27 @@ namespace Base {
 	static void fileListCallback(const char* filename) {
 		if(!strcmp(filename, ".") || !strcmp(filename, ".."))
 			return;
+		Syscall::FileListings& fls(*SYSCALL_THIS->gFileListings);
+		FileList& scan(fls.scan);
 		std::string fn = filename;
-		if(isDirectory((sFileListRealDir + fn).c_str())) {
+		if(isDirectory((fls.scanRealDir + fn).c_str())) {
 			fn += "/";
 		}
 		struct FileListItem fli;
 		fli.name = fn;
 #ifdef _WIN32_WCE
-		sFileList.files.push_back(fli);
+		scan.files.push_back(fli);
 #else
-		fli.sorting = sFileListSorting;
-		if(sFileListSorting == MA_FL_SORT_NONE)
+		fli.sorting = fls.scanSorting;
+		if(fls.scanSorting == MA_FL_SORT_NONE)
 			// hack: we store an ordinal in st_ino.
 			// looks like it would break on Windows if a directory has
 			// more than 65k files. I don't care to fix it.
-			fli.s.st_ino = (ino_t)sFileList.files.size();
+			fli.s.st_ino = (ino_t)scan.files.size();
 		else
 			stat(fn.c_str(), &fli.s);
 
-		sFileList.files.insert(fli);
+		scan.files.insert(fli);
 #endif	//_WIN32_WCE
 	}
 
@@ -1540,20 +1557,19 @@ namespace Base {
 	// we'll put all filesystem access into a separate directory, like chroot.
 	MAHandle Syscall::maFileListStart(const char* path, const char* filter, int sorting) {
 		LOGF("maFileListStart(%s, %s, 0x%x)\n", path, filter, sorting);
-#ifndef _WIN32_WCE
-		sFileListSorting = sorting;
-#endif
-		sFileList.files.clear();
+		FileList& scan(gFileListings->scan);
+		gFileListings->scanSorting = sorting;
+		scan.files.clear();
 		if(path[0] == 0) {	//empty string
 			//list filesystem roots
 #if FILESYSTEM_CHROOT || defined(LINUX) || defined(__IPHONE__) || defined(_WIN32_WCE)
 			FileListItem fli;
 			fli.name = "/";
 #ifdef _WIN32_WCE
-			sFileList.files.push_back(fli);
+			scan.files.push_back(fli);
 #else
 			fli.sorting = MA_FL_SORT_NONE;
-			sFileList.files.insert(fli);
+			scan.files.insert(fli);
 #endif	//_WIN32_WCE
 #else	//FILESYSTEM_CHROOT
 #ifdef WIN32
@@ -1566,7 +1582,7 @@ namespace Base {
 					buf[0] = 'A' + i;
 					fli.name = buf;
 					fli.s.st_ino = i;
-					sFileList.files.insert(fli);
+					scan.files.insert(fli);
 				}
 			}
 #else
@@ -1583,7 +1599,7 @@ namespace Base {
 			scanPath += path;
 			if(scanPath[scanPath.size()-1] != '/')
 				scanPath += "/";
-			sFileListRealDir = scanPath;
+			gFileListings->scanRealDir = scanPath;
 			scanPath += filter;
 			int res = scanDirectory(scanPath.c_str(), fileListCallback);
 			if(res) {
@@ -1591,17 +1607,17 @@ namespace Base {
 				FILE_FAIL(MA_FERR_GENERIC);
 			}
 		}
-		std::pair<FileListItr, bool> ires = sFileListings.insert(
-			std::pair<int, FileList>(sFileListNextHandle, sFileList));
+		std::pair<FileListItr, bool> ires = gFileListings->lists.insert(
+			std::pair<int, FileList>(gFileListings->nextHandle, scan));
 		DEBUG_ASSERT(ires.second);
 		FileList& fl(ires.first->second);
 		fl.itr = fl.files.begin();
-		return sFileListNextHandle++;
+		return gFileListings->nextHandle++;
 	}
 
 	int Syscall::maFileListNext(MAHandle list, char* nameBuf, int bufSize) {
-		FileListItr itr = sFileListings.find(list);
-		MYASSERT(itr != sFileListings.end(), ERR_FILE_HANDLE_INVALID);
+		FileListItr itr = gFileListings->lists.find(list);
+		MYASSERT(itr != gFileListings->lists.end(), ERR_FILE_HANDLE_INVALID);
 		FileList& fl(itr->second);
 		if(fl.itr == fl.files.end())
 			return 0;
@@ -1614,11 +1630,154 @@ namespace Base {
 	}
 
 	int Syscall::maFileListClose(MAHandle list) {
-		FileListItr itr = sFileListings.find(list);
-		MYASSERT(itr != sFileListings.end(), ERR_FILE_HANDLE_INVALID);
-		sFileListings.erase(itr);
+		FileListItr itr = gFileListings->lists.find(list);
+		MYASSERT(itr != gFileListings->lists.end(), ERR_FILE_HANDLE_INVALID);
+		gFileListings->lists.erase(itr);
 		return 0;
 	}
+
+#ifdef VM_SNAPSHOTS
+	//***************************************************************************
+	// Snapshots
+	//***************************************************************************
+
+	class SnapshotSerializer : public ResourceSerializer {
+	public:
+		SnapshotSerializer(Syscall& syscall) : mSyscall(syscall) {}
+
+		bool save(Stream& out, byte type, void* obj) {
+			switch(type) {
+			case RT_BINARY: {
+				Smartie<Stream> copy(((Stream*)obj)->createCopy());
+				TEST(copy());
+				int len;
+				TEST(copy->length(len));
+				TEST(out.writeObject(len));
+				return out.writeStream(*copy, len);
+			}
+			case RT_IMAGE:
+				return mSyscall.saveImageSnapshot(out, (RT_IMAGE_Type*)obj);
+			default:
+				return false;
+			}
+		}
+
+		void* load(Stream& in, byte type) {
+			switch(type) {
+			case RT_BINARY: {
+				int len;
+				TEST(in.readObject(len));
+				Smartie<MemStream> ms(new MemStream(len));
+				TEST(in.read(ms->ptr(), len));
+				return ms.extract();
+			}
+			case RT_IMAGE:
+				return mSyscall.loadImageSnapshot(in);
+			default:
+				return NULL;
+			}
+		}
+	private:
+		Syscall& mSyscall;
+	};
+
+	static bool writeString(Stream& out, const char* s) {
+		int len = strlen(s);
+		TEST(out.writeObject(len));
+		return out.write(s, len);
+	}
+
+	static bool readString(Stream& in, std::string& s) {
+		int len;
+		TEST(in.readObject(len));
+		s.resize(len);
+		return len == 0 || in.read(&s[0], len);
+	}
+
+	bool Syscall::saveSnapshot(Stream& out) {
+		if(!gFileListings->lists.empty()) {
+			LOG("Snapshot: file listings can't be saved.\n");
+			FAIL;
+		}
+
+		SnapshotSerializer serializer(*this);
+		TEST(resources.saveSnapshot(out, serializer));
+
+		TEST(out.writeObject(gFileNextHandle));
+		TEST(out.writeObject(gFileHandles.size()));
+		FileMap::TIteratorC fitr = gFileHandles.begin();
+		while(fitr.hasMore()) {
+			const FileMap::Pair& p(fitr.next());
+			const FileHandle& fh(*p.value);
+			int pos = -1;
+			if(fh.fs) {
+				TEST(fh.fs->tell(pos));
+			}
+			TEST(out.writeObject(p.key));
+			TEST(out.writeObject(fh.mode));
+			TEST(out.writeObject(pos));
+			TEST(writeString(out, fh.name));
+		}
+
+		TEST(out.writeObject(gStoreNextId));
+		uint nStores = 0;
+		for(int id=1; id<gStoreNextId; id++) {
+			if(gStores.find(id))
+				nStores++;
+		}
+		TEST(out.writeObject(nStores));
+		for(int id=1; id<gStoreNextId; id++) {
+			const char* name = gStores.find(id);
+			if(name) {
+				TEST(out.writeObject(id));
+				TEST(writeString(out, name));
+			}
+		}
+		return true;
+	}
+
+	bool Syscall::loadSnapshot(Stream& in) {
+		SnapshotSerializer serializer(*this);
+		TEST(resources.loadSnapshot(in, serializer));
+
+		TEST(in.readObject(gFileNextHandle));
+		uint nFiles;
+		TEST(in.readObject(nFiles));
+		for(uint i=0; i<nFiles; i++) {
+			int handle, pos;
+			std::string name;
+			Smartie<FileHandle> fhs(new FileHandle);
+			FileHandle& fh(*fhs);
+			TEST(in.readObject(handle));
+			TEST(in.readObject(fh.mode));
+			TEST(in.readObject(pos));
+			TEST(readString(in, name));
+			fh.name.resize(name.size() + 1);
+			memcpy(fh.name, name.c_str(), name.size() + 1);
+			fh.fs = NULL;
+			if(pos >= 0) {
+				if(openFile(fh) < 0 || !fh.fs) {
+					LOG("Snapshot: could not reopen %s\n", name.c_str());
+					FAIL;
+				}
+				TEST(fh.fs->seek(Seek::Start, pos));
+			}
+			gFileHandles.insert(handle, fhs.extract());
+		}
+
+		TEST(in.readObject(gStoreNextId));
+		uint nStores;
+		TEST(in.readObject(nStores));
+		for(uint i=0; i<nStores; i++) {
+			int id;
+			std::string name;
+			TEST(in.readObject(id));
+			TEST(readString(in, name));
+			gStores.insert(id, name.c_str(), name.size());
+		}
+		return true;
+	}
+#endif	//VM_SNAPSHOTS
 #endif	// NOT SYMBIAN
 #endif // NOT _android
 
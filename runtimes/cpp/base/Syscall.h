@@ -118,6 +118,12 @@ namespace Base {
 		FileMap gFileHandles;
 		int gFileNextHandle;
 
+#ifndef SYMBIAN
+		//maFileList state. Defined in Syscall.cpp.
+		struct FileListings;
+		FileListings* gFileListings;
+#endif
+
 		FileHandle& getFileHandle(MAHandle file);
 
 		MAHandle maFileOpen(const char* path, int mode);
@@ -146,6 +152,19 @@ namespace Base {
 
 		ResourceArray resources;
 
+#ifdef VM_SNAPSHOTS
+		//Saves the runtime state that can be re-created on restore:
+		//resources, open files and stores.
+		//Fails if there is state that can't be saved.
+		bool saveSnapshot(Stream& out);
+		//Call after loadResources().
+		bool loadSnapshot(Stream& in);
+
+		//platform-specific
+		bool saveImageSnapshot(Stream& out, RT_IMAGE_Type* image);
+		RT_IMAGE_Type* loadImageSnapshot(Stream& in);
+#endif
+
 		void ValidateMemRange(const void* ptr, int size);
 		int ValidatedStrLen(const char* ptr);
 
@@ -172,6 +191,17 @@ namespace Base {
 		int getMemoryProtection();
 #endif
 
+#ifdef VM_STATISTICS
+		//Counters kept by the platform. The core counts basic blocks and syscalls.
+		struct Statistics {
+			u64 yields, waits, waitTime, eventOverflows;	//waitTime is in milliseconds.
+			Statistics() : yields(0), waits(0), waitTime(0), eventOverflows(0) {}
+		} statistics;
+
+		int getVMStatistics(MAVMStatistics* stats);
+		int getSyscallCount(int id);
+#endif
+
 #ifdef EMULATOR
 		bool mAllowDivZero;
 #endif
@@ -217,8 +247,14 @@ namespace Base {
 #endif
 
 #define CALL_SYSCALL(syscall) syscall
+
+//Platforms that can run one VM per thread define this in Platform.h.
+#ifndef VM_THREAD_LOCAL
+#define VM_THREAD_LOCAL
+#endif
+
 namespace Base {
-	extern Syscall* gSyscall;
+	extern VM_THREAD_LOCAL Syscall* gSyscall;
 }
 #define SYSCALL_THIS gSyscall
 #endif	//SYMBIAN
@@ -18,6 +18,7 @@ limitations under the License.
 #include <helpers/helpers.h>
 
 #include "ThreadPool.h"
+#include "TimelineTrace.h"
 
 using namespace MoSyncError;
 
@@ -112,6 +113,9 @@ int WorkerThread::homeRun(void* data) {
 }
 
 void WorkerThread::run() {
+#ifdef TIMELINE_TRACE
+	TimelineTrace::nameThread("ThreadPool worker");
+#endif
 	while(!mQuit) {
 		do {
 			mSem.wait();
@@ -0,0 +1,212 @@
+/* Copyright 2013 David Axmark
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "config_platform.h"
+
+#ifdef TIMELINE_TRACE
+
+#include <stdio.h>
+
+#include <helpers/helpers.h>
+#include <helpers/attribute.h>
+
+#include "TimelineTrace.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+using namespace MoSyncError;
+
+namespace TimelineTrace {
+
+struct Event {
+	u64 start, duration;
+	const char* name;
+	const char* category;
+	const char* argName;
+	int arg;
+};
+
+#define CHUNK_SIZE 4096
+
+//Only the owning thread writes to a chunk.
+//An event is written before count is increased, and a chunk before it is linked.
+struct Chunk {
+	Event events[CHUNK_SIZE];
+	volatile int count;
+	Chunk* volatile next;
+};
+
+//Buffers are never freed; a thread may still be writing when stop() runs.
+struct ThreadBuffer {
+	Chunk* first;
+	Chunk* last;	//only used by the owner.
+	const char* volatile name;
+	int tid;
+	ThreadBuffer* next;
+};
+
+volatile bool gEnabled = false;
+
+static FILE* sFile = NULL;
+static u64 sStartTime;
+static ThreadBuffer* volatile sBuffers = NULL;
+static THREAD_LOCAL ThreadBuffer* sThreadBuffer = NULL;
+
+//Writes before the barrier are seen by other threads before writes after it.
+static void memoryBarrier() {
+#ifdef _MSC_VER
+	MemoryBarrier();
+#else
+	__sync_synchronize();
+#endif
+}
+
+static bool compareAndSwap(ThreadBuffer* volatile* p, ThreadBuffer* oldValue, ThreadBuffer* newValue) {
+#ifdef _MSC_VER
+	return InterlockedCompareExchangePointer((PVOID volatile*)p, newValue, oldValue) == oldValue;
+#else
+	return __sync_bool_compare_and_swap(p, oldValue, newValue);
+#endif
+}
+
+u64 now() {
+#ifdef _WIN32
+	static LARGE_INTEGER frequency = { 0 };
+	if(frequency.QuadPart == 0)
+		GLE(QueryPerformanceFrequency(&frequency));
+	LARGE_INTEGER counter;
+	GLE(QueryPerformanceCounter(&counter));
+	return (u64)(counter.QuadPart / frequency.QuadPart) * 1000000 +
+		(u64)(counter.QuadPart % frequency.QuadPart) * 1000000 / frequency.QuadPart;
+#else
+	struct timespec ts;
+	DEBUG_ASRTZERO(clock_gettime(CLOCK_MONOTONIC, &ts));
+	return (u64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+static Chunk* newChunk() {
+	Chunk* c = new Chunk;
+	c->count = 0;
+	c->next = NULL;
+	return c;
+}
+
+//Creates the buffer of the current thread the first time it is used,
+//and pushes it on the list read by stop().
+static ThreadBuffer* getBuffer() {
+	ThreadBuffer* b = sThreadBuffer;
+	if(b)
+		return b;
+	b = new ThreadBuffer;
+	b->first = b->last = newChunk();
+	b->name = NULL;
+	ThreadBuffer* head;
+	do {
+		head = sBuffers;
+		b->next = head;
+		b->tid = head ? head->tid + 1 : 1;
+	} while(!compareAndSwap(&sBuffers, head, b));
+	sThreadBuffer = b;
+	return b;
+}
+
+void nameThread(const char* name) {
+	if(!gEnabled)
+		return;
+	ThreadBuffer* b = getBuffer();
+	if(!b->name)
+		b->name = name;
+}
+
+void end(u64 start, const char* name, const char* category, const char* argName, int arg) {
+	if(!start || !gEnabled)
+		return;
+	u64 t = now();
+	ThreadBuffer* b = getBuffer();
+	Chunk* c = b->last;
+	if(c->count == CHUNK_SIZE) {
+		Chunk* n = newChunk();
+		memoryBarrier();
+		c->next = n;
+		b->last = c = n;
+	}
+	Event& e(c->events[c->count]);
+	e.start = start;
+	e.duration = t - start;
+	e.name = name;
+	e.category = category;
+	e.argName = argName;
+	e.arg = arg;
+	memoryBarrier();
+	c->count = c->count + 1;
+}
+
+bool start(const char* filename) {
+	DEBUG_ASSERT(!sFile);
+	sFile = fopen(filename, "w");
+	if(!sFile) {
+		LOG("Could not open %s\n", filename);
+		return false;
+	}
+	sStartTime = now();
+	memoryBarrier();
+	gEnabled = true;
+	LOG("Writing a timeline trace to %s\n", filename);
+	return true;
+}
+
+static void writeEvent(int tid, const Event& e) {
+	fprintf(sFile, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%i,"
+		"\"ts\":%.0f,\"dur\":%.0f", e.name, e.category, tid,
+		(double)(e.start - sStartTime), (double)e.duration);
+	if(e.argName)
+		fprintf(sFile, ",\"args\":{\"%s\":%i}", e.argName, e.arg);
+	fputc('}', sFile);
+}
+
+void stop() {
+	if(!sFile)
+		return;
+	gEnabled = false;
+	memoryBarrier();
+
+	fputs("{\"traceEvents\":[\n"
+		"{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"MoRE\"}}", sFile);
+	for(ThreadBuffer* b = sBuffers; b != NULL; b = b->next) {
+		if(b->name) {
+			fprintf(sFile, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%i,"
+				"\"args\":{\"name\":\"%s\"}}", b->tid, b->name);
+		}
+		for(Chunk* c = b->first; c != NULL; c = c->next) {
+			int count = c->count;
+			memoryBarrier();
+			for(int i=0; i<count; i++) {
+				writeEvent(b->tid, c->events[i]);
+			}
+		}
+	}
+	fputs("\n],\"displayTimeUnit\":\"ms\"}\n", sFile);
+	fclose(sFile);
+	sFile = NULL;
+}
+
+}	//namespace TimelineTrace
+
+#endif	//TIMELINE_TRACE
@@ -0,0 +1,83 @@
+/* Copyright 2013 David Axmark
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef TIMELINETRACE_H
+#define TIMELINETRACE_H
+
+#ifdef TIMELINE_TRACE
+
+#include <stddef.h>
+#include <helpers/types.h>
+
+//A timeline of spans on every thread, written as Chrome trace events,
+//for chrome://tracing and ui.perfetto.dev.
+//
+//Each thread appends to its own buffer, without locks.
+//The buffers are only read by stop(), which writes the file.
+namespace TimelineTrace {
+	extern volatile bool gEnabled;
+
+	//Starts recording. Returns false if the file can't be opened.
+	bool start(const char* filename);
+
+	//Stops recording and writes the file. Can be passed to atexit().
+	void stop();
+
+	//Names the current thread in the timeline, unless it already has a name.
+	//name must be a string literal.
+	void nameThread(const char* name);
+
+	//Microseconds, on a monotonic clock.
+	u64 now();
+
+	//Returns the start time of a span, or 0 if not recording.
+	inline u64 begin() {
+		return gEnabled ? now() : 0;
+	}
+
+	//Records a span from start until now on the current thread. Ignored if start is 0.
+	//name, category and argName must be string literals; they are read by stop().
+	void end(u64 start, const char* name, const char* category,
+		const char* argName = NULL, int arg = 0);
+
+	class Span {
+	public:
+		Span(const char* name, const char* category, const char* argName = NULL, int arg = 0)
+			: mStart(begin()), mName(name), mCategory(category), mArgName(argName), mArg(arg) {}
+		~Span() {
+			if(mStart)
+				end(mStart, mName, mCategory, mArgName, mArg);
+		}
+	private:
+		const u64 mStart;
+		const char* const mName;
+		const char* const mCategory;
+		const char* const mArgName;
+		const int mArg;
+	};
+}
+
+#define TRACE_SPAN(name, category) TimelineTrace::Span _traceSpan(name, category)
+#define TRACE_SPAN_ARG(name, category, argName, arg) \
+	TimelineTrace::Span _traceSpan(name, category, argName, arg)
+
+#else
+
+#define TRACE_SPAN(name, category)
+#define TRACE_SPAN_ARG(name, category, argName, arg)
+
+#endif	//TIMELINE_TRACE
+
+#endif	//TIMELINETRACE_H
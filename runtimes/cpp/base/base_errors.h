@@ -99,6 +99,8 @@ limitations under the License.
 	m(40081, ERR_RES_PLACEHOLDER_ALREADY_DESTROYED, "Placeholder is already destroyed")\
 	m(40082, ERR_ORIENTATION_INVALID, "Invalid orientation")\
 	m(40083, ERR_DB_PARAM_TYPE_INVALID, "DB: Invalid parameter type")\
+	m(40084, ERR_SNAPSHOT_BROKEN, "The VM snapshot file is broken")\
+	m(40085, ERR_REPLAY_DIVERGED, "The program diverged from the syscall log being replayed")\
 
 DECLARE_ERROR_ENUM(BASE)
 
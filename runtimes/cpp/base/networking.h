@@ -31,6 +31,7 @@ limitations under the License.
 
 #include "TcpConnection.h"
 #include "ThreadPool.h"
+#include "TimelineTrace.h"
 #include "netImpl.h"
 
 using namespace Base;
@@ -124,11 +125,34 @@ struct MAServerConn : public MAConn {
 
 class ConnOp : public Runnable {
 protected:
-	ConnOp(MAConn& m) : mac(m) {}
+	ConnOp(MAConn& m) : mac(m)
+#ifdef TIMELINE_TRACE
+		, mTraceStart(TimelineTrace::begin())
+#endif
+	{}
 	MAConn& mac;
 
+#ifdef TIMELINE_TRACE
+	//the op's span lasts from the syscall that started it until its result.
+	const u64 mTraceStart;
+
+	static const char* traceName(int opcode) {
+		switch(opcode) {
+		case CONNOP_CONNECT: return "conn connect";
+		case CONNOP_READ: return "conn read";
+		case CONNOP_WRITE: return "conn write";
+		case CONNOP_FINISH: return "conn finish";
+		case CONNOP_ACCEPT: return "conn accept";
+		default: return "conn";
+		}
+	}
+#endif
+
 	void handleResult(int opcode, int result, bool lock = true) {
 		LOGST("ConnOp::handleResult %i %i %i", mac.handle, opcode, result);
+#ifdef TIMELINE_TRACE
+		TimelineTrace::end(mTraceStart, traceName(opcode), "net", "handle", mac.handle);
+#endif
 		if(lock)
 		{
 			gConnMutex.lock();
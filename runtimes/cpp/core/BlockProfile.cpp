@@ -0,0 +1,194 @@
+/* Copyright 2013 David Axmark
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <stdio.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "config_platform.h"
+#include <helpers/helpers.h>
+
+#include "CoreCommon.h"
+#include "BlockProfile.h"
+#include "disassembler.h"
+#include "sld.h"
+
+using std::map;
+using std::pair;
+using std::string;
+using std::vector;
+
+#define BLOCK_PROFILE_VERSION 1
+
+enum {
+	INSN_START = 1,
+	BLOCK_START = 2,
+	//the instruction doesn't continue to the next one; the core counts wherever it goes.
+	INSN_TRANSFER = 4,
+};
+
+struct Block {
+	int start, end, insnCount;
+	u64 count;
+};
+
+struct FunctionCount {
+	u64 calls, instructions;
+	FunctionCount() : calls(0), instructions(0) {}
+};
+
+struct FunctionOrder {
+	const vector<pair<string, FunctionCount> >& f;
+	FunctionOrder(const vector<pair<string, FunctionCount> >& _f) : f(_f) {}
+	bool operator()(int a, int b) const {
+		if(f[a].second.instructions != f[b].second.instructions)
+			return f[a].second.instructions > f[b].second.instructions;
+		return f[a].first < f[b].first;
+	}
+};
+
+static bool isTransfer(int op) {
+	switch(op) {
+	case _CALL: case _CALLI: case _RET: case _JPI: case _JPR: case _CASE:
+	case _JC_EQ: case _JC_NE: case _JC_GE: case _JC_GEU: case _JC_GT:
+	case _JC_GTU: case _JC_LE: case _JC_LEU: case _JC_LT: case _JC_LTU:
+		return true;
+	default:
+		return false;
+	}
+}
+
+//CALLI, JPI and the conditional branches have a fixed target.
+static bool hasTarget(int op) {
+	return isTransfer(op) && op != _CALL && op != _RET && op != _JPR && op != _CASE;
+}
+
+//Marks instructions and the static block boundaries.
+static void scanCode(const byte* code, int codeLen, const int* constants,
+	const uint* entries, vector<byte>& flags)
+{
+	flags.assign(codeLen + 1, 0);
+	flags[0] |= BLOCK_START;
+	int a = 0;
+	while(a < codeLen) {
+		byte op, op2, rd, rs;
+		int imm;
+		int len = disassemble_one(code + a, code, constants, NULL, op, op2, rd, rs, imm);
+		if(len <= 0)
+			break;
+		int realOp = (op == _FAR) ? op2 : op;
+		flags[a] |= INSN_START;
+		if(entries[a] != 0)
+			flags[a] |= BLOCK_START;
+		if(isTransfer(realOp)) {
+			flags[a] |= INSN_TRANSFER;
+			if(a + len <= codeLen)
+				flags[a + len] |= BLOCK_START;
+			if(hasTarget(realOp) && imm >= 0 && imm < codeLen)
+				flags[imm] |= BLOCK_START;
+		}
+		a += len;
+	}
+}
+
+static string functionName(int address) {
+	const FuncMapping* fm = mapFunctionEx(address);
+	if(!fm)
+		return "?";
+	return fm->mangledName.empty() ? fm->name : fm->mangledName;
+}
+
+bool writeBlockProfile(const char* filename, const byte* code, int codeLen,
+	const int* constants, const uint* entries)
+{
+	vector<byte> flags;
+	scanCode(code, codeLen, constants, entries, flags);
+
+	//blocks in address order. a block that doesn't end in a transfer
+	//falls through to the next one, which gets its count.
+	vector<Block> blocks;
+	bool fallsThrough = false;
+	u64 prevCount = 0;
+	for(int a = 0; a < codeLen; a++) {
+		if(!(flags[a] & INSN_START))
+			continue;
+		if((flags[a] & BLOCK_START) || blocks.empty()) {
+			Block b;
+			b.start = b.end = a;
+			b.insnCount = 0;
+			b.count = entries[a] + (fallsThrough ? prevCount : 0);
+			blocks.push_back(b);
+		}
+		Block& b(blocks.back());
+		b.insnCount++;
+		fallsThrough = !(flags[a] & INSN_TRANSFER);
+		prevCount = b.count;
+	}
+	for(size_t i=0; i<blocks.size(); i++) {
+		blocks[i].end = (i + 1 < blocks.size()) ? blocks[i+1].start : codeLen;
+	}
+
+	FILE* file = fopen(filename, "w");
+	if(!file)
+		return false;
+	fprintf(file, "MOSYNC_BLOCK_PROFILE\t%i\n", BLOCK_PROFILE_VERSION);
+
+	map<pair<size_t, int>, u64> lines;	//(file index, line), count
+	map<string, FunctionCount> functions;
+	for(size_t i=0; i<blocks.size(); i++) {
+		const Block& b(blocks[i]);
+		string func = functionName(b.start);
+		fprintf(file, "B\t%x\t%x\t%.0f\t%s\n", b.start, b.end, (double)b.count, func.c_str());
+
+		FunctionCount& fc(functions[func]);
+		fc.instructions += b.count * b.insnCount;
+		const FuncMapping* fm = mapFunctionEx(b.start);
+		if(fm && fm->start == b.start)
+			fc.calls = b.count;
+
+		for(int a = b.start; a < b.end; a++) {
+			LineMapping lm;
+			if(!(flags[a] & INSN_START) || !mapIpEx(a, lm))
+				continue;
+			u64& lc(lines[std::make_pair(lm.file, lm.line)]);
+			lc = MAX(lc, b.count);
+		}
+	}
+
+	const vector<FileMapping>& files(sldFiles());
+	for(map<pair<size_t, int>, u64>::const_iterator itr = lines.begin(); itr != lines.end(); itr++) {
+		size_t f = itr->first.first;
+		fprintf(file, "L\t%s\t%i\t%.0f\n", f < files.size() ? files[f].name.c_str() : "?",
+			itr->first.second, (double)itr->second);
+	}
+
+	vector<pair<string, FunctionCount> > funcs(functions.begin(), functions.end());
+	vector<int> order(funcs.size());
+	for(size_t i=0; i<order.size(); i++) {
+		order[i] = (int)i;
+	}
+	std::sort(order.begin(), order.end(), FunctionOrder(funcs));
+	for(size_t i=0; i<order.size(); i++) {
+		const pair<string, FunctionCount>& p(funcs[order[i]]);
+		fprintf(file, "F\t%s\t%.0f\t%.0f\n", p.first.c_str(),
+			(double)p.second.calls, (double)p.second.instructions);
+	}
+
+	bool ok = !ferror(file);
+	fclose(file);
+	return ok;
+}
@@ -0,0 +1,40 @@
+/* Copyright 2013 David Axmark
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef BLOCKPROFILE_H
+#define BLOCKPROFILE_H
+
+#include <helpers/types.h>
+
+//Basic-block execution counts, for coverage tools and for pipe-tool's code layout.
+//
+//With BLOCK_PROFILING, the core only counts control transfers: entries[a] is
+//incremented when a jump, call, return or case lands on a, and when a conditional
+//branch falls through to a. The program's entry point starts at 1.
+//Code that is entered by falling off the end of the previous block gets the
+//previous block's count as well; that is worked out here, from the code.
+//
+//The output is a tab-separated text file. Addresses are hexadecimal,
+//and functions are SLD mangled names, or "?" without an SLD.
+//	MOSYNC_BLOCK_PROFILE	1
+//	B	<start>	<end>	<count>	<function>	one per basic block; end is exclusive.
+//	L	<file>	<line>	<count>	one per source line with code; the largest count of its blocks.
+//	F	<function>	<calls>	<instructions>	one per function, the most executed instructions first.
+//
+//Returns false if the file couldn't be written.
+bool writeBlockProfile(const char* filename, const byte* code, int codeLen,
+	const int* constants, const uint* entries);
+
+#endif	//BLOCKPROFILE_H
@@ -69,6 +69,42 @@ using namespace MoSyncError;
 #include <config_platform.h>
 #ifdef MOSYNC_NATIVE
 #undef USE_ARM_RECOMPILER
+#undef USE_X64_RECOMPILER
+#undef USE_THREADED_CORE
+#endif
+
+#ifdef INLINE_FLOAT_SYSCALLS
+#include "FloatIntrinsics.h"
+#endif
+
+#if defined(USE_THREADED_CORE) && defined(USE_ARM_RECOMPILER)
+#error USE_THREADED_CORE and USE_ARM_RECOMPILER are mutually exclusive
+#endif
+#if defined(USE_X64_RECOMPILER) && (defined(USE_ARM_RECOMPILER) || defined(USE_THREADED_CORE))
+#error USE_X64_RECOMPILER cannot be combined with USE_ARM_RECOMPILER or USE_THREADED_CORE
+#endif
+
+#ifdef USE_THREADED_CORE
+#ifdef THREADED_SUPERINSTRUCTIONS_FILE
+#include THREADED_SUPERINSTRUCTIONS_FILE
+#else
+#include "core_superinstructions.h"
+#endif
+#ifdef THREADED_NO_FUSION
+#undef SUPERINSTRUCTIONS
+#define SUPERINSTRUCTIONS(m)
+#endif
+#ifndef INLINE_FLOAT_SYSCALLS
+#undef FLOAT_INTRINSICS
+#define FLOAT_INTRINSICS(m)
+#endif
+
+//direct threading needs labels-as-values; other compilers dispatch through a switch.
+#if defined(__GNUC__) && !defined(THREADED_CORE_NO_COMPUTED_GOTO)
+#define THREADED_DISPATCH_GOTO 1
+#else
+#define THREADED_DISPATCH_GOTO 0
+#endif
 #endif
 
 #if defined(USE_ARM_RECOMPILER)
@@ -94,6 +130,16 @@ __inline void chrashTestDummy(const char* fmt, ...) {
 #endif	// 1
 #endif	// USE_ARM_RECOMPILER
 
+#ifdef USE_X64_RECOMPILER
+#include "Recompiler/X64Recompiler.h"
+#endif
+
+#ifdef MAPPED_PROGRAM_LOADING
+#include <fcntl.h>
+#include <unistd.h>
+#include "MappedSegment.h"
+#endif
+
 #include "Core.h"
 
 #if defined (FAKE_CALL_STACK)
@@ -113,6 +159,59 @@ __inline void chrashTestDummy(const char* fmt, ...) {
 #include <vector>
 #endif
 
+#ifdef VM_SNAPSHOTS
+#if !defined(UPDATE_IP) || defined(USE_ARM_RECOMPILER) || defined(USE_X64_RECOMPILER)
+#error VM_SNAPSHOTS requires UPDATE_IP and an interpreting core
+#endif
+#include <string>
+#include <vector>
+#endif
+
+#ifdef MEMORY_PROTECTION
+//protectionPages lets the common case, a page with nothing protected in it,
+//skip the bitmap. A page is 256 bytes, so no aligned access crosses a page.
+#define PROTECTION_PAGE_BITS 8
+#define PROTECTION_PAGE_SIZE (1 << PROTECTION_PAGE_BITS)
+#define PROTECTION_PAGE_COUNT ((DATA_SEGMENT_SIZE + PROTECTION_PAGE_SIZE - 1) >> PROTECTION_PAGE_BITS)
+#define IS_PROTECTED_PAGE(x) (protectionPages[(x) >> PROTECTION_PAGE_BITS] & protectionEnabled)
+#endif
+
+#ifdef SAMPLING_PROFILER
+#if !defined(FAKE_CALL_STACK) || !defined(UPDATE_IP)
+#error SAMPLING_PROFILER requires FAKE_CALL_STACK and UPDATE_IP
+#endif
+#include "SamplingProfiler.h"
+#endif
+
+#ifdef SYSCALL_STATISTICS
+#ifdef MOBILEAUTHOR
+#error SYSCALL_STATISTICS requires the generated syscall table
+#endif
+#include "SyscallStats.h"
+#endif
+
+#ifdef BLOCK_PROFILING
+#if defined(USE_ARM_RECOMPILER) || defined(USE_X64_RECOMPILER)
+#error BLOCK_PROFILING requires an interpreting core
+#endif
+#include "BlockProfile.h"
+#include <string>
+#endif
+
+#ifdef SYSCALL_RECORDING
+#ifdef MOBILEAUTHOR
+#error SYSCALL_RECORDING requires the generated syscall table
+#endif
+#include "SyscallLog.h"
+#endif
+
+#ifdef VM_STATISTICS
+#ifdef MOBILEAUTHOR
+#error VM_STATISTICS requires the generated syscall table
+#endif
+#include "VMStatistics.h"
+#endif
+
 namespace Core {
 
 using namespace Base;
@@ -316,6 +415,15 @@ public:
 
 #define _DBG_OP _ENDOP
 
+#ifdef MAPPED_PROGRAM_LOADING
+	MappedSegment mMappedCode, mMappedData;
+#endif
+
+#ifdef VM_SNAPSHOTS
+	std::string mSnapshotFile;
+	int mSnapshotSyscall;	//< 0 when no snapshot is pending
+#endif
+
 	uint IP;
 	byte* rIP;
 
@@ -323,9 +431,46 @@ public:
 
 	void* customEventPointer;
 
+#ifdef USE_THREADED_CORE
+	//pre-decoded instruction. see core_threaded.h.
+	struct ThreadedInsn {
+		const void* handler;	//label address when THREADED_DISPATCH_GOTO is on
+		ushort op;
+		byte rd, rs;
+		int imm;	//immediate, resolved constant or jump target
+		byte len;	//size of the encoded instruction(s) in mem_cs
+		byte len1;	//size of the first instruction of a fused pair
+		byte rd2, rs2;	//operands of the second instruction of a fused pair
+		int imm2;
+	};
+#define THREADED_FUSED_ENUM_ELEM(a, b) _F_##a##_##b,
+#define THREADED_FLOAT_ENUM_ELEM(name) _FI_##name,
+	enum {
+		_TDECODE = _ENDOP + 1,	//not yet decoded
+		_TILLEGAL,
+		FLOAT_INTRINSICS(THREADED_FLOAT_ENUM_ELEM)	//SYSCALL of a float intrinsic
+		_TFUSED_FIRST,
+		_TFUSED_BEFORE_FIRST = _TFUSED_FIRST - 1,
+		SUPERINSTRUCTIONS(THREADED_FUSED_ENUM_ELEM)
+		_TEND
+	};
+#define THREADED_MAX_INSN_LEN 6	//FAR JC_xx rd rs imm24
+#define THREADED_MAX_FUSED_LEN (2*THREADED_MAX_INSN_LEN)
+#define THREADED_CODE_PAD 8
+
+	ThreadedInsn* mThreadedCode;
+	const void* const* mThreadedHandlers;
+#ifndef THREADED_NO_FUSION
+	ushort mThreadedFuse[_ENDOP][_ENDOP];	//fused op for a pair, or 0
+#endif
+#endif
+
 #ifdef USE_ARM_RECOMPILER
 	MoSync::ArmRecompiler recompiler;
 #endif
+#ifdef USE_X64_RECOMPILER
+	MoSync::X64Recompiler recompiler;
+#endif
 
 #ifdef MEMORY_DEBUG
 	int InstCount;
@@ -335,10 +480,19 @@ public:
 	int* instruction_count;
 #endif
 
+#ifdef BLOCK_PROFILING
+	//per code address, the number of times control got there other than by falling through.
+	uint* blockEntries;
+	std::string mBlockProfileFile;
+#endif
+
 #ifdef FAKE_CALL_STACK
-	int* fakeCallStack;
-	int fakeCallStackDepth;	//measured in ints
-	int fakeCallStackCapacity;	//measured in ints
+	//ring buffer of return addresses. only the innermost FAKE_CALL_STACK_SIZE are kept.
+	int fakeCallStack[FAKE_CALL_STACK_SIZE];
+	int fakeCallStackDepth;	//measured in ints. may be greater than FAKE_CALL_STACK_SIZE.
+	//the number of outermost frames whose slots have been reused by deeper frames.
+	//frames from here up to fakeCallStackDepth are intact.
+	int fakeCallStackLost;
 
 #ifdef FUNCTION_PROFILING
 	class ProfTree {
@@ -553,38 +707,43 @@ public:
 	} profTree;
 #endif	//FUNCTION_PROFILING
 
+#ifdef SAMPLING_PROFILER
+	SamplingProfiler mSampler;
+#endif
+
 	//init functions
-	void allocFakeCallStack() {
-		fakeCallStackCapacity = 16;
-		fakeCallStack = (int*)malloc(fakeCallStackCapacity * sizeof(int));
-		DEBUG_ASSERT(fakeCallStack != NULL);
-		resetFakeCallStack();
-	}
 	void resetFakeCallStack() {
 		fakeCallStackDepth = 0;
+		fakeCallStackLost = 0;
 	}
-	void freeFakeCallStack() {
-		if(fakeCallStack != NULL)
-			free(fakeCallStack);
+
+	//Copies the intact frames, outermost first. Returns the number of frames copied.
+	int copyFakeCallStack(int* frames, int maxFrames) const {
+		int n = MIN(fakeCallStackDepth - fakeCallStackLost, maxFrames);
+		int first = fakeCallStackDepth - n;
+		for(int i=0; i<n; i++) {
+			frames[i] = fakeCallStack[(first + i) & (FAKE_CALL_STACK_SIZE - 1)];
+		}
+		return n;
 	}
 
 	//core functions
 	void fakePush(int returnAddress, int callAddress) {
-		if(fakeCallStackDepth == fakeCallStackCapacity) {
-			fakeCallStackCapacity *= 2;
-			int* temp = (int*)realloc(fakeCallStack, fakeCallStackCapacity * sizeof(int));
-			DEBUG_ASSERT(temp != NULL);	//should cause destructor to be called on failure
-			fakeCallStack = temp;
-		}
-		fakeCallStack[fakeCallStackDepth++] = returnAddress;
+		if(fakeCallStackDepth >= FAKE_CALL_STACK_SIZE)
+			fakeCallStackLost = MAX(fakeCallStackLost, fakeCallStackDepth - FAKE_CALL_STACK_SIZE + 1);
+		fakeCallStack[fakeCallStackDepth & (FAKE_CALL_STACK_SIZE - 1)] = returnAddress;
+		fakeCallStackDepth++;
 #ifdef FUNCTION_PROFILING
 		profTree.call(callAddress);
 #endif
 	}
 	void fakePop() {
-		if(fakeCallStackDepth > 0)
+		if(fakeCallStackDepth > 0) {
 			fakeCallStackDepth--;
-		else {
+			//frames pushed from here on are new.
+			if(fakeCallStackLost > fakeCallStackDepth)
+				fakeCallStackLost = fakeCallStackDepth;
+		} else {
 			LOG("Warning: Call stack broken @ IP 0x%X\n", IP);
 		}
 #ifdef FUNCTION_PROFILING
@@ -604,6 +763,11 @@ public:
 #ifdef USE_ARM_RECOMPILER
 		//aIP = RunArm(aIP);
 		rIP = (byte*)recompiler.run((int)rIP);
+#elif defined(USE_X64_RECOMPILER)
+		rIP = mem_cs + recompiler.run((int)(rIP - mem_cs));
+#elif defined(USE_THREADED_CORE)
+		ThreadedInsn* pc = RunThreaded(mThreadedCode + (rIP - mem_cs));
+		rIP = mem_cs + (pc - mThreadedCode);
 #else
 		rIP = Run(rIP);
 #endif
@@ -658,7 +822,7 @@ public:
 		InitVM();
 
 		FileStream mod(modfile);
-		if(!LoadVM(mod))
+		if(!LoadVM(mod, modfile))
 			return false;
 
 		FileStream res(resfile);
@@ -689,6 +853,9 @@ public:
 		}
 #endif
 
+#ifdef VM_SNAPSHOTS
+		mSyscall.resources.markLoaded();
+#endif
 
 #ifdef FUNCTION_PROFILING
 		profTree.init(Head.EntryPoint);
@@ -717,6 +884,9 @@ public:
 		if(!mSyscall.loadResources(stream, combfile))
 			return false;
 #endif
+#ifdef VM_SNAPSHOTS
+		mSyscall.resources.markLoaded();
+#endif
 
 #ifdef FUNCTION_PROFILING
 		profTree.init(Head.EntryPoint);
@@ -752,7 +922,7 @@ public:
 		LOGC("\n");
 #endif
 
-#ifdef USE_ARM_RECOMPILER
+#if defined(USE_ARM_RECOMPILER) || defined(USE_X64_RECOMPILER)
 		//closeRecompiler();
 		LOG("Close recompiler\n");
 		recompiler.close();
@@ -763,7 +933,26 @@ public:
 	//****************************************
 	//Loader
 	//****************************************
-	int LoadVM(Stream& file) {
+	void freeSegments() {
+#ifdef MAPPED_PROGRAM_LOADING
+		if(mMappedCode.base) {
+			unmapSegment(mMappedCode);
+			mem_cs = NULL;
+		}
+		if(mMappedData.base) {
+			unmapSegment(mMappedData);
+			mem_ds = NULL;
+		}
+#endif
+		SAFE_DELETE(mem_cs);
+		SAFE_DELETE(mem_ds);
+		SAFE_DELETE(mem_cp);
+	}
+
+	//If filename is set, it must be the file that 'file' reads from.
+	//With MAPPED_PROGRAM_LOADING, the code and data segments are then mapped from it
+	//instead of being copied.
+	int LoadVM(Stream& file, const char* filename = NULL) {
 
 		LOG("LoadVM\n");
 
@@ -774,12 +963,13 @@ public:
 			FAIL;
 		}
 
-		SAFE_DELETE(mem_cs);
-		SAFE_DELETE(mem_ds);
-		SAFE_DELETE(mem_cp);
+		freeSegments();
 
 #ifdef MEMORY_PROTECTION
-		SAFE_DELETE(protectionSet);
+		delete[] protectionSet;
+		protectionSet = NULL;
+		delete[] protectionPages;
+		protectionPages = NULL;
 #endif
 
 		// Init regs + IP
@@ -802,9 +992,35 @@ public:
 		currentSyscallId = -1;
 #endif
 
+#ifdef MAPPED_PROGRAM_LOADING
+		int mapFd = -1;
+		if(filename) {
+			mapFd = open(filename, O_RDONLY);
+			if(mapFd < 0) {
+				LOG("open(%s) failed, copying segments instead\n", filename);
+			}
+		}
+#ifdef GDB_DEBUG
+		bool codeWritable = mGdbOn;	//for breakpoints
+#else
+		bool codeWritable = false;
+#endif
+#endif
+
 		DUMPHEX(Head.CodeLen);
 		if(Head.CodeLen > 0) {
 			CODE_SEGMENT_SIZE = nextPowerOf2(2, Head.CodeLen);
+			bool codeMapped = false;
+#ifdef MAPPED_PROGRAM_LOADING
+			if(mapFd >= 0) {
+				int pos;
+				TEST(file.tell(pos));
+				mem_cs = (byte*)mapSegment(mMappedCode, mapFd, pos, Head.CodeLen,
+					CODE_SEGMENT_SIZE, 1, codeWritable);
+				codeMapped = mem_cs != NULL;
+			}
+			if(!codeMapped)
+#endif
 			mem_cs = new byte[CODE_SEGMENT_SIZE];
 			if(!mem_cs) BIG_PHAT_ERROR(ERR_OOM);
 #ifdef INSTRUCTION_PROFILING
@@ -813,8 +1029,19 @@ public:
 			if(!instruction_count) BIG_PHAT_ERROR(ERR_OOM);
 			ZEROMEM(instruction_count, sizeof(int)*CODE_SEGMENT_SIZE);
 #endif
-			TEST(file.read(mem_cs, Head.CodeLen));
-			ZEROMEM(mem_cs + Head.CodeLen, CODE_SEGMENT_SIZE - Head.CodeLen);
+#ifdef BLOCK_PROFILING
+			delete[] blockEntries;
+			blockEntries = new uint[CODE_SEGMENT_SIZE];
+			if(!blockEntries) BIG_PHAT_ERROR(ERR_OOM);
+			ZEROMEM(blockEntries, sizeof(uint)*CODE_SEGMENT_SIZE);
+			blockEntries[Head.EntryPoint & CODE_SEGMENT_MASK]++;
+#endif
+			if(codeMapped) {
+				TEST(file.seek(Seek::Current, Head.CodeLen));
+			} else {
+				TEST(file.read(mem_cs, Head.CodeLen));
+				ZEROMEM(mem_cs + Head.CodeLen, CODE_SEGMENT_SIZE - Head.CodeLen);
+			}
 		} else {
 			BIG_PHAT_ERROR(ERR_PROGRAM_FILE_BROKEN);
 		}
@@ -825,6 +1052,7 @@ public:
 		DUMPHEX(Head.DataSize);
 		if(Head.DataLen > 0) {
 			DATA_SEGMENT_SIZE = nextPowerOf2(16, Head.DataSize);
+			bool dataMapped = false;
 
 #ifdef _android
 			/*
@@ -866,15 +1094,32 @@ public:
 			mJniEnv->DeleteLocalRef(byteBuffer);
 
 #else
+#ifdef MAPPED_PROGRAM_LOADING
+			//heap, stack and BSS stay untouched anonymous pages until the program uses them.
+			if(mapFd >= 0) {
+				int pos;
+				TEST(file.tell(pos));
+				mem_ds = (int*)mapSegment(mMappedData, mapFd, pos, Head.DataLen,
+					DATA_SEGMENT_SIZE, sizeof(int), true);
+				dataMapped = mem_ds != NULL;
+			}
+			if(!dataMapped)
+#endif
 			mem_ds = new int[DATA_SEGMENT_SIZE / sizeof(int)];
 #endif
 
 			if(!mem_ds) BIG_PHAT_ERROR(ERR_OOM);
-			TEST(file.read(mem_ds, Head.DataLen));
-			ZEROMEM((byte*)mem_ds + Head.DataLen, DATA_SEGMENT_SIZE - Head.DataLen);
+			if(dataMapped) {
+				TEST(file.seek(Seek::Current, Head.DataLen));
+			} else {
+				TEST(file.read(mem_ds, Head.DataLen));
+				ZEROMEM((byte*)mem_ds + Head.DataLen, DATA_SEGMENT_SIZE - Head.DataLen);
+			}
 #ifdef MEMORY_PROTECTION
 			protectionSet = new byte[(DATA_SEGMENT_SIZE+7)>>3];
 			ZEROMEM(protectionSet, (DATA_SEGMENT_SIZE+7)>>3);
+			protectionPages = new byte[PROTECTION_PAGE_COUNT];
+			ZEROMEM(protectionPages, PROTECTION_PAGE_COUNT);
 			//unprotectMemory(0, DATA_SEGMENT_SIZE);
 			//protectMemory(Head.DataSize-Head.StackSize-Head.HeapSize-16, Head.HeapSize);
 #endif
@@ -882,6 +1127,10 @@ public:
 			BIG_PHAT_ERROR(ERR_PROGRAM_FILE_BROKEN);
 		}
 		DUMPHEX(DATA_SEGMENT_SIZE);
+#ifdef MAPPED_PROGRAM_LOADING
+		if(mapFd >= 0)
+			close(mapFd);
+#endif
 
 		DUMPHEX(Head.IntLen);
 		if(Head.IntLen > 0) {
@@ -901,6 +1150,10 @@ public:
 
 		customEventPointer = ((char*)mem_ds) + (Head.DataSize - maxCustomEventSize);
 
+#ifdef USE_THREADED_CORE
+		predecodeThreaded();
+#endif
+
 #ifdef USE_ARM_RECOMPILER
 		//initRecompilerVariables();
 #ifndef _android
@@ -908,11 +1161,162 @@ public:
 #else
 		recompiler.init(this, &VM_Yield, mJniEnv, mJThis);
 #endif
+#endif
+#ifdef USE_X64_RECOMPILER
+		recompiler.init(this, &VM_Yield);
 #endif
 
 		return 1; //good load
 	}
 
+#if defined(VM_SNAPSHOTS) || defined(SYSCALL_RECORDING)
+	//FNV-1a
+	static uint hashBytes(const byte* p, int len) {
+		uint h = 2166136261u;
+		for(int i=0; i<len; i++) {
+			h = (h ^ p[i]) * 16777619u;
+		}
+		return h;
+	}
+#endif
+
+#ifdef VM_SNAPSHOTS
+	//****************************************
+	//Snapshots
+	//****************************************
+#define SNAPSHOT_MAGIC 0x504E534D	//MSNP
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_PAGE_SIZE 4096
+
+	//writes the pages that aren't all zero, each prefixed by its offset.
+	//the list ends with 'size'.
+	static bool writePages(Stream& out, const byte* mem, uint size) {
+		for(uint offset=0; offset<size; offset+=SNAPSHOT_PAGE_SIZE) {
+			uint len = MIN(SNAPSHOT_PAGE_SIZE, size - offset);
+			bool zero = true;
+			for(uint i=0; i<len && zero; i++) {
+				zero = mem[offset + i] == 0;
+			}
+			if(!zero) {
+				TEST(out.writeObject(offset));
+				TEST(out.write(mem + offset, len));
+			}
+		}
+		return out.writeObject(size);
+	}
+
+	//pages missing from the snapshot are zeroed, but only within the first dirtyLen bytes;
+	//the rest of mem must already be zero.
+	static bool readPages(Stream& in, byte* mem, uint size, uint dirtyLen) {
+		uint next = 0;
+		while(true) {
+			uint offset;
+			TEST(in.readObject(offset));
+			TEST(offset >= next && offset <= size && (offset % SNAPSHOT_PAGE_SIZE) == 0);
+			uint zeroEnd = MIN(offset, dirtyLen);
+			if(next < zeroEnd)
+				memset(mem + next, 0, zeroEnd - next);
+			if(offset == size)
+				return true;
+			uint len = MIN(SNAPSHOT_PAGE_SIZE, size - offset);
+			TEST(in.read(mem + offset, len));
+			next = offset + len;
+		}
+	}
+
+	//Called at the start of the marker syscall. On restore, execution resumes
+	//at the syscall instruction, so the syscall runs as if nothing happened.
+	bool saveSnapshot(const char* filename) {
+		WriteFileStream out(filename);
+		TEST(out.isOpen());
+		TEST(out.writeObject((int)SNAPSHOT_MAGIC));
+		TEST(out.writeObject((int)SNAPSHOT_VERSION));
+		TEST(out.writeObject(Head));
+		TEST(out.writeObject(hashBytes(mem_cs, Head.CodeLen)));
+		TEST(out.write(regs, sizeof(regs)));
+		TEST(out.writeObject(IP));
+#ifdef FAKE_CALL_STACK
+		//leave out the syscall's own frame. it is pushed again when the syscall is re-executed.
+		int frames[FAKE_CALL_STACK_SIZE];
+		int depth = MAX(copyFakeCallStack(frames, FAKE_CALL_STACK_SIZE) - 1, 0);
+		TEST(out.writeObject(depth));
+		TEST(out.write(frames, depth * sizeof(int)));
+#else
+		TEST(out.writeObject(0));
+#endif
+		TEST(writePages(out, (byte*)mem_ds, DATA_SEGMENT_SIZE));
+#ifdef MEMORY_PROTECTION
+		TEST(writePages(out, protectionSet, (DATA_SEGMENT_SIZE+7)>>3));
+#endif
+		TEST(mSyscall.saveSnapshot(out));
+		return true;
+	}
+
+	//Call right after LoadVMApp().
+	//Returns false, with nothing changed, if the snapshot is missing or doesn't match the program.
+	bool loadSnapshot(const char* filename) {
+		FileStream in(filename);
+		TEST(in.isOpen());
+		int magic, version;
+		TEST(in.readObject(magic));
+		TEST(in.readObject(version));
+		if(magic != SNAPSHOT_MAGIC || version != SNAPSHOT_VERSION) {
+			LOG("%s is not a version %i snapshot.\n", filename, SNAPSHOT_VERSION);
+			FAIL;
+		}
+		MA_HEAD head;
+		uint hash;
+		TEST(in.readObject(head));
+		TEST(in.readObject(hash));
+		if(memcmp(&head, &Head, sizeof(Head)) != 0 || hash != hashBytes(mem_cs, Head.CodeLen)) {
+			LOG("Snapshot %s was made from another program.\n", filename);
+			FAIL;
+		}
+
+		//from here on, a failure leaves the VM in an unusable state.
+		MYASSERT(in.read(regs, sizeof(regs)), ERR_SNAPSHOT_BROKEN);
+		MYASSERT(in.readObject(IP), ERR_SNAPSHOT_BROKEN);
+		int depth;
+		MYASSERT(in.readObject(depth) && depth >= 0, ERR_SNAPSHOT_BROKEN);
+		std::vector<int> frames(depth);
+		if(depth > 0) {
+			MYASSERT(in.read(&frames[0], depth * sizeof(int)), ERR_SNAPSHOT_BROKEN);
+		}
+#ifdef FAKE_CALL_STACK
+		resetFakeCallStack();
+		for(int i=0; i<depth; i++) {
+			//the callee is the function that contains the next return address, or IP.
+			int calleeIp = (i + 1 < depth) ? frames[i + 1] - 1 : (int)IP;
+			int callee = mapFunctionStart(calleeIp);
+			fakePush(frames[i], callee >= 0 ? callee : calleeIp);
+		}
+#endif
+		MYASSERT(readPages(in, (byte*)mem_ds, DATA_SEGMENT_SIZE, Head.DataLen), ERR_SNAPSHOT_BROKEN);
+#ifdef MEMORY_PROTECTION
+		MYASSERT(readPages(in, protectionSet, (DATA_SEGMENT_SIZE+7)>>3, 0), ERR_SNAPSHOT_BROKEN);
+		updateProtectionPages(0, DATA_SEGMENT_SIZE);
+#endif
+		MYASSERT(mSyscall.loadSnapshot(in), ERR_SNAPSHOT_BROKEN);
+		rIP = mem_cs + IP;
+		LOG("Restored snapshot %s at IP 0x%x\n", filename, IP);
+		return true;
+	}
+
+	void setSnapshotTrigger(const char* filename, int syscallId) {
+		mSnapshotFile = filename;
+		mSnapshotSyscall = syscallId;
+	}
+#endif	//VM_SNAPSHOTS
+
+#ifdef SYSCALL_RECORDING
+	SyscallLog mSyscallLog;
+
+	//identifies the program and its initial data.
+	uint programHash() const {
+		return hashBytes(mem_cs, Head.CodeLen) ^ hashBytes((const byte*)&Head, sizeof(Head));
+	}
+#endif
+
 	//****************************************
 	//Definitions
 	//****************************************
@@ -950,6 +1354,24 @@ void WRITE_REG(int reg, int value) {
 #define IMMU	((uint32_t) imm32)
 #define IMM	((int32_t) imm32)
 
+#ifdef BLOCK_PROFILING
+#define BLOCK_PROFILE(address) blockEntries[address]++;
+#else
+#define BLOCK_PROFILE(address)
+#endif
+#ifdef VM_STATISTICS
+#define BLOCK_COUNT mStatistics.blocks++;
+#else
+#define BLOCK_COUNT
+#endif
+#define BLOCK_ENTER(address) BLOCK_PROFILE(address) BLOCK_COUNT
+#if defined(BLOCK_PROFILING) || defined(VM_STATISTICS)
+//for conditional branches; counts the instruction after an untaken branch.
+#define JC_NOT_TAKEN else { BLOCK_ENTER(uint(ip - mem_cs)) }
+#else
+#define JC_NOT_TAKEN
+#endif
+
 #ifdef MEMORY_DEBUG
 #ifdef CORE_DEBUGGING_MODE
 	void dumpJump(uint address) {
@@ -967,10 +1389,10 @@ void WRITE_REG(int reg, int value) {
 #endif
 #define JMP_GENERIC(address) dumpJump(address); if(uint(address) >= CODE_SEGMENT_SIZE) {\
 	LOG("\nIllegal jump to 0x%04X\n", (uint)address); BIG_PHAT_ERROR(ERR_IMEM_OOB); }\
-		ip = (byte*)(mem_cs + (address));
+		ip = (byte*)(mem_cs + (address)); BLOCK_ENTER(uint(ip - mem_cs))
 #else
 #define JMP_GENERIC(address) \
-	ip = (byte*)(mem_cs + ((address) & CODE_SEGMENT_MASK));
+	ip = (byte*)(mem_cs + ((address) & CODE_SEGMENT_MASK)); BLOCK_ENTER(uint(ip - mem_cs))
 #endif  //MEMORY_DEBUG
 
 #define	JMP_IMM	JMP_GENERIC(IMM)
@@ -1022,12 +1444,52 @@ void WRITE_REG(int reg, int value) {
 #define RESET_PROTECTION(x) (protectionSet[(x)>>3]&=~(1<<((x)&0x7)))
 #define GET_PROTECTION(x) (protectionSet[(x)>>3]&(1<<((x)&0x7)))
 
+	void protectionViolation(uint address) const {
+		LOG("Access to protected memory at 0x%x, IP 0x%x\n", address, GetIp());
+		BIG_PHAT_ERROR(ERR_MEMORY_PROTECTED);
+	}
+
+	//Checks one access that doesn't cross a page.
+	void checkProtectionFast(uint address, uint size) const {
+		if(IS_PROTECTED_PAGE(address)) {
+			for(uint i = address; i < address+size; i++)
+				if(GET_PROTECTION(i))
+					protectionViolation(i);
+		}
+	}
+
 	void checkProtection(uint address, uint size) const {
-		if(protectionEnabled) {
-		for(uint i = address; i < address+size; i++)
-			if(GET_PROTECTION(i)) {
-				BIG_PHAT_ERROR(ERR_MEMORY_PROTECTED);
-			}
+		if(!protectionEnabled || size == 0)
+			return;
+		uint end = address + size;
+		uint page = address >> PROTECTION_PAGE_BITS;
+		uint lastPage = (end - 1) >> PROTECTION_PAGE_BITS;
+		for(; page <= lastPage; page++) {
+			if(!protectionPages[page])
+				continue;
+			uint start = MAX(address, page << PROTECTION_PAGE_BITS);
+			uint stop = MIN(end, (page + 1) << PROTECTION_PAGE_BITS);
+			for(uint i = start; i < stop; i++)
+				if(GET_PROTECTION(i))
+					protectionViolation(i);
+		}
+	}
+
+	//Recomputes the page flags for the pages that overlap [start, start+length).
+	void updateProtectionPages(uint start, uint length) {
+		if(length == 0)
+			return;
+		uint firstPage = start >> PROTECTION_PAGE_BITS;
+		uint lastPage = (start + length - 1) >> PROTECTION_PAGE_BITS;
+		for(uint page = firstPage; page <= lastPage; page++) {
+			//a page is PROTECTION_PAGE_SIZE / 8 bytes of bitmap.
+			const byte* bits = protectionSet + (page << (PROTECTION_PAGE_BITS - 3));
+			const byte* bitsEnd = MIN(bits + (PROTECTION_PAGE_SIZE >> 3),
+				protectionSet + ((DATA_SEGMENT_SIZE + 7) >> 3));
+			byte any = 0;
+			for(; bits < bitsEnd; bits++)
+				any |= *bits;
+			protectionPages[page] = any != 0;
 		}
 	}
 #endif	//MEMORY_PROTECTION
@@ -1043,8 +1505,9 @@ void WRITE_REG(int reg, int value) {
 
 	template<class T, bool write> T& getValidatedMemRefBase(uint address) {
 		DEBUG_ASSERT(isPowerOf2(sizeof(T)));
-		if(address >= DATA_SEGMENT_SIZE || (address+sizeof(T)) > DATA_SEGMENT_SIZE ||
-			((address & (sizeof(T) - 1)) != 0) || //alignment check
+		//DATA_SEGMENT_SIZE is a power of 2, so one mask covers both the bounds
+		//and the alignment check.
+		if((address & ~(DATA_SEGMENT_MASK & ~(sizeof(T) - 1))) != 0 ||
 			(address < 4))	//NULL pointer check
 		{
 			LOG("Memory reference validation failed. Size %" PFZT ", address 0x%x\n",
@@ -1061,7 +1524,9 @@ void WRITE_REG(int reg, int value) {
 		}
 
 #ifdef MEMORY_PROTECTION
-		checkProtection(address, sizeof(T));
+		//maProtectMemory only guards against writes.
+		if(write)
+			checkProtectionFast(address, sizeof(T));
 #endif
 
 		return MEMREF(T, address);
@@ -1198,6 +1663,7 @@ void WRITE_REG(int reg, int value) {
 		//memset(&protectionSet[start], 1, length);
 		for(uint i = start; i < start+length; i++)
 			SET_PROTECTION(i);
+		updateProtectionPages(start, length);
 	}
 
 	void unprotectMemory(uint start, uint length) {
@@ -1206,10 +1672,11 @@ void WRITE_REG(int reg, int value) {
 		//memset(&protectionSet[start], 0, length);
 		for(uint i = start; i < start+length; i++)
 			RESET_PROTECTION(i);
+		updateProtectionPages(start, length);
 	}
 
 	void setMemoryProtection(int enable) {
-		this->protectionEnabled = enable;
+		this->protectionEnabled = enable ? 1 : 0;
 	}
 
 	int getMemoryProtection() {
@@ -1224,30 +1691,68 @@ void WRITE_REG(int reg, int value) {
 #define _MOSYNC_SYSCALL_ARGUMENTS_H_
 #include "syscall_arguments.h"
 
-	void ISC2(int syscall_id) {
-
-		switch(syscall_id) {
-#ifdef MOBILEAUTHOR
-#include <Deimos/DeimosInvokeSyscall.h>
-#else
-
+#ifndef MOBILEAUTHOR
+	//one member function per syscall, ISC_<name>, and the SYSCALL_TABLE macro.
 #define memset __memset
 #define memcpy __memcpy
 #define strcpy __strcpy
 #define strcmp __strcmp
-#include "invoke_syscall_cpp.h"
+#include "invoke_syscall_table_cpp.h"
 #undef memset
 #undef memcpy
 #undef strcpy
 #undef strcmp
 
+	void ISC_bad() {
+		BIG_PHAT_ERROR(ERR_BAD_SYSCALL);
+	}
+
+	typedef void (VMCoreInt::*SyscallFunc)();
 #endif
+
+	void ISC2(int syscall_id) {
+#ifdef MOBILEAUTHOR
+		switch(syscall_id) {
+#include <Deimos/DeimosInvokeSyscall.h>
 		default:  //bad syscall
 			BIG_PHAT_ERROR(ERR_BAD_SYSCALL);
 		}
+#else
+#define SYSCALL_TABLE_ELEM(name) &VMCoreInt::ISC_##name,
+#define SYSCALL_TABLE_BAD &VMCoreInt::ISC_bad,
+		static const SyscallFunc sSyscallTable[SYSCALL_TABLE_SIZE] = {
+			SYSCALL_TABLE(SYSCALL_TABLE_ELEM, SYSCALL_TABLE_BAD)
+		};
+		if((uint)syscall_id >= SYSCALL_TABLE_SIZE)
+			BIG_PHAT_ERROR(ERR_BAD_SYSCALL);
+		(this->*sSyscallTable[syscall_id])();
+#endif
 	}
 
+#ifdef SYSCALL_STATISTICS
+	SyscallStats mSyscallStats;
+#endif
+
+#ifdef VM_STATISTICS
+	VMStatistics mStatistics;
+#endif
+
 	void InvokeSysCall(int syscall_id) {
+#ifdef VM_SNAPSHOTS
+		if(syscall_id == mSnapshotSyscall) {
+			mSnapshotSyscall = -1;
+			if(saveSnapshot(mSnapshotFile.c_str())) {
+				LOG("Wrote snapshot %s\n", mSnapshotFile.c_str());
+			} else {
+				LOG("Could not write snapshot %s\n", mSnapshotFile.c_str());
+				remove(mSnapshotFile.c_str());
+			}
+		}
+#endif
+#ifdef SYSCALL_RECORDING
+		if(mSyscallLog.replay(syscall_id, regs))
+			return;
+#endif
 #ifdef TRACK_SYSCALL_ID
 		currentSyscallId = syscall_id;
 #endif
@@ -1257,9 +1762,19 @@ void WRITE_REG(int reg, int value) {
 			LOG("Trapped core leave, code %i\n", symbianError);
 			VM_Yield = 1;
 		}
+#elif defined(SYSCALL_STATISTICS)
+		u64 startTime = mSyscallStats.begin(syscall_id);
+#ifdef VM_STATISTICS
+		mStatistics.beforeSyscall(syscall_id, mSyscall);
+#endif
+		ISC2(syscall_id);
+		mSyscallStats.end(syscall_id, startTime);
 #else
 		ISC2(syscall_id);
 #endif
+#ifdef SYSCALL_RECORDING
+		mSyscallLog.record(syscall_id, regs);
+#endif
 #ifdef TRACK_SYSCALL_ID
 		currentSyscallId = -1;
 #endif
@@ -1292,6 +1807,12 @@ void WRITE_REG(int reg, int value) {
 #undef RUN_NAME
 #undef RUN_LOOP
 
+#ifdef USE_THREADED_CORE
+#define THREADED_RUN_NAME RunThreaded
+#include "core_threaded.h"
+#undef THREADED_RUN_NAME
+#endif	//USE_THREADED_CORE
+
 #if 0//def GDB_DEBUG
 #define RUN_NAME Step
 #define RUN_LOOP return ip
@@ -1319,6 +1840,9 @@ void WRITE_REG(int reg, int value) {
 
 	void SetIp(int ip) {
 		IP = ip;
+#ifdef USE_THREADED_CORE
+		rIP = mem_cs + (IP & CODE_SEGMENT_MASK);
+#endif
 	}
 
 #ifdef _MSC_VER
@@ -1327,16 +1851,30 @@ void WRITE_REG(int reg, int value) {
 
 	VMCoreInt(Syscall& aSyscall)
 	: rIP(NULL)
+#ifdef USE_THREADED_CORE
+	, mThreadedCode(NULL), mThreadedHandlers(NULL)
+#endif
 #ifdef MEMORY_DEBUG
 	, InstCount(0)
 #endif
 #ifdef INSTRUCTION_PROFILING
 	,instruction_count(NULL)
+#endif
+#ifdef BLOCK_PROFILING
+	,blockEntries(NULL)
 #endif
 	, mSyscall(aSyscall) {
 
+#ifdef VM_SNAPSHOTS
+		mSnapshotSyscall = -1;
+#endif
+#ifdef VM_STATISTICS
+		mSyscallStats.init(SYSCALL_TABLE_SIZE);
+		mStatistics.init(&mSyscallStats);
+#endif
+
 #ifdef FAKE_CALL_STACK
-		allocFakeCallStack();
+		resetFakeCallStack();
 #endif
 #ifdef LOG_STATE_CHANGE
 		initStateChange();
@@ -1344,6 +1882,17 @@ void WRITE_REG(int reg, int value) {
 	}
 
 	virtual ~VMCoreInt() {
+#ifdef VM_STATISTICS
+		mStatistics.close(mSyscall);
+#endif
+#ifdef SYSCALL_STATISTICS
+		if(mSyscallStats.isWriting())
+			mSyscallStats.write();
+#endif
+#ifdef SAMPLING_PROFILER
+		//the sampler thread reads IP; stop it before anything is torn down.
+		mSampler.stop();
+#endif
 #ifdef GDB_DEBUG
 		if(mGdbOn)
 			mGdbStub->closeDebugConnection();
@@ -1363,26 +1912,25 @@ void WRITE_REG(int reg, int value) {
 #ifdef COUNT_INSTRUCTION_USE
 	logInstructionUse();
 #endif
-		delete mem_cs;
-		delete mem_ds;
-		delete mem_cp;
+		freeSegments();
+#ifdef USE_THREADED_CORE
+		delete[] mThreadedCode;
+#endif
 
 #ifdef MEMORY_PROTECTION
-		delete protectionSet;
+		delete[] protectionSet;
+		delete[] protectionPages;
 #endif
 
 #ifdef LOG_STATE_CHANGE
 		freeStateChange();
 #endif
 
-#ifdef USE_ARM_RECOMPILER
+#if defined(USE_ARM_RECOMPILER) || defined(USE_X64_RECOMPILER)
 		//closeRecompiler();
 		recompiler.close();
 #endif
 
-#ifdef FAKE_CALL_STACK
-		freeFakeCallStack();
-#endif
 #ifdef INSTRUCTION_PROFILING
 		if(instruction_count != NULL) {
 			FILE* file = fopen("profile.txt", "w");
@@ -1400,6 +1948,15 @@ void WRITE_REG(int reg, int value) {
 		}
 		delete instruction_count;
 #endif
+#ifdef BLOCK_PROFILING
+		if(blockEntries != NULL && !mBlockProfileFile.empty()) {
+			if(writeBlockProfile(mBlockProfileFile.c_str(), mem_cs, Head.CodeLen, mem_cp, blockEntries))
+				LOG("Wrote block profile %s\n", mBlockProfileFile.c_str());
+			else
+				LOG("Could not write block profile %s\n", mBlockProfileFile.c_str());
+		}
+		delete[] blockEntries;
+#endif
 
 	}
 
@@ -1410,6 +1967,7 @@ private:
 VMCore::VMCore() : mem_cs(NULL), mem_ds(NULL), mem_cp(NULL)
 #ifdef MEMORY_PROTECTION
 	,protectionSet(NULL)
+	,protectionPages(NULL)
 	,protectionEnabled(1)
 #endif
 #ifdef TRACK_SYSCALL_ID
@@ -1474,8 +2032,58 @@ void SetIp(VMCore* core, int ip) {
 int GetFakeCallStackDepth(const VMCore* core) {
 	return CORE->fakeCallStackDepth;
 }
-const int* GetFakeCallStack(const VMCore* core) {
-	return CORE->fakeCallStack;
+int GetFakeCallStack(const VMCore* core, int* frames, int maxFrames) {
+	return CORE->copyFakeCallStack(frames, maxFrames);
+}
+#endif
+
+#ifdef VM_SNAPSHOTS
+void SetSnapshotTrigger(VMCore* core, const char* filename, int syscallId) {
+	CORE->setSnapshotTrigger(filename, syscallId);
+}
+bool LoadSnapshot(VMCore* core, const char* filename) {
+	return CORE->loadSnapshot(filename);
+}
+#endif
+
+#ifdef SAMPLING_PROFILER
+void StartSampling(VMCore* core, const char* baseName, int intervalMs) {
+#if defined(USE_ARM_RECOMPILER) || defined(USE_X64_RECOMPILER)
+	LOG("Warning: recompiled code doesn't update IP or the call stack; samples will be meaningless.\n");
+#endif
+	CORE->mSampler.start(core, baseName, intervalMs);
+}
+#endif
+
+#ifdef SYSCALL_STATISTICS
+void StartSyscallStats(VMCore* core, bool timed, const char* filename) {
+	CORE->mSyscallStats.start(SYSCALL_TABLE_SIZE, timed, filename);
+}
+void RequestSyscallStatsDump() {
+	SyscallStats::requestDump();
+}
+#endif
+
+#ifdef VM_STATISTICS
+bool StartStatisticsDump(VMCore* core, const char* filename, int intervalMs) {
+	return CORE->mStatistics.startDump(filename, intervalMs);
+}
+#endif
+
+#ifdef BLOCK_PROFILING
+void SetBlockProfileFile(VMCore* core, const char* filename) {
+	CORE->mBlockProfileFile = filename;
+}
+#endif
+
+#ifdef SYSCALL_RECORDING
+bool StartSyscallRecording(VMCore* core, const char* filename) {
+	return CORE->mSyscallLog.startRecording(filename, CORE->programHash(),
+		(byte*)CORE->mem_ds, CORE->DATA_SEGMENT_SIZE);
+}
+bool StartSyscallReplay(VMCore* core, const char* filename) {
+	return CORE->mSyscallLog.startReplay(filename, CORE->programHash(),
+		(byte*)CORE->mem_ds, CORE->DATA_SEGMENT_SIZE);
 }
 #endif
 
@@ -1510,6 +2118,11 @@ void Step(VMCore* core) {
 	CORE->rIP = CORE->Step(CORE->rIP);
 }
 #endif
+void InvalidateCode(VMCore* core, int address, int length) {
+#ifdef USE_THREADED_CORE
+	CORE->InvalidateCode(address, length);
+#endif
+}
 int& GetVMYield(VMCore* core) {
 	return CORE->VM_Yield;
 }
@@ -1539,7 +2152,7 @@ const wchar* GetValidatedWStr(const VMCore* core, int address) {
 }
 
 #ifdef MOSYNC_NATIVE
-static char* gCustomEventPointer[512];
+static VM_THREAD_LOCAL char* gCustomEventPointer[512];
 #endif
 
 void* GetCustomEventPointer(VMCore* core) {
@@ -1565,6 +2178,15 @@ static int getMemoryProtection(VMCore* core) {
 }
 #endif
 
+#ifdef VM_STATISTICS
+static VMStatistics& getStatistics(VMCore* core) {
+	return CORE->mStatistics;
+}
+static SyscallStats& getSyscallStats(VMCore* core) {
+	return CORE->mSyscallStats;
+}
+#endif
+
 #if 0//ndef SYMBIAN
 int getRuntimeIp() {
 	if(gCore) {
@@ -1602,7 +2224,7 @@ const char* CurrentSyscallString(VMCore* core, char* buffer, int bufSize) {
 #endif
 
 #ifndef SYMBIAN
-Core::VMCore* gCore = NULL;
+VM_THREAD_LOCAL Core::VMCore* gCore = NULL;
 #endif
 
 void* Base::Syscall::GetValidatedMemRange(int address, int size) {
@@ -1648,5 +2270,20 @@ int Base::Syscall::getMemoryProtection() {
 #endif
 
 void Base::Syscall::VM_Yield() {
+#ifdef VM_STATISTICS
+	statistics.yields++;
+#endif
 	Core::GetVMYield(gCore) = 1;
 }
+
+#ifdef VM_STATISTICS
+int Base::Syscall::getVMStatistics(MAVMStatistics* stats) {
+	Core::getStatistics(gCore).fill(stats, *this);
+	return 0;
+}
+
+int Base::Syscall::getSyscallCount(int id) {
+	s64 count = Core::getSyscallStats(gCore).getCount(id);
+	return count < 0 ? IOCTL_UNAVAILABLE : (int)count;
+}
+#endif
@@ -53,6 +53,26 @@ class GdbStub;
 #include "GdbCommon.h"
 #endif
 
+#ifdef FAKE_CALL_STACK
+//The number of frames kept by the call stack ring buffer. Must be a power of 2.
+#ifndef FAKE_CALL_STACK_SIZE
+#define FAKE_CALL_STACK_SIZE 1024
+#endif
+#if (FAKE_CALL_STACK_SIZE & (FAKE_CALL_STACK_SIZE - 1)) != 0
+#error FAKE_CALL_STACK_SIZE must be a power of 2
+#endif
+#endif
+
+//The sampling profiler reads the current syscall from the core.
+#if defined(SAMPLING_PROFILER) && !defined(TRACK_SYSCALL_ID)
+#define TRACK_SYSCALL_ID
+#endif
+
+//The VM statistics read the per-syscall counters kept for SYSCALL_STATISTICS.
+#if defined(VM_STATISTICS) && !defined(SYSCALL_STATISTICS)
+#define SYSCALL_STATISTICS
+#endif
+
 namespace Base {
 #ifdef MOBILEAUTHOR
 #define Syscall DeimosSyscall
@@ -115,8 +135,9 @@ namespace Core {
 #endif
 
 #ifdef MEMORY_PROTECTION
-		byte* protectionSet;
-		int protectionEnabled;
+		byte* protectionSet;	//one bit per byte of mem_ds
+		byte* protectionPages;	//one byte per page; 1 if any byte in the page is protected
+		int protectionEnabled;	//0 or 1
 #endif
 
 #if defined(SYMBIAN) && defined(SUPPORT_RELOAD)
@@ -153,8 +174,53 @@ namespace Core {
 	void DeleteCore(VMCore* core);
 	int GetIp(const VMCore* core);	//only valid if VM is not Running, or UPDATE_IP is defined
 	void SetIp(VMCore* core, int ip);
+#ifdef FAKE_CALL_STACK
+	//The number of frames on the call stack, including those that didn't fit.
 	int GetFakeCallStackDepth(const VMCore* core);
-	const int* GetFakeCallStack(const VMCore* core);
+	//Copies the innermost frames that are still intact, at most maxFrames and
+	//FAKE_CALL_STACK_SIZE, outermost first. Returns the number of frames copied.
+	int GetFakeCallStack(const VMCore* core, int* frames, int maxFrames);
+#endif
+#ifdef VM_SNAPSHOTS
+	//Makes the core write a snapshot of itself and the runtime to filename,
+	//when the program first invokes the given syscall.
+	void SetSnapshotTrigger(VMCore* core, const char* filename, int syscallId);
+	//Call after LoadVMApp(). Returns false, with nothing changed,
+	//if the snapshot is missing or was made from another program.
+	bool LoadSnapshot(VMCore* core, const char* filename);
+#endif
+#ifdef SAMPLING_PROFILER
+	//Starts the sampling profiler. The profile is written when the core is deleted,
+	//to baseName.folded and baseName.pb.
+	void StartSampling(VMCore* core, const char* baseName, int intervalMs);
+#endif
+#ifdef SYSCALL_STATISTICS
+	//Starts counting syscalls, and timing them if timed is true.
+	//The counters are written to filename, or to the log if filename is NULL,
+	//when the core is deleted and after RequestSyscallStatsDump().
+	void StartSyscallStats(VMCore* core, bool timed, const char* filename);
+	//Makes the next core to invoke a syscall write its counters.
+	//Safe to call from a signal handler.
+	void RequestSyscallStatsDump();
+#endif
+#ifdef VM_STATISTICS
+	//Makes the core append its counters, and the runtime's, to filename as JSON lines
+	//(see VMStatistics.h). Returns false if the file can't be opened.
+	bool StartStatisticsDump(VMCore* core, const char* filename, int intervalMs);
+#endif
+#ifdef BLOCK_PROFILING
+	//Makes the core write its basic-block profile (see BlockProfile.h) to filename when it is deleted.
+	void SetBlockProfileFile(VMCore* core, const char* filename);
+#endif
+#ifdef SYSCALL_RECORDING
+	//Call after LoadVMApp(). Records the results of the non-deterministic syscalls
+	//to filename, until the core is deleted.
+	bool StartSyscallRecording(VMCore* core, const char* filename);
+	//Call after LoadVMApp(). Feeds the program the results recorded in filename
+	//instead of running those syscalls. Exits when the log ends.
+	//Returns false if the log is missing or was recorded from another program.
+	bool StartSyscallReplay(VMCore* core, const char* filename);
+#endif
 
 	//returns false on failure
 #ifdef MOBILEAUTHOR
@@ -179,6 +245,8 @@ namespace Core {
 #ifdef GDB_DEBUG
 	void Step(VMCore*);
 #endif
+	//call after modifying mem_cs, so that any pre-decoded code is refreshed.
+	void InvalidateCode(VMCore* core, int address, int length);
 
 	//for syscall
 	int& GetVMYield(VMCore* core);
@@ -198,7 +266,11 @@ namespace Core {
 }
 
 #ifndef SYMBIAN
-extern Core::VMCore* gCore;
+#ifndef VM_THREAD_LOCAL
+#define VM_THREAD_LOCAL
+#endif
+//The core running on this thread, if VM_THREAD_LOCAL is set.
+extern VM_THREAD_LOCAL Core::VMCore* gCore;
 #endif
 
 #endif	//CORE_H
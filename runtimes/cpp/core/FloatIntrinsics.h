@@ -0,0 +1,126 @@
+/* Copyright 2013 David Axmark
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef FLOATINTRINSICS_H
+#define FLOATINTRINSICS_H
+
+// The soft-float syscalls, run directly on the register file by the
+// interpreters and the recompilers when INLINE_FLOAT_SYSCALLS is defined.
+// Include this before testing INLINE_FLOAT_SYSCALLS.
+// Arguments and results use the same registers as invoke_syscall_cpp.h:
+// i0-i3 in, r14 (and r15 for doubles) out.
+
+#include <helpers/helpers.h>
+#include <helpers/maapi_defs.h>
+#include <helpers/asm_config.h>
+#include "Core.h"
+
+//so that they show up in the syscall log.
+#ifdef SYSCALL_DEBUGGING_MODE
+#undef INLINE_FLOAT_SYSCALLS
+#endif
+
+#define SYSCALL_ID_ENUM_ELEM(number, reType, name, arg1, argD) SYSCALL_ID_##name = number,
+enum {
+	SYSCALLS(SYSCALL_ID_ENUM_ELEM, , , )
+};
+
+#define FLOAT_INTRINSICS(m)\
+	m(__adddf3) m(__subdf3) m(__muldf3) m(__divdf3) m(__negdf2)\
+	m(__fixdfsi) m(__fixunsdfsi) m(__floatsidf) m(__extendsfdf2) m(dcmp)\
+	m(__addsf3) m(__subsf3) m(__mulsf3) m(__divsf3) m(__negsf2)\
+	m(__fixsfsi) m(__fixunssfsi) m(__floatsisf) m(__truncdfsf2) m(fcmp)
+
+static inline double fiGetDouble(const int* regs, int r) {
+	MA_DV dv;
+	dv.MA_DV_HI = regs[r];
+	dv.MA_DV_LO = regs[r+1];
+	return dv.d;
+}
+static inline float fiGetFloat(const int* regs, int r) {
+	return MAKE(float, regs[r]);
+}
+static inline void fiSetDouble(int* regs, double d) {
+	MA_DV dv;
+	dv.d = d;
+	regs[Core::REG_r14] = dv.MA_DV_HI;
+	regs[Core::REG_r15] = dv.MA_DV_LO;
+}
+static inline void fiSetFloat(int* regs, float f) {
+	regs[Core::REG_r14] = MAKE(int, f);
+}
+
+#define FI_D(n) fiGetDouble(regs, Core::REG_i##n)
+#define FI_F(n) fiGetFloat(regs, Core::REG_i##n)
+#define FI_I(n) regs[Core::REG_i##n]
+// like dcmp and fcmp: -1 for NaN. written without == for -Wfloat-equal.
+#define FI_CMP(a, b) ((a) > (b) ? 1 : ((a) >= (b) ? 0 : -1))
+#define FI_IS_ZERO(x) ((x) >= 0 && (x) <= 0)
+
+// Returns false if id isn't a float intrinsic, or if the call must take
+// the normal syscall path; that is division by zero, which may panic.
+static inline bool runFloatIntrinsic(int id, int* regs) {
+	switch(id) {
+	case SYSCALL_ID___adddf3: fiSetDouble(regs, FI_D(0) + FI_D(2)); return true;
+	case SYSCALL_ID___subdf3: fiSetDouble(regs, FI_D(0) - FI_D(2)); return true;
+	case SYSCALL_ID___muldf3: fiSetDouble(regs, FI_D(0) * FI_D(2)); return true;
+	case SYSCALL_ID___divdf3:
+		if(FI_IS_ZERO(FI_D(2)))
+			return false;
+		fiSetDouble(regs, FI_D(0) / FI_D(2));
+		return true;
+	case SYSCALL_ID___negdf2: fiSetDouble(regs, -FI_D(0)); return true;
+	case SYSCALL_ID___fixdfsi: regs[Core::REG_r14] = (int)FI_D(0); return true;
+	case SYSCALL_ID___fixunsdfsi: regs[Core::REG_r14] = (int)(uint)FI_D(0); return true;
+	case SYSCALL_ID___floatsidf: fiSetDouble(regs, (double)FI_I(0)); return true;
+	case SYSCALL_ID___extendsfdf2: fiSetDouble(regs, (double)FI_F(0)); return true;
+	case SYSCALL_ID_dcmp: regs[Core::REG_r14] = FI_CMP(FI_D(0), FI_D(2)); return true;
+
+	case SYSCALL_ID___addsf3: fiSetFloat(regs, FI_F(0) + FI_F(1)); return true;
+	case SYSCALL_ID___subsf3: fiSetFloat(regs, FI_F(0) - FI_F(1)); return true;
+	case SYSCALL_ID___mulsf3: fiSetFloat(regs, FI_F(0) * FI_F(1)); return true;
+	case SYSCALL_ID___divsf3:
+		if(FI_IS_ZERO(FI_F(1)))
+			return false;
+		fiSetFloat(regs, FI_F(0) / FI_F(1));
+		return true;
+	case SYSCALL_ID___negsf2: fiSetFloat(regs, -FI_F(0)); return true;
+	case SYSCALL_ID___fixsfsi: regs[Core::REG_r14] = (int)FI_F(0); return true;
+	case SYSCALL_ID___fixunssfsi: regs[Core::REG_r14] = (int)(uint)FI_F(0); return true;
+	case SYSCALL_ID___floatsisf: fiSetFloat(regs, (float)FI_I(0)); return true;
+	case SYSCALL_ID___truncdfsf2: fiSetFloat(regs, (float)FI_D(0)); return true;
+	case SYSCALL_ID_fcmp: regs[Core::REG_r14] = FI_CMP(FI_F(0), FI_F(1)); return true;
+	default:
+		return false;
+	}
+}
+
+static inline bool isFloatIntrinsic(int id) {
+#define FLOAT_INTRINSIC_CASE(name) case SYSCALL_ID_##name:
+	switch(id) {
+	FLOAT_INTRINSICS(FLOAT_INTRINSIC_CASE)
+		return true;
+	default:
+		return false;
+	}
+}
+
+#undef FI_D
+#undef FI_F
+#undef FI_I
+#undef FI_CMP
+#undef FI_IS_ZERO
+
+#endif	//FLOATINTRINSICS_H
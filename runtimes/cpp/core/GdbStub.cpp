@@ -43,11 +43,16 @@ char GdbStub::hexChars[] = {'0','1','2','3','4','5','6','7','8','9','a','b','c',
 
 GdbStub::GdbStub(Core::VMCore *core)
 {
-	outputBuffer.resize(1024);
+	// a reply of the advertised size, plus the framing and a notification prefix.
+	outputBuffer.resize(GDB_PACKET_SIZE + 16);
 	curOutputBuffer = outputBuffer.begin();
-	mInputBuffer.resize(1024);
+	mInputBuffer.resize(GDB_PACKET_SIZE + 16);
     mCore = core;
     mWaitingForAck = false;
+    mNoReply = false;
+    mNonStop = false;
+    mRunning = false;
+    mLastSignal = eBreakpoint;
     mQuit = false;
     mExitPacketSent = false;
     mMessageMutex.post();	//leave it open so exactly one thread can get in
@@ -60,34 +65,61 @@ int GdbStub::hexToNum(char c) {
 	else return -1;
 }
 
-void GdbStub::checkAndResize(int len) {
+void GdbStub::checkOutputSpace(int len) {
 	size_t curIndex = (size_t)(curOutputBuffer-outputBuffer.begin());
-	size_t newSize = (len+curIndex)+1; // +1 for the null terminator...
-	if(newSize>(outputBuffer.size())) {
-		//BIG_PHAT_ERROR(ERR_INTERNAL);
-		size_t betterSize = (outputBuffer.size()+2)*2;
-		if(betterSize>newSize) newSize=betterSize;
-		outputBuffer.resize(newSize);
-		curOutputBuffer = outputBuffer.begin()+curIndex;
-	}	
+	if(len + curIndex + 1 > outputBuffer.size()) { // +1 for the null terminator...
+		BIG_PHAT_ERROR(ERR_INTERNAL);
+	}
+}
+
+bool GdbStub::replyFits(int len) const {
+	// the reply starts after the '$'.
+	int used = (int)(curOutputBuffer - outputBuffer.begin()) - 1;
+	return len >= 0 && len <= GDB_PACKET_SIZE - used;
+}
+
+bool GdbStub::replyTooLarge() {
+	clearOutputBuffer();
+	appendOut("E02");
+	return true;
 }
 
 void GdbStub::appendOut(const char *what) {
-	checkAndResize(strlen(what));
+	checkOutputSpace(strlen(what));
 	curOutputBuffer += sprintf(curOutputBuffer, "%s", what);	
 }
 
 void GdbStub::appendOut(char what) {
-	checkAndResize(1);
+	checkOutputSpace(1);
 	*curOutputBuffer++ = what;
 	*curOutputBuffer = 0;
 }
 
+void GdbStub::appendBinary(const byte* data, int len) {
+	checkOutputSpace(len * 2);
+	for(int i = 0; i < len; i++) {
+		byte b = data[i];
+		if(b == '#' || b == '$' || b == '}' || b == '*') {
+			*curOutputBuffer++ = '}';
+			b ^= 0x20;
+		}
+		*curOutputBuffer++ = b;
+	}
+	*curOutputBuffer = 0;
+}
+
+bool GdbStub::inputStartsWith(const char* prefix) {
+	size_t len = strlen(prefix);
+	if(mInputEnd - mInputPtr < (int)len || strncmp(mInputPtr, prefix, len) != 0)
+		return false;
+	mInputPtr += len;
+	return true;
+}
+
 void GdbStub::clearOutputBuffer() {
 	curOutputBuffer = outputBuffer.begin();
-	checkAndResize(1024);
+	mNoReply = false;
 	appendOut('$');
-	
 }
 
 void GdbStub::setupDebugConnection() {
@@ -208,7 +240,14 @@ void GdbStub::exceptionHandler(int code) {
 	putMessage(m);
 }
 void GdbStub::sendExceptionPacket(int code) {
+	mRunning = false;
+	mLastSignal = code;
 	clearOutputBuffer();
+	if(mNonStop) {
+		// a notification. GDB doesn't ack it, but answers with vStopped.
+		outputBuffer[0] = '%';
+		appendOut("Stop:");
+	}
 	appendOut('S');
 	appendOut(hexChars[(code>>4)&0xf]);
 	appendOut(hexChars[(code)&0xf]);
@@ -306,11 +345,7 @@ void GdbStub::handleInput() {
 			break;
 		case 0x03:
 			LOG("Stub recieved interrupt signal\n");
-			mCore->mGdbSignal = eInterrupt;
-			{
-				SDL_UserEvent event = { FE_INTERRUPT, 0, NULL, NULL };
-				FE_PushEvent((SDL_Event*)&event);
-			}
+			interrupt();
 			pos++;
 			break;
 		default:
@@ -324,6 +359,12 @@ void GdbStub::handleInput() {
 	mInputPos = 0;
 }
 
+void GdbStub::interrupt() {
+	mCore->mGdbSignal = eInterrupt;
+	SDL_UserEvent event = { FE_INTERRUPT, 0, NULL, NULL };
+	FE_PushEvent((SDL_Event*)&event);
+}
+
 void GdbStub::handleAck() {
 	LOGD("GDB ACK was sent from the client.\n");
 	if(mWaitingForAck) {
@@ -375,6 +416,7 @@ int GdbStub::handlePacket(int pos) {
 
 	//parse the packet
 	mInputPtr = mInputBuffer.begin() + begin;
+	mInputEnd = mInputBuffer.begin() + pos - 3;
 	doPacket();
 	return pos;
 }
@@ -423,60 +465,153 @@ bool GdbStub::writeRegisters() {
 		mCore->regs[i] = getDataTypeFromInput<int>();
 	}
 	Core::SetIp(mCore, getDataTypeFromInput<int>());
+	appendOut("OK");
 	return true;
 }
 
-bool GdbStub::readMemory() {
-	int address = getBoundedDataTypeFromInput<int>(',');
-	int length = getBoundedDataTypeFromInput<int>(0);	
+static bool isCodeAddress(int address) {
+	return !(address >= DATA_MEMORY_START && address < INSTRUCTION_MEMORY_START);
+}
 
-	byte *src;
+byte* GdbStub::getMemory(int address, int length) {
+	byte *mem;
 	int size;
 	if(address >= DATA_MEMORY_START && address < INSTRUCTION_MEMORY_START) {
 		size = mCore->DATA_SEGMENT_SIZE;
-		src = (byte*)mCore->mem_ds;
+		mem = (byte*)mCore->mem_ds;
 	} else {
 		size = mCore->CODE_SEGMENT_SIZE;
-		src = (byte*)mCore->mem_cs;
+		mem = (byte*)mCore->mem_cs;
 	}
 	address &= ADDRESS_MASK;
-	if(address >= size || address + length > size) {
+	if(length < 0 || address > size || length > size - address) {
 		LOG("bad address: 0x%x + 0x%x\n", address, length);
-		return false;
+		return NULL;
 	}
-	src += address;
+	return mem + address;
+}
+
+bool GdbStub::appendMemory(int address, int length) {
+	const byte* src = getMemory(address, length);
+	if(!src)
+		return false;
 
+	checkOutputSpace(length * 2);
 	for(int i = 0; i < length; i++) {
-		appendDataTypeToOutput<byte>(src[i]);
+		*curOutputBuffer++ = hexChars[src[i] >> 4];
+		*curOutputBuffer++ = hexChars[src[i] & 0xf];
 	}
+	*curOutputBuffer = 0;
 	return true;
 }
 
+bool GdbStub::readMemory() {
+	int address = getBoundedDataTypeFromInput<int>(',');
+	int length = getBoundedDataTypeFromInput<int>(0);	
+	if(!replyFits(length * 2))
+		return replyTooLarge();
+	return appendMemory(address, length);
+}
+
+// yADDRESS,LENGTH;ADDRESS,LENGTH;...
+// The reply is the ranges' bytes, one after the other, as with 'm'.
+bool GdbStub::readMemoryRanges() {
+	while(true) {
+		int address = getBoundedDataTypeFromInput<int>(',');
+		const char* end = mInputPtr;
+		while(end < mInputEnd && *end != ';')
+			end++;
+		bool last = (end == mInputEnd);
+		int length = getBoundedDataTypeFromInput<int>(last ? 0 : ';');
+		if(!replyFits(length * 2))
+			return replyTooLarge();
+		if(!appendMemory(address, length))
+			return false;
+		if(last)
+			return true;
+	}
+}
+
 bool GdbStub::writeMemory() {
 	int address = getBoundedDataTypeFromInput<int>(',');
 	int length = getBoundedDataTypeFromInput<int>(':');
 
-	byte *dst;
-	int size;
-	if(address>=DATA_MEMORY_START&&address<INSTRUCTION_MEMORY_START) {
-		size = mCore->DATA_SEGMENT_SIZE;
-		dst = (byte*)mCore->mem_ds;
-	} else {
-		size = mCore->CODE_SEGMENT_SIZE;
-		dst = (byte*)mCore->mem_cs;
+	byte* dst = getMemory(address, length);
+	if(!dst)
+		return false;
+
+	for(int i = 0; i < length; i++) {
+		dst[i] = getDataTypeFromInput<byte>();
+	}
+	if(isCodeAddress(address)) {
+		Core::InvalidateCode(mCore, address & ADDRESS_MASK, length);
 	}
-	address&=ADDRESS_MASK;
+	appendOut("OK");
 
-	if(address >= size || address + length > size) {
-		LOG("bad address: 0x%x + 0x%x\n", address, length);
+	return true;
+}
+
+// xADDRESS,LENGTH
+// The reply is 'b' and the bytes, escaped.
+bool GdbStub::readMemoryBinary() {
+	int address = getBoundedDataTypeFromInput<int>(',');
+	int length = getBoundedDataTypeFromInput<int>(0);
+	// every byte may need escaping.
+	if(!replyFits(1 + length * 2))
+		return replyTooLarge();
+	const byte* src = getMemory(address, length);
+	if(!src)
 		return false;
+	appendOut('b');
+	appendBinary(src, length);
+	return true;
+}
+
+// XADDRESS,LENGTH:DATA
+// '}' escapes the next byte, which is xored with 0x20.
+bool GdbStub::writeMemoryBinary() {
+	int address = getBoundedDataTypeFromInput<int>(',');
+	int length = getBoundedDataTypeFromInput<int>(':');
+
+	byte* dst = getMemory(address, length);
+	if(!dst)
+		return false;
+	bool code = isCodeAddress(address);
+	if(code && mRunning) {
+		// the core may be executing it.
+		appendOut("E01");
+		return true;
 	}
 
-	for(int i = 0; i < length; i++) {
-		dst[address+i] = getDataTypeFromInput<byte>();
+	int i = 0;
+	for(const char* p = mInputPtr; p < mInputEnd && i < length; p++) {
+		byte b = *p;
+		if(b == '}') {
+			if(++p == mInputEnd)
+				break;
+			b = *p ^ 0x20;
+		}
+		dst[i++] = b;
+	}
+	if(code) {
+		Core::InvalidateCode(mCore, address & ADDRESS_MASK, i);
+	}
+	if(i != length) {
+		LOG("short binary write: 0x%x of 0x%x\n", i, length);
+		return false;
 	}
 	appendOut("OK");
+	return true;
+}
 
+bool GdbStub::resume(GdbSignal signal) {
+	mCore->mGdbSignal = signal;
+	mRunning = true;
+	if(mNonStop)
+		appendOut("OK");
+	else
+		mNoReply = true;	//until it stops
+	mExecSem.post();
 	return true;
 }
 
@@ -485,9 +620,7 @@ bool GdbStub::continueExec() {
 	if(address) {
 		Core::SetIp(mCore, address);
 	}
-	mCore->mGdbSignal = eNone;
-	mExecSem.post();
-	return true;
+	return resume(eNone);
 }
 
 bool GdbStub::stepExec() {
@@ -495,19 +628,25 @@ bool GdbStub::stepExec() {
 	if(address) {
 		Core::SetIp(mCore, address);
 	}
-	mCore->mGdbSignal = eStep;
-	mExecSem.post();
-	return true;
+	return resume(eStep);
 }
 
 bool GdbStub::quit() {
 	mQuit = true;
+	mNoReply = true;
 	return true;
 }
 
 // Optional commands follows:
 bool GdbStub::lastSignal() {
-	return false;
+	if(mNonStop && mRunning) {
+		appendOut("OK");
+		return true;
+	}
+	appendOut('S');
+	appendOut(hexChars[(mLastSignal>>4)&0xf]);
+	appendOut(hexChars[(mLastSignal)&0xf]);
+	return true;
 }
 
 bool GdbStub::readRegister() {
@@ -535,11 +674,86 @@ bool GdbStub::search() {
 }
 
 bool GdbStub::generalSet() {
-	return false;
+	if(inputStartsWith("NonStop:")) {
+		mNonStop = (*mInputPtr == '1');
+		appendOut("OK");
+		return true;
+	}
+	return defaultResponse();
 }
 
 bool GdbStub::generalQuery() {
-	return false;
+	if(inputStartsWith("Supported")) {
+		sprintf(tempBuffer, "PacketSize=%x;qXfer:memory-map:read+;QNonStop+;vContSupported+",
+			GDB_PACKET_SIZE);
+		appendOut(tempBuffer);
+		return true;
+	}
+	if(inputStartsWith("Xfer:memory-map:read::")) {
+		return memoryMapQuery();
+	}
+	if(inputStartsWith("Attached")) {
+		appendOut('1');
+		return true;
+	}
+	return defaultResponse();
+}
+
+// qXfer:memory-map:read::OFFSET,LENGTH
+// The reply is 'm' and a part of the map, or 'l' and the last part.
+bool GdbStub::memoryMapQuery() {
+	int offset = getBoundedDataTypeFromInput<int>(',');
+	int length = getBoundedDataTypeFromInput<int>(0);
+	int mapLen = sprintf(tempBuffer,
+		"<?xml version=\"1.0\"?>\n"
+		"<!DOCTYPE memory-map PUBLIC \"+//IDN gnu.org//DTD GDB Memory Map V1.0//EN\""
+		" \"http://sourceware.org/gdb/gdb-memory-map.dtd\">\n"
+		"<memory-map>\n"
+		"<memory type=\"ram\" start=\"0x%x\" length=\"0x%x\"/>\n"
+		"<memory type=\"ram\" start=\"0x%x\" length=\"0x%x\"/>\n"
+		"</memory-map>\n",
+		DATA_MEMORY_START, mCore->DATA_SEGMENT_SIZE,
+		INSTRUCTION_MEMORY_START, mCore->CODE_SEGMENT_SIZE);
+	if(offset < 0 || length < 0 || offset > mapLen)
+		return false;
+	if(length > mapLen - offset)
+		length = mapLen - offset;
+	appendOut(offset + length == mapLen ? 'l' : 'm');
+	appendBinary((byte*)tempBuffer + offset, length);
+	return true;
+}
+
+// vCont? lists the supported actions.
+// vCont;ACTION[:THREAD]... applies the first action; there is only one thread.
+// vStopped acknowledges a stop notification. There is never more than one.
+bool GdbStub::vCommand() {
+	if(inputStartsWith("Cont?")) {
+		appendOut("vCont;c;C;s;S;t");
+		return true;
+	}
+	if(inputStartsWith("Cont;")) {
+		char action = *mInputPtr++;
+		switch(action) {
+		case 'c':
+		case 'C':
+			return resume(eNone);
+		case 's':
+		case 'S':
+			return resume(eStep);
+		case 't':
+			if(mRunning)
+				interrupt();
+			appendOut("OK");
+			return true;
+		default:
+			return false;
+		}
+	}
+	if(inputStartsWith("Stopped")) {
+		appendOut("OK");
+		return true;
+	}
+	return defaultResponse();
 }
 
 bool GdbStub::sectionOffsetsQuery() {
@@ -550,8 +764,9 @@ bool GdbStub::consoleOutput() {
 	return false;
 }
 
+// An empty reply tells GDB that the command isn't supported.
 bool GdbStub::defaultResponse() {
-	return false;
+	return true;
 }
 
 // Select and execute command:
@@ -567,31 +782,27 @@ bool GdbStub::executeCommand() {
 		case 'g': return readRegisters();
 		case 'G': return writeRegisters();
 		case 'm': return readMemory();
+		case 'y': return readMemoryRanges();
 		case 'M': return writeMemory();
 		case 'c': return continueExec();
 		case 's': return stepExec();
 		case 'e': return quit();
 
 			// optional;
-
+		case 'x': return readMemoryBinary();
+		case 'X': return writeMemoryBinary();
+		case '?': return lastSignal();
+		case 'q': return generalQuery();
+		case 'Q': return generalSet();
+		case 'v': return vCommand();
 
 #if 0
 		case 'p': return readRegister();		
 		case 'P': return writeRegister();			
-		case '?': return lastSignal();
 		case 'k': return killRequest();
 		case 'd': return toggleDebug();
 		case 'r': return reset();
 		case 't': return search();
-		case 'q': 
-			{
-				if((inputBuffer.toString()).startsWith("Offsets") == true) {
-					return sectionOffsetsQuery();
-				} else {
-					return generalQuery();
-				}
-			}
-			case 'Q' return generalSet();
 				case 'O' return consoleOutput();
 #endif	//0
 
@@ -601,17 +812,16 @@ bool GdbStub::executeCommand() {
 }
 
 void GdbStub::putPacket() {
-	DEBUG_ASSERT(!mWaitingForAck);
+	if(mNoReply)
+		return;
+	// notifications aren't acked.
+	bool notification = (outputBuffer[0] == '%');
+	DEBUG_ASSERT(notification || !mWaitingForAck);
+	// binary replies may contain NULs, so count up to the end of the output.
 	int calculatedChecksum = 0;
-	const char *cur = outputBuffer.begin() + 1;
-	*curOutputBuffer = 0;
-	int len = 0;
-	while(*cur) {
-		len++;
-		calculatedChecksum += (byte)(*cur++);
+	for(const char *cur = outputBuffer.begin() + 1; cur < curOutputBuffer; cur++) {
+		calculatedChecksum += (byte)*cur;
 	}
-	if(len == 0)
-		return;
 
 	appendOut('#');
 	appendOut(hexChars[(calculatedChecksum>>4)&0xf]);
@@ -619,7 +829,8 @@ void GdbStub::putPacket() {
 	*curOutputBuffer = 0;
 
 	LOGD("GDB transmission: \"%s\"\n", outputBuffer.begin());
-	mWaitingForAck = true;
+	if(!notification)
+		mWaitingForAck = true;
 	putDebugChars(outputBuffer.begin(), curOutputBuffer - outputBuffer.begin());
 }
 
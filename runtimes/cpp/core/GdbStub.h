@@ -24,6 +24,10 @@ limitations under the License.
 /* used when compiling the GDB stub */
 #define DBG_STAB ENDOP
 
+// The largest packet the stub accepts or sends, not counting the framing,
+// as reported by qSupported. Memory reads with a larger reply get E02.
+#define GDB_PACKET_SIZE 0x4000
+
 class GdbStub {
 public:
 	GdbStub(Core::VMCore *core);
@@ -92,12 +96,14 @@ private:
 	void handleAck();
 	void handleNack();
 	int handlePacket(int pos);	//returns new pos, or <0 if packet was incomplete
+	void interrupt();
 
 	// Used to store the input data and output data.
 	//char mInputBuffer[1024*10];	//todo:make variable length
 	mostd::vector<char> mInputBuffer;
 	int mInputPos;
 	char* mInputPtr;	//legacy
+	char* mInputEnd;	//the '#' of the current packet. binary data may contain NULs.
 
 	mostd::vector<char> outputBuffer;
 	char *curOutputBuffer;
@@ -107,6 +113,14 @@ private:
 
 	bool mWaitingForAck;
 
+	// Set by commands that reply later, or not at all.
+	bool mNoReply;
+
+	// In non-stop mode, resuming replies at once and stops are sent as notifications.
+	bool mNonStop;
+	bool mRunning;
+	int mLastSignal;
+
 	// Reference to the core, used to retrieve and write memory/registers and such.
 	Core::VMCore *mCore;
 
@@ -153,7 +167,17 @@ private:
 
 	void appendOut(const char *what);
 	void appendOut(char what);
-	void checkAndResize(int len);
+	// The output buffer has a fixed size; this is an internal error if len more bytes don't fit.
+	void checkOutputSpace(int len);
+	// True if len more bytes of reply stay within GDB_PACKET_SIZE.
+	bool replyFits(int len) const;
+	// Replaces the reply with E02.
+	bool replyTooLarge();
+
+	// Appends data, escaped as in binary packets.
+	void appendBinary(const byte* data, int len);
+	// Advances the input past prefix if it starts with it.
+	bool inputStartsWith(const char* prefix);
 
 	template<typename type>
 	void appendDataTypeToOutput(type d) {
@@ -179,8 +203,18 @@ private:
 	bool writeRegisters();
 	bool readMemory();
 	bool writeMemory();
+
+	// Reads several ranges of memory in one packet. Not part of the GDB protocol.
+	bool readMemoryRanges();
+	// Appends a range of memory to the output, in hex. Returns false if it's out of bounds.
+	bool appendMemory(int address, int length);
+	// Returns the memory at address, or NULL if the range is out of bounds.
+	byte* getMemory(int address, int length);
+	bool readMemoryBinary();
+	bool writeMemoryBinary();
 	bool continueExec();
 	bool stepExec();
+	bool resume(GdbSignal signal);
 	
 	/**
 	 * Terminates the program (relatively) gracefully.
@@ -207,6 +241,8 @@ private:
 	bool search();
 	bool generalSet();
 	bool generalQuery();
+	bool memoryMapQuery();
+	bool vCommand();
 	bool sectionOffsetsQuery();
 	bool consoleOutput();
 	bool defaultResponse();
@@ -0,0 +1,109 @@
+/* Copyright 2013 David Axmark
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "config_platform.h"
+
+#ifdef MAPPED_PROGRAM_LOADING
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <helpers/helpers.h>
+
+#include "MappedSegment.h"
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+using namespace MoSyncError;
+
+static bool readFully(int fd, void* dst, size_t len, off_t offset) {
+	char* p = (char*)dst;
+	while(len > 0) {
+		ssize_t res = pread(fd, p, len, offset);
+		if(res <= 0)
+			return false;
+		p += res;
+		offset += res;
+		len -= res;
+	}
+	return true;
+}
+
+void* mapSegment(MappedSegment& seg, int fd, int fileOffset, int fileLen,
+	unsigned int segmentSize, int alignment, bool writable)
+{
+	DEBUG_ASSERT(seg.base == NULL);
+	const size_t pageSize = sysconf(_SC_PAGESIZE);
+	const size_t pageMask = pageSize - 1;
+
+	//the segment must have the same offset within a page as the file contents,
+	//or the contents can't be mapped.
+	bool cow = (fileOffset % alignment) == 0;
+	size_t skew = cow ? (fileOffset & pageMask) : 0;
+
+	seg.size = (skew + segmentSize + pageMask) & ~pageMask;
+	seg.base = mmap(NULL, seg.size, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(seg.base == MAP_FAILED) {
+		LOG("mmap(%i) failed\n", (int)seg.size);
+		seg.base = NULL;
+		return NULL;
+	}
+	char* start = (char*)seg.base + skew;
+
+	//[fileBase, fullEnd) are whole pages that contain nothing but the file contents,
+	//except for bytes before fileOffset, which land below start.
+	int copyFrom = fileOffset;
+	if(cow) {
+		size_t fileBase = fileOffset - skew;
+		size_t fullEnd = (fileOffset + fileLen) & ~pageMask;
+		if(fullEnd > fileBase) {
+			void* res = mmap(seg.base, fullEnd - fileBase, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_FIXED, fd, fileBase);
+			if(res == MAP_FAILED) {
+				LOG("mmap of file failed\n");
+				unmapSegment(seg);
+				return NULL;
+			}
+			copyFrom = MAX(fileOffset, (int)fullEnd);
+		}
+	}
+	int copyLen = fileOffset + fileLen - copyFrom;
+	if(!readFully(fd, start + (copyFrom - fileOffset), copyLen, copyFrom)) {
+		LOG("pread failed\n");
+		unmapSegment(seg);
+		return NULL;
+	}
+
+	if(!writable) {
+		if(mprotect(seg.base, seg.size, PROT_READ) != 0) {
+			unmapSegment(seg);
+			return NULL;
+		}
+	}
+	return start;
+}
+
+void unmapSegment(MappedSegment& seg) {
+	if(seg.base == NULL)
+		return;
+	munmap(seg.base, seg.size);
+	seg.base = NULL;
+	seg.size = 0;
+}
+
+#endif	//MAPPED_PROGRAM_LOADING
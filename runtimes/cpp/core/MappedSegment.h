@@ -0,0 +1,42 @@
+/* Copyright 2013 David Axmark
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef MAPPEDSEGMENT_H
+#define MAPPEDSEGMENT_H
+
+#include <stddef.h>
+
+//A VM segment built from memory mappings instead of new[] and ZEROMEM.
+//POSIX only.
+struct MappedSegment {
+	void* base;
+	size_t size;
+
+	MappedSegment() : base(NULL), size(0) {}
+};
+
+//Returns a pointer to segmentSize bytes, of which the first fileLen are read from fd at fileOffset
+//and the rest are zero, or NULL on failure.
+//Whole pages of file contents are mapped copy-on-write; everything else is anonymous memory,
+//so pages that are never touched are never allocated.
+//If fileOffset is not a multiple of alignment, the file contents are read instead of mapped.
+//If writable is false, the segment is made read-only.
+void* mapSegment(MappedSegment& seg, int fd, int fileOffset, int fileLen,
+	unsigned int segmentSize, int alignment, bool writable);
+
+//Does nothing if seg isn't mapped.
+void unmapSegment(MappedSegment& seg);
+
+#endif	//MAPPEDSEGMENT_H
@@ -54,7 +54,7 @@
 #ifdef AVMPLUS_VERBOSE
 // hack (for debugging)
 #include <core.h>
-extern Core::VMCore *gCore;
+extern VM_THREAD_LOCAL Core::VMCore *gCore;
 #endif
 
 namespace avmplus
@@ -21,6 +21,9 @@ limitations under the License.
 
 #include <helpers/helpers.h>
 #include <base/base_errors.h>
+#ifdef INLINE_FLOAT_SYSCALLS
+#include "../FloatIntrinsics.h"
+#endif
 using namespace MoSyncError;
 
 using namespace avmplus;
@@ -1043,12 +1046,26 @@ namespace MoSync {
 		saveRegister(rd, saveReg);
 	}
 
+#ifdef INLINE_FLOAT_SYSCALLS
+	// called like VMCore::invokeSysCall.
+	static void invokeFloatIntrinsic(VMCore* core, int id) {
+		if(!runFloatIntrinsic(id, core->regs))
+			core->invokeSysCall(id);
+	}
+#endif
+
 	void ArmRecompiler::visit_SYSCALL() {
 		LOGC("SYSCALL\n");
 
 		InvokeSyscall_fptr fptr = &VMCore::invokeSysCall;
 		int invokeSyscallAddr = FUNC_CAST(fptr);
 		int syscallNumber = mInstructions[0].imm;
+#ifdef INLINE_FLOAT_SYSCALLS
+		if(isFloatIntrinsic(syscallNumber)) {
+			void (*fiptr)(VMCore*, int) = &invokeFloatIntrinsic;
+			invokeSyscallAddr = FUNC_CAST(fiptr);
+		}
+#endif
 		//GEN_BREAKPOINT;
 
 	//#if 1
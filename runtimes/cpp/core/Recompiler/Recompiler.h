@@ -18,7 +18,7 @@ limitations under the License.
 
 #include <config_platform.h>
 
-#ifdef USE_ARM_RECOMPILER
+#if defined(USE_ARM_RECOMPILER) || defined(USE_X64_RECOMPILER)
 
 #include <Core.h>
 #include "Recompiler.h"
@@ -80,7 +80,7 @@ namespace MoSync {
 
 		// make a tree for all sequences possible, and use it for early outs.
 		struct InstructionPatternNode {
-			InstructionPatternNode(InstructionPatternNode *parent=NULL, int depth=0) : depth(depth), matcher(0), visitor(0), parent(parent) {
+			InstructionPatternNode(InstructionPatternNode *aParent=NULL, int aDepth=0) : depth(aDepth), matcher(0), visitor(0), parent(aParent) {
 				memset(children, 0, sizeof(InstructionPatternNode*));
 			}
 
@@ -166,7 +166,7 @@ namespace MoSync {
 		}
 
 		struct Label {
-			Label(int ip) : ip(ip), next(0) {
+			Label(int aIp) : ip(aIp), next(0) {
 			}
 
 			int ip;
@@ -174,9 +174,9 @@ namespace MoSync {
 		};
 
 		struct Function {
-			Function(int start, int end) : 
-				start(start), end(end), labels(0), next(0) {
-				addLabel(start);	
+			Function(int aStart, int aEnd) : 
+				start(aStart), end(aEnd), labels(0), next(0) {
+				addLabel(aStart);	
 			}
 			Label *findLabel(int ip) {
 				Label *l = labels;
@@ -195,7 +195,7 @@ namespace MoSync {
 
 			Label *findNextLabel(int ip) {
 				Label *l;
-				if(l = findLabel(ip)) return l->next;
+				if((l = findLabel(ip)) != 0) return l->next;
 				else return 0;
 			}
 
@@ -206,9 +206,9 @@ namespace MoSync {
 				} else {
 					Label *l = findLabel(ip);
 					if(l->ip != ip) {
-						Label *next = l->next;
+						Label *oldNext = l->next;
 						l->next = new Label(ip);
-						l->next->next = next;
+						l->next->next = oldNext;
 					}
 				}
 			}
@@ -269,6 +269,7 @@ endOfFunction:
 						f->addLabel(inst.imm);
 						goto endOfFunction;
 					}
+					// fall through
 
 					case Core::_JC_EQ:
 					case Core::_JC_NE:
@@ -361,7 +362,8 @@ endOfFunction:
 					}
 					*/
 
-					if(ip>mCurrentFunction->end) { 
+					// the last function has no end if the code doesn't finish with a RET.
+					if(ip>mCurrentFunction->end && mCurrentFunction->next) { 
 						thisImpl->endFunction(mCurrentFunction);
 						mCurrentFunction = mCurrentFunction->next; 
 						mNextLabel = mCurrentFunction->labels;
@@ -411,6 +413,6 @@ endOfFunction:
 
 } // namespace MoSync
 
-#endif	//USE_ARM_RECOMPILER
+#endif	//USE_ARM_RECOMPILER || USE_X64_RECOMPILER
 
 #endif
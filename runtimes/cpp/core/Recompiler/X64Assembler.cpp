@@ -0,0 +1,278 @@
+/* Copyright 2013 David Axmark
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <config_platform.h>
+
+#ifdef USE_X64_RECOMPILER
+
+#include "X64Assembler.h"
+#include <string.h>
+
+namespace MoSync {
+
+	X64Assembler::X64Assembler() : mStart(NULL), mPos(0) {
+	}
+
+	void X64Assembler::reset(byte* start) {
+		mStart = start;
+		mPos = 0;
+	}
+
+	void X64Assembler::emit8(int b) {
+		if(mStart)
+			mStart[mPos] = (byte)b;
+		mPos++;
+	}
+
+	void X64Assembler::emit32(int i) {
+		if(mStart)
+			memcpy(mStart + mPos, &i, 4);
+		mPos += 4;
+	}
+
+	void X64Assembler::emit64(const void* p) {
+		if(mStart)
+			memcpy(mStart + mPos, &p, 8);
+		mPos += 8;
+	}
+
+	// force is used for byte registers, where a REX prefix selects SPL..DIL
+	// instead of AH..BH.
+	void X64Assembler::rex(bool w, int reg, int index, int base, bool force) {
+		int r = 0x40 | (w ? 8 : 0) | ((reg & 8) >> 1) | ((index & 8) >> 2) | ((base & 8) >> 3);
+		if(r != 0x40 || force)
+			emit8(r);
+	}
+
+	void X64Assembler::modrmReg(int reg, int rm) {
+		emit8(0xC0 | ((reg & 7) << 3) | (rm & 7));
+	}
+
+	// always mod=10, so RBP/R13 need no special case and the size is constant.
+	void X64Assembler::modrmDisp32(int reg, Register base, int disp32) {
+		emit8(0x80 | ((reg & 7) << 3) | (base & 7));
+		if((base & 7) == RSP)
+			emit8(0x24);
+		emit32(disp32);
+	}
+
+	void X64Assembler::modrmSib(int reg, Register base, Register index, int scale, int disp32) {
+		emit8(0x80 | ((reg & 7) << 3) | 4);
+		emit8((scale << 6) | ((index & 7) << 3) | (base & 7));
+		emit32(disp32);
+	}
+
+	void X64Assembler::rel32(const byte* target) {
+		// the displacement is relative to the end of the instruction.
+		emit32((int)(target - (current() + 4)));
+	}
+
+	void X64Assembler::MOV(Register dst, Register src) {
+		rex(false, src, 0, dst);
+		emit8(0x89);
+		modrmReg(src, dst);
+	}
+
+	void X64Assembler::MOV_imm32(Register dst, int imm32) {
+		rex(false, 0, 0, dst);
+		emit8(0xB8 + (dst & 7));
+		emit32(imm32);
+	}
+
+	void X64Assembler::MOV_load(Register dst, Register base, int disp32) {
+		rex(false, dst, 0, base);
+		emit8(0x8B);
+		modrmDisp32(dst, base, disp32);
+	}
+
+	void X64Assembler::MOV_store(Register base, int disp32, Register src) {
+		rex(false, src, 0, base);
+		emit8(0x89);
+		modrmDisp32(src, base, disp32);
+	}
+
+	void X64Assembler::MOV_store_imm32(Register base, int disp32, int imm32) {
+		rex(false, 0, 0, base);
+		emit8(0xC7);
+		modrmDisp32(0, base, disp32);
+		emit32(imm32);
+	}
+
+	void X64Assembler::ALU(AluOperator op, Register dst, Register src) {
+		rex(false, src, 0, dst);
+		emit8((op << 3) | 1);
+		modrmReg(src, dst);
+	}
+
+	void X64Assembler::ALU_imm32(AluOperator op, Register dst, int imm32) {
+		rex(false, 0, 0, dst);
+		emit8(0x81);
+		modrmReg(op, dst);
+		emit32(imm32);
+	}
+
+	void X64Assembler::IMUL(Register dst, Register src) {
+		rex(false, dst, 0, src);
+		emit8(0x0F);
+		emit8(0xAF);
+		modrmReg(dst, src);
+	}
+
+	void X64Assembler::SHIFT_CL(ShiftOperator op, Register dst) {
+		rex(false, 0, 0, dst);
+		emit8(0xD3);
+		modrmReg(op, dst);
+	}
+
+	void X64Assembler::SHIFT_imm8(ShiftOperator op, Register dst, int imm8) {
+		rex(false, 0, 0, dst);
+		emit8(0xC1);
+		modrmReg(op, dst);
+		emit8(imm8);
+	}
+
+	void X64Assembler::NEG(Register dst) {
+		rex(false, 0, 0, dst);
+		emit8(0xF7);
+		modrmReg(3, dst);
+	}
+
+	void X64Assembler::NOT(Register dst) {
+		rex(false, 0, 0, dst);
+		emit8(0xF7);
+		modrmReg(2, dst);
+	}
+
+	void X64Assembler::TEST_rr(Register a, Register b) {
+		rex(false, b, 0, a);
+		emit8(0x85);
+		modrmReg(b, a);
+	}
+
+	void X64Assembler::MOVSX8(Register dst, Register src) {
+		rex(false, dst, 0, src, true);
+		emit8(0x0F);
+		emit8(0xBE);
+		modrmReg(dst, src);
+	}
+
+	void X64Assembler::MOVSX16(Register dst, Register src) {
+		rex(false, dst, 0, src);
+		emit8(0x0F);
+		emit8(0xBF);
+		modrmReg(dst, src);
+	}
+
+	void X64Assembler::LOAD_indexed(Register dst, Register base, Register index, int size) {
+		rex(false, dst, index, base);
+		switch(size) {
+		case 1: emit8(0x0F); emit8(0xBE); break;
+		case 2: emit8(0x0F); emit8(0xBF); break;
+		default: emit8(0x8B); break;
+		}
+		modrmSib(dst, base, index, 0, 0);
+	}
+
+	void X64Assembler::STORE_indexed(Register base, Register index, Register src, int size) {
+		if(size == 2)
+			emit8(0x66);
+		rex(false, src, index, base, size == 1);
+		emit8(size == 1 ? 0x88 : 0x89);
+		modrmSib(src, base, index, 0, 0);
+	}
+
+	void X64Assembler::LOAD_scaled(Register dst, Register base, Register index, int disp32) {
+		rex(false, dst, index, base);
+		emit8(0x8B);
+		modrmSib(dst, base, index, 2, disp32);
+	}
+
+	void X64Assembler::MOV64(Register dst, Register src) {
+		rex(true, src, 0, dst);
+		emit8(0x89);
+		modrmReg(src, dst);
+	}
+
+	void X64Assembler::MOV64_imm64(Register dst, const void* imm64) {
+		rex(true, 0, 0, dst);
+		emit8(0xB8 + (dst & 7));
+		emit64(imm64);
+	}
+
+	void X64Assembler::ADD64_imm32(Register dst, int imm32) {
+		rex(true, 0, 0, dst);
+		emit8(0x81);
+		modrmReg(ADD_op, dst);
+		emit32(imm32);
+	}
+
+	void X64Assembler::SUB64_imm32(Register dst, int imm32) {
+		rex(true, 0, 0, dst);
+		emit8(0x81);
+		modrmReg(SUB_op, dst);
+		emit32(imm32);
+	}
+
+	void X64Assembler::PUSH(Register r) {
+		rex(false, 0, 0, r);
+		emit8(0x50 + (r & 7));
+	}
+
+	void X64Assembler::POP(Register r) {
+		rex(false, 0, 0, r);
+		emit8(0x58 + (r & 7));
+	}
+
+	void X64Assembler::JMP(const byte* target) {
+		emit8(0xE9);
+		rel32(target);
+	}
+
+	void X64Assembler::JCC(ConditionCode cc, const byte* target) {
+		emit8(0x0F);
+		emit8(0x80 + cc);
+		rel32(target);
+	}
+
+	void X64Assembler::JMP_table(Register base, Register index) {
+		rex(false, 0, index, base);
+		emit8(0xFF);
+		modrmSib(4, base, index, 3, 0);
+	}
+
+	void X64Assembler::JMP_reg(Register r) {
+		rex(false, 0, 0, r);
+		emit8(0xFF);
+		modrmReg(4, r);
+	}
+
+	void X64Assembler::CALL_reg(Register r) {
+		rex(false, 0, 0, r);
+		emit8(0xFF);
+		modrmReg(2, r);
+	}
+
+	void X64Assembler::RET() {
+		emit8(0xC3);
+	}
+
+	void X64Assembler::ALIGN(int alignment) {
+		while((mPos & (alignment - 1)) != 0)
+			emit8(0x90);
+	}
+
+} // namespace MoSync
+
+#endif	//USE_X64_RECOMPILER
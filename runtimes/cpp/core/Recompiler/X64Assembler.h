@@ -0,0 +1,133 @@
+/* Copyright 2013 David Axmark
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _X64_ASSEMBLER_H_
+#define _X64_ASSEMBLER_H_
+
+#include <helpers/types.h>
+
+namespace MoSync {
+
+	// Minimal x86-64 code emitter for the X64Recompiler.
+	// Every instruction is emitted with a fixed size that only depends on the
+	// registers used, never on immediate or displacement values, so that the
+	// sizing pass and the final pass produce identical layouts.
+	// If mStart is NULL, instructions are only measured.
+	class X64Assembler {
+	public:
+		typedef enum {
+			RAX = 0, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+			R8, R9, R10, R11, R12, R13, R14, R15
+		} Register;
+
+		// Jcc condition codes
+		typedef enum {
+			O = 0x0,
+			NO = 0x1,
+			B = 0x2,	// unsigned <
+			AE = 0x3,	// unsigned >=
+			E = 0x4,
+			NE = 0x5,
+			BE = 0x6,	// unsigned <=
+			A = 0x7,	// unsigned >
+			S = 0x8,
+			NS = 0x9,
+			L = 0xC,	// signed <
+			GE = 0xD,
+			LE = 0xE,
+			G = 0xF
+		} ConditionCode;
+
+		// /digit of the 0x81 group, and (op<<3)|1 for the register form
+		typedef enum {
+			ADD_op = 0,
+			OR_op = 1,
+			AND_op = 4,
+			SUB_op = 5,
+			XOR_op = 6,
+			CMP_op = 7
+		} AluOperator;
+
+		// /digit of the 0xC1 and 0xD3 groups
+		typedef enum {
+			SHL_op = 4,
+			SHR_op = 5,
+			SAR_op = 7
+		} ShiftOperator;
+
+		byte* mStart;
+		int mPos;	// bytes emitted
+
+		X64Assembler();
+
+		void reset(byte* start);
+		byte* current() const { return mStart + mPos; }
+
+		// 32-bit register operations
+		void MOV(Register dst, Register src);
+		void MOV_imm32(Register dst, int imm32);
+		void MOV_load(Register dst, Register base, int disp32);	// dst = [base+disp32]
+		void MOV_store(Register base, int disp32, Register src);	// [base+disp32] = src
+		void MOV_store_imm32(Register base, int disp32, int imm32);
+		void ALU(AluOperator op, Register dst, Register src);
+		void ALU_imm32(AluOperator op, Register dst, int imm32);
+		void IMUL(Register dst, Register src);
+		void SHIFT_CL(ShiftOperator op, Register dst);
+		void SHIFT_imm8(ShiftOperator op, Register dst, int imm8);
+		void NEG(Register dst);
+		void NOT(Register dst);
+		void TEST_rr(Register a, Register b);
+		void MOVSX8(Register dst, Register src);
+		void MOVSX16(Register dst, Register src);
+
+		// data memory at [base+index]; size is 1, 2 or 4. loads sign-extend.
+		void LOAD_indexed(Register dst, Register base, Register index, int size);
+		void STORE_indexed(Register base, Register index, Register src, int size);
+		// dst = [base+index*4+disp32]
+		void LOAD_scaled(Register dst, Register base, Register index, int disp32);
+
+		// 64-bit operations
+		void MOV64(Register dst, Register src);
+		void MOV64_imm64(Register dst, const void* imm64);
+		void ADD64_imm32(Register dst, int imm32);
+		void SUB64_imm32(Register dst, int imm32);
+		void PUSH(Register r);
+		void POP(Register r);
+
+		// control flow. targets are absolute; rel32 is always used.
+		void JMP(const byte* target);
+		void JCC(ConditionCode cc, const byte* target);
+		void JMP_table(Register base, Register index);	// jmp [base+index*8]
+		void JMP_reg(Register r);
+		void CALL_reg(Register r);
+		void RET();
+
+		// pads with NOPs up to the given power-of-two alignment.
+		void ALIGN(int alignment);
+
+	private:
+		void emit8(int b);
+		void emit32(int i);
+		void emit64(const void* p);
+		void rex(bool w, int reg, int index, int base, bool force=false);
+		void modrmReg(int reg, int rm);
+		void modrmDisp32(int reg, Register base, int disp32);
+		void modrmSib(int reg, Register base, Register index, int scale, int disp32);
+		void rel32(const byte* target);
+	};
+
+} // namespace MoSync
+
+#endif	//_X64_ASSEMBLER_H_
@@ -0,0 +1,738 @@
+/* Copyright 2013 David Axmark
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "X64Recompiler.h"
+
+#define CACHE_LINE_SIZE 64 // bytes
+
+#ifdef USE_X64_RECOMPILER
+
+#include <helpers/helpers.h>
+#include <base/base_errors.h>
+#ifdef INLINE_FLOAT_SYSCALLS
+#include "../FloatIntrinsics.h"
+#endif
+using namespace MoSyncError;
+
+using namespace Core;
+
+#include <stdint.h>
+#include <sys/mman.h>
+
+#define SETUP_DEFAULT_VISITOR_ELEM(inst) defaultVisitors[_##inst] = &X64Recompiler::visit_##inst;
+
+#define REG_OFS(r) ((r)*(int)sizeof(int))
+
+#define FUNC_CAST(func) ((const void*)(func))
+
+namespace MoSync {
+
+	X64Recompiler::X64Recompiler() :
+		Recompiler<X64Recompiler>(2) {
+		mPipeToX64InstMap = NULL;
+		mMapSize = 0;
+		mCode = NULL;
+		mCodeSize = 0;
+		mInstructions = NULL;
+		INSTRUCTIONS(SETUP_DEFAULT_VISITOR_ELEM);
+		defaultVisitors[_NUL] = &X64Recompiler::visitIllegal;
+	}
+
+	void* X64Recompiler::allocateCodeMemory(int size) {
+		void* mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if(mem == MAP_FAILED) {
+			LOG("X64Recompiler: mmap(%i) failed\n", size);
+			BIG_PHAT_ERROR(ERR_INTERNAL);
+		}
+		return mem;
+	}
+
+	void X64Recompiler::freeCodeMemory(void* addr, int size) {
+		munmap(addr, size);
+	}
+
+	// the buffer is written as RW and only made executable once it's complete.
+	void X64Recompiler::protectMemory(void* addr, int size) {
+		if(mprotect(addr, size, PROT_READ | PROT_EXEC) != 0) {
+			LOG("X64Recompiler: mprotect failed\n");
+			BIG_PHAT_ERROR(ERR_INTERNAL);
+		}
+	}
+
+	//***************************************
+	// Helpers called from generated code
+	//***************************************
+
+	void X64Recompiler::divu(int* regs, int rd, int rs) {
+		uint32_t denom = (uint32_t)regs[rs];
+		if(denom==0) BIG_PHAT_ERROR(ERR_DIVISION_BY_ZERO);
+		*(uint32_t*)&regs[rd] /= denom;
+	}
+
+	void X64Recompiler::divui(int* regs, int rd, int imm32) {
+		uint32_t denom = (uint32_t)imm32;
+		if(denom==0) BIG_PHAT_ERROR(ERR_DIVISION_BY_ZERO);
+		*(uint32_t*)&regs[rd] /= denom;
+	}
+
+	void X64Recompiler::div(int* regs, int rd, int rs) {
+		if(regs[rs]==0) BIG_PHAT_ERROR(ERR_DIVISION_BY_ZERO);
+		regs[rd] /= regs[rs];
+	}
+
+	void X64Recompiler::divi(int* regs, int rd, int imm32) {
+		if(imm32==0) BIG_PHAT_ERROR(ERR_DIVISION_BY_ZERO);
+		regs[rd] /= imm32;
+	}
+
+	void X64Recompiler::invokeSyscall(VMCore* core, int id) {
+		core->invokeSysCall(id);
+	}
+
+#ifdef INLINE_FLOAT_SYSCALLS
+	void X64Recompiler::floatIntrinsic(VMCore* core, int id) {
+		if(!runFloatIntrinsic(id, core->regs))
+			core->invokeSysCall(id);
+	}
+#endif
+
+	void GCCATTRIB(noreturn) X64Recompiler::badJump() {
+		LOG("X64Recompiler: jump to an address that is not an instruction\n");
+		BIG_PHAT_ERROR(ERR_IMEM_OOB);
+	}
+
+	void GCCATTRIB(noreturn) X64Recompiler::illegalInstruction() {
+		BIG_PHAT_ERROR(ERR_ILLEGAL_INSTRUCTION);
+	}
+
+#ifdef LOG_STATE_CHANGE
+	void X64Recompiler::logStateChange(VMCore* core, int ip) {
+		core->logStateChange(ip);
+	}
+#endif
+
+	//***************************************
+	// Code generation helpers
+	//***************************************
+
+	// entry: called as int entry(byte* nativeAddress). sets up the environment
+	// registers and jumps into the translated code.
+	// exit: jumped to with the next MoSync ip in EAX.
+	// bad jump: every unmapped slot of mPipeToX64InstMap points here.
+	void X64Recompiler::generateStubs() {
+		mEntryStub = assm.mPos;
+		assm.PUSH(XA::RBP);
+		assm.PUSH(XA::RBX);
+		assm.PUSH(XA::R12);
+		assm.PUSH(XA::R13);
+		assm.PUSH(XA::R14);
+		assm.PUSH(XA::R15);
+		assm.SUB64_imm32(XA::RSP, 8);	// keep calls 16-byte aligned
+		assm.MOV64_imm64(XA::RBX, mEnvironment.regs);
+		assm.MOV64_imm64(XA::R12, mEnvironment.mem_ds);
+		assm.MOV_imm32(XA::R13, mEnvironment.dataMask);
+		assm.MOV64_imm64(XA::R14, mPipeToX64InstMap);
+		assm.JMP_reg(XA::RDI);
+
+		assm.ALIGN(16);
+		mExitStub = assm.mPos;
+		assm.ADD64_imm32(XA::RSP, 8);
+		assm.POP(XA::R15);
+		assm.POP(XA::R14);
+		assm.POP(XA::R13);
+		assm.POP(XA::R12);
+		assm.POP(XA::RBX);
+		assm.POP(XA::RBP);
+		assm.RET();
+
+		assm.ALIGN(16);
+		mBadJumpStub = assm.mPos;
+		assm.MOV64_imm64(XA::RAX, FUNC_CAST(&X64Recompiler::badJump));
+		assm.CALL_reg(XA::RAX);
+
+		assm.ALIGN(CACHE_LINE_SIZE);
+	}
+
+	void X64Recompiler::emitHelperCall(const void* func, const void* arg0, int arg1, int arg2) {
+		assm.MOV64_imm64(XA::RDI, arg0);
+		assm.MOV_imm32(XA::RSI, arg1);
+		assm.MOV_imm32(XA::RDX, arg2);
+		assm.MOV64_imm64(XA::RAX, func);
+		assm.CALL_reg(XA::RAX);
+	}
+
+	// RAX = (REG(base) + imm32) & dataMask & ~(size-1), like RECOMP_MEMREF.
+	void X64Recompiler::emitAddress(int base, int imm32, int size) {
+		assm.MOV_load(XA::RAX, XA::RBX, REG_OFS(base));
+		if(imm32 != 0)
+			assm.ALU_imm32(XA::ADD_op, XA::RAX, imm32);
+		assm.ALU(XA::AND_op, XA::RAX, XA::R13);
+		if(size > 1)
+			assm.ALU_imm32(XA::AND_op, XA::RAX, ~(size - 1));
+	}
+
+	void X64Recompiler::emitLoad(int rd, int rs, int imm32, int size) {
+		emitAddress(rs, imm32, size);
+		assm.LOAD_indexed(XA::RCX, XA::R12, XA::RAX, size);
+		assm.MOV_store(XA::RBX, REG_OFS(rd), XA::RCX);
+	}
+
+	void X64Recompiler::emitStore(int rd, int rs, int imm32, int size) {
+		emitAddress(rd, imm32, size);
+		assm.MOV_load(XA::RCX, XA::RBX, REG_OFS(rs));
+		assm.STORE_indexed(XA::R12, XA::RAX, XA::RCX, size);
+	}
+
+	void X64Recompiler::emitArith(XA::AluOperator op, int rd, int rs) {
+		assm.MOV_load(XA::RAX, XA::RBX, REG_OFS(rd));
+		assm.MOV_load(XA::RCX, XA::RBX, REG_OFS(rs));
+		assm.ALU(op, XA::RAX, XA::RCX);
+		assm.MOV_store(XA::RBX, REG_OFS(rd), XA::RAX);
+	}
+
+	void X64Recompiler::emitArithImm(XA::AluOperator op, int rd, int imm32) {
+		assm.MOV_load(XA::RAX, XA::RBX, REG_OFS(rd));
+		assm.ALU_imm32(op, XA::RAX, imm32);
+		assm.MOV_store(XA::RBX, REG_OFS(rd), XA::RAX);
+	}
+
+	// x86 masks the shift count to 5 bits, which is also what the interpreter
+	// ends up doing on this architecture.
+	void X64Recompiler::emitShift(XA::ShiftOperator op, int rd, int rs) {
+		assm.MOV_load(XA::RAX, XA::RBX, REG_OFS(rd));
+		assm.MOV_load(XA::RCX, XA::RBX, REG_OFS(rs));
+		assm.SHIFT_CL(op, XA::RAX);
+		assm.MOV_store(XA::RBX, REG_OFS(rd), XA::RAX);
+	}
+
+	void X64Recompiler::emitShiftImm(XA::ShiftOperator op, int rd, int imm32) {
+		assm.MOV_load(XA::RAX, XA::RBX, REG_OFS(rd));
+		assm.SHIFT_imm8(op, XA::RAX, imm32 & 31);
+		assm.MOV_store(XA::RBX, REG_OFS(rd), XA::RAX);
+	}
+
+	void X64Recompiler::emitJump(int address) {
+		assm.JMP(mPipeToX64InstMap[address & mEnvironment.codeMask]);
+	}
+
+	// jumps to the MoSync address held in r. r is clobbered.
+	void X64Recompiler::emitJumpReg(XA::Register r) {
+		assm.ALU_imm32(XA::AND_op, r, mEnvironment.codeMask);
+		assm.JMP_table(XA::R14, r);
+	}
+
+	void X64Recompiler::emitCondJump(XA::ConditionCode cc, int rd, int rs, int address) {
+		assm.MOV_load(XA::RAX, XA::RBX, REG_OFS(rd));
+		assm.MOV_load(XA::RCX, XA::RBX, REG_OFS(rs));
+		assm.ALU(XA::CMP_op, XA::RAX, XA::RCX);
+		assm.JCC(cc, mPipeToX64InstMap[address & mEnvironment.codeMask]);
+	}
+
+	void X64Recompiler::emitCall(int address) {
+		int returnAddr = mInstructions[0].ip + mInstructions[0].length;
+		assm.MOV_store_imm32(XA::RBX, REG_OFS(REG_rt), returnAddr);
+		emitJump(address);
+	}
+
+	//***************************************
+	// Visitors
+	//***************************************
+
+	void X64Recompiler::visitIllegal() {
+		LOGC("illegal\n");
+		assm.MOV64_imm64(XA::RAX, FUNC_CAST(&X64Recompiler::illegalInstruction));
+		assm.CALL_reg(XA::RAX);
+	}
+
+	void X64Recompiler::visit_PUSH() {
+		LOGC("PUSH\n");
+		byte rd = mInstructions[0].rd;
+		int imm32 = mInstructions[0].imm;
+
+		assm.MOV_load(XA::RAX, XA::RBX, REG_OFS(REG_sp));
+		for(int i = rd; i < rd+imm32; i++) {
+			assm.ALU_imm32(XA::SUB_op, XA::RAX, 4);
+			assm.MOV(XA::RDX, XA::RAX);
+			assm.ALU(XA::AND_op, XA::RDX, XA::R13);
+			assm.ALU_imm32(XA::AND_op, XA::RDX, ~3);
+			assm.MOV_load(XA::RCX, XA::RBX, REG_OFS(i));
+			assm.STORE_indexed(XA::R12, XA::RDX, XA::RCX, 4);
+		}
+		assm.MOV_store(XA::RBX, REG_OFS(REG_sp), XA::RAX);
+	}
+
+	void X64Recompiler::visit_POP() {
+		LOGC("POP\n");
+		byte rd = mInstructions[0].rd;
+		int imm32 = mInstructions[0].imm;
+
+		assm.MOV_load(XA::RAX, XA::RBX, REG_OFS(REG_sp));
+		for(int i = rd; i > rd-imm32; i--) {
+			assm.MOV(XA::RDX, XA::RAX);
+			assm.ALU(XA::AND_op, XA::RDX, XA::R13);
+			assm.ALU_imm32(XA::AND_op, XA::RDX, ~3);
+			assm.LOAD_indexed(XA::RCX, XA::R12, XA::RDX, 4);
+			assm.MOV_store(XA::RBX, REG_OFS(i), XA::RCX);
+			assm.ALU_imm32(XA::ADD_op, XA::RAX, 4);
+		}
+		assm.MOV_store(XA::RBX, REG_OFS(REG_sp), XA::RAX);
+	}
+
+	void X64Recompiler::visit_CALL() {
+		LOGC("CALL\n");
+		byte rd = mInstructions[0].rd;
+
+		// rt is written before rd is read, as in the interpreter.
+		int returnAddr = mInstructions[0].ip + mInstructions[0].length;
+		assm.MOV_store_imm32(XA::RBX, REG_OFS(REG_rt), returnAddr);
+		assm.MOV_load(XA::RAX, XA::RBX, REG_OFS(rd));
+		emitJumpReg(XA::RAX);
+	}
+
+	void X64Recompiler::visit_CALLI() {
+		LOGC("CALLI\n");
+		emitCall(mInstructions[0].imm);
+	}
+
+	void X64Recompiler::visit_LDB() {
+		LOGC("LDB\n");
+		emitLoad(mInstructions[0].rd, mInstructions[0].rs, mInstructions[0].imm, sizeof(char));
+	}
+
+	void X64Recompiler::visit_STB() {
+		LOGC("STB\n");
+		emitStore(mInstructions[0].rd, mInstructions[0].rs, mInstructions[0].imm, sizeof(char));
+	}
+
+	void X64Recompiler::visit_LDH() {
+		LOGC("LDH\n");
+		emitLoad(mInstructions[0].rd, mInstructions[0].rs, mInstructions[0].imm, sizeof(short));
+	}
+
+	void X64Recompiler::visit_STH() {
+		LOGC("STH\n");
+		emitStore(mInstructions[0].rd, mInstructions[0].rs, mInstructions[0].imm, sizeof(short));
+	}
+
+	void X64Recompiler::visit_LDW() {
+		LOGC("LDW\n");
+		emitLoad(mInstructions[0].rd, mInstructions[0].rs, mInstructions[0].imm, sizeof(int));
+	}
+
+	void X64Recompiler::visit_STW() {
+		LOGC("STW\n");
+		emitStore(mInstructions[0].rd, mInstructions[0].rs, mInstructions[0].imm, sizeof(int));
+	}
+
+	void X64Recompiler::visit_LDI() {
+		LOGC("LDI\n");
+		assm.MOV_store_imm32(XA::RBX, REG_OFS(mInstructions[0].rd), mInstructions[0].imm);
+	}
+
+	void X64Recompiler::visit_LDR() {
+		LOGC("LDR\n");
+		assm.MOV_load(XA::RAX, XA::RBX, REG_OFS(mInstructions[0].rs));
+		assm.MOV_store(XA::RBX, REG_OFS(mInstructions[0].rd), XA::RAX);
+	}
+
+	void X64Recompiler::visit_ADD() {
+		LOGC("ADD\n");
+		emitArith(XA::ADD_op, mInstructions[0].rd, mInstructions[0].rs);
+	}
+
+	void X64Recompiler::visit_ADDI() {
+		LOGC("ADDI\n");
+		emitArithImm(XA::ADD_op, mInstructions[0].rd, mInstructions[0].imm);
+	}
+
+	void X64Recompiler::visit_MUL() {
+		LOGC("MUL\n");
+		byte rd = mInstructions[0].rd;
+		byte rs = mInstructions[0].rs;
+		assm.MOV_load(XA::RAX, XA::RBX, REG_OFS(rd));
+		assm.MOV_load(XA::RCX, XA::RBX, REG_OFS(rs));
+		assm.IMUL(XA::RAX, XA::RCX);
+		assm.MOV_store(XA::RBX, REG_OFS(rd), XA::RAX);
+	}
+
+	void X64Recompiler::visit_MULI() {
+		LOGC("MULI\n");
+		byte rd = mInstructions[0].rd;
+		assm.MOV_load(XA::RAX, XA::RBX, REG_OFS(rd));
+		assm.MOV_imm32(XA::RCX, mInstructions[0].imm);
+		assm.IMUL(XA::RAX, XA::RCX);
+		assm.MOV_store(XA::RBX, REG_OFS(rd), XA::RAX);
+	}
+
+	void X64Recompiler::visit_SUB() {
+		LOGC("SUB\n");
+		emitArith(XA::SUB_op, mInstructions[0].rd, mInstructions[0].rs);
+	}
+
+	void X64Recompiler::visit_SUBI() {
+		LOGC("SUBI\n");
+		emitArithImm(XA::SUB_op, mInstructions[0].rd, mInstructions[0].imm);
+	}
+
+	void X64Recompiler::visit_AND() {
+		LOGC("AND\n");
+		emitArith(XA::AND_op, mInstructions[0].rd, mInstructions[0].rs);
+	}
+
+	void X64Recompiler::visit_ANDI() {
+		LOGC("ANDI\n");
+		emitArithImm(XA::AND_op, mInstructions[0].rd, mInstructions[0].imm);
+	}
+
+	void X64Recompiler::visit_OR() {
+		LOGC("OR\n");
+		emitArith(XA::OR_op, mInstructions[0].rd, mInstructions[0].rs);
+	}
+
+	void X64Recompiler::visit_ORI() {
+		LOGC("ORI\n");
+		emitArithImm(XA::OR_op, mInstructions[0].rd, mInstructions[0].imm);
+	}
+
+	void X64Recompiler::visit_XOR() {
+		LOGC("XOR\n");
+		emitArith(XA::XOR_op, mInstructions[0].rd, mInstructions[0].rs);
+	}
+
+	void X64Recompiler::visit_XORI() {
+		LOGC("XORI\n");
+		emitArithImm(XA::XOR_op, mInstructions[0].rd, mInstructions[0].imm);
+	}
+
+	void X64Recompiler::visit_DIVU() {
+		LOGC("DIVU\n");
+		emitHelperCall(FUNC_CAST(&X64Recompiler::divu), mEnvironment.regs,
+			mInstructions[0].rd, mInstructions[0].rs);
+	}
+
+	void X64Recompiler::visit_DIVUI() {
+		LOGC("DIVUI\n");
+		emitHelperCall(FUNC_CAST(&X64Recompiler::divui), mEnvironment.regs,
+			mInstructions[0].rd, mInstructions[0].imm);
+	}
+
+	void X64Recompiler::visit_DIV() {
+		LOGC("DIV\n");
+		emitHelperCall(FUNC_CAST(&X64Recompiler::div), mEnvironment.regs,
+			mInstructions[0].rd, mInstructions[0].rs);
+	}
+
+	void X64Recompiler::visit_DIVI() {
+		LOGC("DIVI\n");
+		emitHelperCall(FUNC_CAST(&X64Recompiler::divi), mEnvironment.regs,
+			mInstructions[0].rd, mInstructions[0].imm);
+	}
+
+	void X64Recompiler::visit_SLL() {
+		LOGC("SLL\n");
+		emitShift(XA::SHL_op, mInstructions[0].rd, mInstructions[0].rs);
+	}
+
+	void X64Recompiler::visit_SLLI() {
+		LOGC("SLLI\n");
+		emitShiftImm(XA::SHL_op, mInstructions[0].rd, mInstructions[0].imm);
+	}
+
+	void X64Recompiler::visit_SRA() {
+		LOGC("SRA\n");
+		emitShift(XA::SAR_op, mInstructions[0].rd, mInstructions[0].rs);
+	}
+
+	void X64Recompiler::visit_SRAI() {
+		LOGC("SRAI\n");
+		emitShiftImm(XA::SAR_op, mInstructions[0].rd, mInstructions[0].imm);
+	}
+
+	void X64Recompiler::visit_SRL() {
+		LOGC("SRL\n");
+		emitShift(XA::SHR_op, mInstructions[0].rd, mInstructions[0].rs);
+	}
+
+	void X64Recompiler::visit_SRLI() {
+		LOGC("SRLI\n");
+		emitShiftImm(XA::SHR_op, mInstructions[0].rd, mInstructions[0].imm);
+	}
+
+	void X64Recompiler::visit_NOT() {
+		LOGC("NOT\n");
+		assm.MOV_load(XA::RAX, XA::RBX, REG_OFS(mInstructions[0].rs));
+		assm.NOT(XA::RAX);
+		assm.MOV_store(XA::RBX, REG_OFS(mInstructions[0].rd), XA::RAX);
+	}
+
+	void X64Recompiler::visit_NEG() {
+		LOGC("NEG\n");
+		assm.MOV_load(XA::RAX, XA::RBX, REG_OFS(mInstructions[0].rs));
+		assm.NEG(XA::RAX);
+		assm.MOV_store(XA::RBX, REG_OFS(mInstructions[0].rd), XA::RAX);
+	}
+
+	void X64Recompiler::visit_RET() {
+		LOGC("RET\n");
+		assm.MOV_load(XA::RAX, XA::RBX, REG_OFS(REG_rt));
+		emitJumpReg(XA::RAX);
+	}
+
+	void X64Recompiler::visit_JC_EQ() {
+		LOGC("JC_EQ\n");
+		emitCondJump(XA::E, mInstructions[0].rd, mInstructions[0].rs, mInstructions[0].imm);
+	}
+
+	void X64Recompiler::visit_JC_NE() {
+		LOGC("JC_NE\n");
+		emitCondJump(XA::NE, mInstructions[0].rd, mInstructions[0].rs, mInstructions[0].imm);
+	}
+
+	void X64Recompiler::visit_JC_GE() {
+		LOGC("JC_GE\n");
+		emitCondJump(XA::GE, mInstructions[0].rd, mInstructions[0].rs, mInstructions[0].imm);
+	}
+
+	void X64Recompiler::visit_JC_GEU() {
+		LOGC("JC_GEU\n");
+		emitCondJump(XA::AE, mInstructions[0].rd, mInstructions[0].rs, mInstructions[0].imm);
+	}
+
+	void X64Recompiler::visit_JC_GT() {
+		LOGC("JC_GT\n");
+		emitCondJump(XA::G, mInstructions[0].rd, mInstructions[0].rs, mInstructions[0].imm);
+	}
+
+	void X64Recompiler::visit_JC_GTU() {
+		LOGC("JC_GTU\n");
+		emitCondJump(XA::A, mInstructions[0].rd, mInstructions[0].rs, mInstructions[0].imm);
+	}
+
+	void X64Recompiler::visit_JC_LE() {
+		LOGC("JC_LE\n");
+		emitCondJump(XA::LE, mInstructions[0].rd, mInstructions[0].rs, mInstructions[0].imm);
+	}
+
+	void X64Recompiler::visit_JC_LEU() {
+		LOGC("JC_LEU\n");
+		emitCondJump(XA::BE, mInstructions[0].rd, mInstructions[0].rs, mInstructions[0].imm);
+	}
+
+	void X64Recompiler::visit_JC_LT() {
+		LOGC("JC_LT\n");
+		emitCondJump(XA::L, mInstructions[0].rd, mInstructions[0].rs, mInstructions[0].imm);
+	}
+
+	void X64Recompiler::visit_JC_LTU() {
+		LOGC("JC_LTU\n");
+		emitCondJump(XA::B, mInstructions[0].rd, mInstructions[0].rs, mInstructions[0].imm);
+	}
+
+	void X64Recompiler::visit_JPI() {
+		LOGC("JPI\n");
+		emitJump(mInstructions[0].imm);
+	}
+
+	void X64Recompiler::visit_JPR() {
+		LOGC("JPR\n");
+		assm.MOV_load(XA::RAX, XA::RBX, REG_OFS(mInstructions[0].rd));
+		emitJumpReg(XA::RAX);
+	}
+
+	void X64Recompiler::visit_XB() {
+		LOGC("XB\n");
+		assm.MOV_load(XA::RAX, XA::RBX, REG_OFS(mInstructions[0].rs));
+		assm.MOVSX8(XA::RAX, XA::RAX);
+		assm.MOV_store(XA::RBX, REG_OFS(mInstructions[0].rd), XA::RAX);
+	}
+
+	void X64Recompiler::visit_XH() {
+		LOGC("XH\n");
+		assm.MOV_load(XA::RAX, XA::RBX, REG_OFS(mInstructions[0].rs));
+		assm.MOVSX16(XA::RAX, XA::RAX);
+		assm.MOV_store(XA::RBX, REG_OFS(mInstructions[0].rd), XA::RAX);
+	}
+
+	void X64Recompiler::visit_SYSCALL() {
+		LOGC("SYSCALL\n");
+		int syscallNumber = mInstructions[0].imm;
+		int nextIp = mInstructions[0].ip + mInstructions[0].length;
+
+#ifdef INLINE_FLOAT_SYSCALLS
+		// these never yield.
+		if(isFloatIntrinsic(syscallNumber)) {
+			emitHelperCall(FUNC_CAST(&X64Recompiler::floatIntrinsic), mEnvironment.core,
+				syscallNumber, 0);
+			return;
+		}
+#endif
+
+		emitHelperCall(FUNC_CAST(&X64Recompiler::invokeSyscall), mEnvironment.core,
+			syscallNumber, 0);
+
+		// if(VM_Yield) return nextIp;
+		assm.MOV64_imm64(XA::RCX, mEnvironment.VM_Yield);
+		assm.MOV_load(XA::RCX, XA::RCX, 0);
+		assm.MOV_imm32(XA::RAX, nextIp);
+		assm.TEST_rr(XA::RCX, XA::RCX);
+		assm.JCC(XA::NE, assm.mStart + mExitStub);
+	}
+
+	void X64Recompiler::visit_CASE() {
+		LOGC("CASE\n");
+		byte rd = mInstructions[0].rd;
+		uint imm32 = mInstructions[0].imm;
+
+		imm32 <<= 2;
+		uint CaseStart = RECOMP_MEM(int, imm32, READ);
+		uint CaseLength = RECOMP_MEM(int, imm32 + 1*sizeof(int), READ);
+		int tableAddress = imm32 + 3*sizeof(int);
+		int defaultCaseAddress = RECOMP_MEM(int, imm32 + 2*sizeof(int), READ);
+
+		// index = RD - CaseStart; if(index > CaseLength) goto default;
+		assm.MOV_load(XA::RAX, XA::RBX, REG_OFS(rd));
+		assm.ALU_imm32(XA::SUB_op, XA::RAX, CaseStart);
+		assm.ALU_imm32(XA::CMP_op, XA::RAX, CaseLength);
+		assm.JCC(XA::A, mPipeToX64InstMap[defaultCaseAddress & mEnvironment.codeMask]);
+
+		// the table itself is read at run time, like the interpreter does.
+		assm.SHIFT_imm8(XA::SHL_op, XA::RAX, 2);
+		assm.ALU_imm32(XA::ADD_op, XA::RAX, tableAddress);
+		assm.ALU(XA::AND_op, XA::RAX, XA::R13);
+		assm.ALU_imm32(XA::AND_op, XA::RAX, ~3);
+		assm.LOAD_indexed(XA::RAX, XA::R12, XA::RAX, 4);
+		emitJumpReg(XA::RAX);
+	}
+
+	void X64Recompiler::visit_FAR() {
+		LOGC("FAR\n");
+		int op = mInstructions[0].op2;
+		byte rd = mInstructions[0].rd;
+		byte rs = mInstructions[0].rs;
+		int imm32 = mInstructions[0].imm;
+
+		switch(op) {
+			case _CALLI: emitCall(imm32); break;
+
+			case _JC_EQ:	emitCondJump(XA::E, rd, rs, imm32); break;
+			case _JC_NE:	emitCondJump(XA::NE, rd, rs, imm32); break;
+			case _JC_GE:	emitCondJump(XA::GE, rd, rs, imm32); break;
+			case _JC_GT:	emitCondJump(XA::G, rd, rs, imm32); break;
+			case _JC_LE:	emitCondJump(XA::LE, rd, rs, imm32); break;
+			case _JC_LT:	emitCondJump(XA::L, rd, rs, imm32); break;
+			case _JC_LTU:	emitCondJump(XA::B, rd, rs, imm32); break;
+			case _JC_GEU:	emitCondJump(XA::AE, rd, rs, imm32); break;
+			case _JC_GTU:	emitCondJump(XA::A, rd, rs, imm32); break;
+			case _JC_LEU:	emitCondJump(XA::BE, rd, rs, imm32); break;
+
+			case _JPI:		emitJump(imm32); break;
+
+			default: visitIllegal(); break;
+		}
+	}
+
+	//***************************************
+	// Passes
+	//***************************************
+
+	void X64Recompiler::beginPass() {
+		if(mPass==1) {
+			// measure only
+			assm.reset(NULL);
+			generateStubs();
+			for(int i = 0; i < mMapSize; i++)
+				mPipeToX64InstMap[i] = (byte*)(intptr_t)mBadJumpStub;
+		} else {
+			mCode = (byte*)allocateCodeMemory(mCodeSize);
+			for(int i = 0; i < mMapSize; i++)
+				mPipeToX64InstMap[i] = mCode + (intptr_t)mPipeToX64InstMap[i];
+			assm.reset(mCode);
+			generateStubs();
+		}
+	}
+
+	void X64Recompiler::endPass() {
+		// running off the end of the code segment is a bad jump too.
+		assm.JMP(assm.mStart + mBadJumpStub);
+
+		if(mPass==1) {
+			mCodeSize = assm.mPos;
+			LOG("X64Recompiler: %i bytes of code\n", mCodeSize);
+		} else {
+			DEBUG_ASSERT(assm.mPos == mCodeSize);
+			protectMemory(mCode, mCodeSize);
+			// beginFunction() is called before beginPass(), so make sure a
+			// later recompile can't write into the protected buffer.
+			assm.reset(NULL);
+		}
+	}
+
+	void X64Recompiler::beginInstruction(int ip) {
+		if(mPass==1) {
+			mPipeToX64InstMap[ip] = (byte*)(intptr_t)assm.mPos;
+		} else {
+			DEBUG_ASSERT(mPipeToX64InstMap[ip] == assm.current());
+		}
+
+#ifdef LOG_STATE_CHANGE
+		emitHelperCall(FUNC_CAST(&X64Recompiler::logStateChange), mEnvironment.core, ip, 0);
+#endif
+	}
+
+	void X64Recompiler::beginFunction(Function *f) {
+		assm.ALIGN(16);
+	}
+
+	void X64Recompiler::endFunction(Function *f) {
+	}
+
+	int X64Recompiler::run(int ip) {
+		if(mStopped) {
+			LOG("Stopped, Recompiling...\n");
+			Recompiler<X64Recompiler>::recompile();
+			LOG("Finished recompiling.\n");
+			mStopped = false;
+		}
+		byte* target = mPipeToX64InstMap[ip & mEnvironment.codeMask];
+		return ((int (*)(byte*))(mCode + mEntryStub))(target);
+	}
+
+	void X64Recompiler::init(VMCore *core, int *VM_Yield) {
+		Recompiler<X64Recompiler>::init(core, VM_Yield);
+		LOG("initRecompilerVariables\n");
+		mCode = NULL;
+		mCodeSize = 0;
+		mStopped = true;
+		mMapSize = mEnvironment.codeMask + 1;
+		mPipeToX64InstMap = new byte*[mMapSize];
+		mInstructions = new Instruction[mInstructionsToFetch];
+	}
+
+	void X64Recompiler::close() {
+		LOG("close\n");
+		Recompiler<X64Recompiler>::close();
+		mInstructions = NULL;
+		if(mCode) {
+			freeCodeMemory(mCode, mCodeSize);
+			mCode = NULL;
+		}
+		delete[] mPipeToX64InstMap;
+		mPipeToX64InstMap = NULL;
+	}
+
+} // namespace MoSync
+
+#endif	//USE_X64_RECOMPILER
@@ -0,0 +1,114 @@
+/* Copyright 2013 David Axmark
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef _X64_RECOMPILER_H_
+#define _X64_RECOMPILER_H_
+
+#include "Recompiler.h"
+
+#ifdef USE_X64_RECOMPILER
+
+#if !defined(__x86_64__) || defined(_WIN32)
+#error USE_X64_RECOMPILER requires an x86-64 System V target
+#endif
+
+#include "X64Assembler.h"
+typedef MoSync::X64Assembler XA;
+
+namespace MoSync {
+
+	// Translates the whole code segment to x86-64 in two passes.
+	// Pass 1 only measures, filling in mPipeToX64InstMap with offsets.
+	// Pass 2 allocates the code buffer and emits the same code for real.
+	//
+	// Register usage inside generated code:
+	//  RBX  = mEnvironment.regs
+	//  R12  = mEnvironment.mem_ds
+	//  R13d = mEnvironment.dataMask
+	//  R14  = mPipeToX64InstMap
+	//  RAX, RCX, RDX, RSI, RDI are scratch.
+	// MoSync registers are kept in memory; nothing is cached across instructions.
+	class X64Recompiler : public Recompiler <X64Recompiler> {
+	public:
+		friend class Recompiler<X64Recompiler>;
+
+		X64Recompiler();
+
+		// ip is a MoSync code address. returns the address to resume at.
+		int run(int ip);
+		void init(Core::VMCore *core, int *VM_Yield);
+		void close();
+
+	protected:
+		void beginInstruction(int ip);
+
+		void beginPass();
+		void endPass();
+		void beginFunction(Function *f);
+		void endFunction(Function *f);
+
+		INSTRUCTIONS(DECLARE_DEFAULT_VISITOR_ELEM)
+		void visitIllegal();
+
+		static void divu(int* regs, int rd, int rs);
+		static void divui(int* regs, int rd, int imm32);
+		static void div(int* regs, int rd, int rs);
+		static void divi(int* regs, int rd, int imm32);
+		static void invokeSyscall(Core::VMCore* core, int id);
+#ifdef INLINE_FLOAT_SYSCALLS
+		static void floatIntrinsic(Core::VMCore* core, int id);
+#endif
+		static void badJump();
+		static void illegalInstruction();
+#ifdef LOG_STATE_CHANGE
+		static void logStateChange(Core::VMCore* core, int ip);
+#endif
+
+		void generateStubs();
+		void emitHelperCall(const void* func, const void* arg0, int arg1, int arg2);
+		void emitAddress(int base, int imm32, int size);
+		void emitLoad(int rd, int rs, int imm32, int size);
+		void emitStore(int rd, int rs, int imm32, int size);
+		void emitArith(XA::AluOperator op, int rd, int rs);
+		void emitArithImm(XA::AluOperator op, int rd, int imm32);
+		void emitShift(XA::ShiftOperator op, int rd, int rs);
+		void emitShiftImm(XA::ShiftOperator op, int rd, int imm32);
+		void emitJump(int address);
+		void emitJumpReg(XA::Register r);
+		void emitCondJump(XA::ConditionCode cc, int rd, int rs, int address);
+		void emitCall(int address);
+
+		void* allocateCodeMemory(int size);
+		void freeCodeMemory(void* addr, int size);
+		void protectMemory(void* addr, int size);
+
+		XA assm;
+		byte** mPipeToX64InstMap;
+		int mMapSize;
+
+		byte* mCode;
+		int mCodeSize;
+
+		// offsets of the stubs at the start of the code buffer
+		int mEntryStub;
+		int mExitStub;
+		int mBadJumpStub;
+	};
+
+} // namespace MoSync
+
+#endif	//USE_X64_RECOMPILER
+
+#endif
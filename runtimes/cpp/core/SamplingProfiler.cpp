@@ -0,0 +1,309 @@
+/* Copyright 2013 David Axmark
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "config_platform.h"
+#include <helpers/helpers.h>
+#include <helpers/TranslateSyscall.h>
+
+#include "Core.h"
+#include "SamplingProfiler.h"
+#include "sld.h"
+
+using namespace MoSyncError;
+using namespace std;
+
+SamplingProfiler::SamplingProfiler() : mSampleCount(0), mCore(NULL),
+	mIntervalMs(1), mQuit(false), mRunning(false)
+{
+}
+
+SamplingProfiler::~SamplingProfiler() {
+	stop();
+}
+
+void SamplingProfiler::start(const Core::VMCore* core, const char* baseName, int intervalMs) {
+	DEBUG_ASSERT(!mRunning);
+	mCore = core;
+	mBaseName = baseName;
+	mIntervalMs = intervalMs > 0 ? intervalMs : 1;
+	mStacks.clear();
+	mSampleCount = 0;
+	mStartTime = time(NULL);
+	mQuit = false;
+	mRunning = true;
+	mThread.start(threadFunc, this);
+	LOG("Sampling profiler started, interval %i ms\n", mIntervalMs);
+}
+
+void SamplingProfiler::stop() {
+	if(!mRunning)
+		return;
+	mQuit = true;
+	mThread.join();
+	mRunning = false;
+	LOG("Sampling profiler stopped: %i samples, %i unique stacks\n",
+		mSampleCount, (int)mStacks.size());
+
+	writeFolded((mBaseName + ".folded").c_str());
+	writePprof((mBaseName + ".pb").c_str());
+}
+
+int SamplingProfiler::threadFunc(void* arg) {
+	((SamplingProfiler*)arg)->run();
+	return 0;
+}
+
+void SamplingProfiler::run() {
+	while(!mQuit) {
+		MoSyncThread::sleep(mIntervalMs);
+		sample();
+	}
+}
+
+void SamplingProfiler::sample() {
+	int frames[FAKE_CALL_STACK_SIZE];
+	int n = Core::GetFakeCallStack(mCore, frames, FAKE_CALL_STACK_SIZE);
+	Stack stack;
+	stack.reserve(n + 1);
+	for(int i=0; i<n; i++) {
+		stack.push_back(frames[i] - 1);
+	}
+	int leaf = Core::GetIp(mCore);
+	int syscall = mCore->currentSyscallId;
+	if(syscall >= 0)
+		leaf = ~syscall;
+	stack.push_back(leaf);
+	mStacks[stack]++;
+	mSampleCount++;
+}
+
+//******************************************************************************
+// Output
+//******************************************************************************
+
+static string frameName(int key) {
+	char buf[32];
+	if(key < 0) {
+		const char* name = translateSyscall(~key);
+		if(name)
+			return name;
+		sprintf(buf, "syscall_%i", ~key);
+		return buf;
+	}
+	const char* name = mapFunction(key);
+	if(name)
+		return name;
+	sprintf(buf, "0x%x", key);
+	return buf;
+}
+
+void SamplingProfiler::writeFolded(const char* filename) const {
+	FILE* file = fopen(filename, "w");
+	if(!file) {
+		LOG("Could not open %s\n", filename);
+		return;
+	}
+	for(StackMap::const_iterator itr = mStacks.begin(); itr != mStacks.end(); itr++) {
+		const Stack& stack(itr->first);
+		for(size_t i=0; i<stack.size(); i++) {
+			if(i > 0)
+				fputc(';', file);
+			fputs(frameName(stack[i]).c_str(), file);
+		}
+		fprintf(file, " %i\n", itr->second);
+	}
+	fclose(file);
+	LOG("Wrote %s\n", filename);
+}
+
+//Minimal protocol buffer writer, enough for profile.proto.
+class ProtoWriter {
+public:
+	string buf;
+
+	void varint(unsigned long long v) {
+		while(v >= 0x80) {
+			buf += (char)((v & 0x7f) | 0x80);
+			v >>= 7;
+		}
+		buf += (char)v;
+	}
+	void tag(int field, int wireType) {
+		varint((field << 3) | wireType);
+	}
+	void intField(int field, long long v) {
+		tag(field, 0);
+		varint((unsigned long long)v);
+	}
+	void bytesField(int field, const string& s) {
+		tag(field, 2);
+		varint(s.size());
+		buf += s;
+	}
+	void messageField(int field, const ProtoWriter& m) {
+		bytesField(field, m.buf);
+	}
+};
+
+//profile.proto field numbers.
+enum {
+	PROFILE_SAMPLE_TYPE = 1,
+	PROFILE_SAMPLE = 2,
+	PROFILE_LOCATION = 4,
+	PROFILE_FUNCTION = 5,
+	PROFILE_STRING_TABLE = 6,
+	PROFILE_TIME_NANOS = 9,
+	PROFILE_PERIOD_TYPE = 11,
+	PROFILE_PERIOD = 12,
+
+	VALUETYPE_TYPE = 1,
+	VALUETYPE_UNIT = 2,
+
+	SAMPLE_LOCATION_ID = 1,
+	SAMPLE_VALUE = 2,
+
+	LOCATION_ID = 1,
+	LOCATION_ADDRESS = 3,
+	LOCATION_LINE = 4,
+
+	LINE_FUNCTION_ID = 1,
+	LINE_LINE = 2,
+
+	FUNCTION_ID = 1,
+	FUNCTION_NAME = 2,
+	FUNCTION_SYSTEM_NAME = 3,
+	FUNCTION_FILENAME = 4,
+};
+
+class StringTable {
+public:
+	StringTable() { get(""); }
+	int get(const string& s) {
+		map<string, int>::const_iterator itr = mIndex.find(s);
+		if(itr != mIndex.end())
+			return itr->second;
+		int i = (int)mStrings.size();
+		mStrings.push_back(s);
+		mIndex[s] = i;
+		return i;
+	}
+	void write(ProtoWriter& w) const {
+		for(size_t i=0; i<mStrings.size(); i++) {
+			w.bytesField(PROFILE_STRING_TABLE, mStrings[i]);
+		}
+	}
+private:
+	vector<string> mStrings;
+	map<string, int> mIndex;
+};
+
+static void writeValueType(ProtoWriter& w, int field, StringTable& st, const char* type, const char* unit) {
+	ProtoWriter vt;
+	vt.intField(VALUETYPE_TYPE, st.get(type));
+	vt.intField(VALUETYPE_UNIT, st.get(unit));
+	w.messageField(field, vt);
+}
+
+void SamplingProfiler::writePprof(const char* filename) const {
+	ProtoWriter profile;
+	StringTable st;
+	long long period = (long long)mIntervalMs * 1000000;
+
+	writeValueType(profile, PROFILE_SAMPLE_TYPE, st, "samples", "count");
+	writeValueType(profile, PROFILE_SAMPLE_TYPE, st, "cpu", "nanoseconds");
+
+	map<int, int> locations;	//key, id
+	map<string, int> functions;	//name, id
+	ProtoWriter locationData, functionData;
+
+	for(StackMap::const_iterator itr = mStacks.begin(); itr != mStacks.end(); itr++) {
+		const Stack& stack(itr->first);
+		ProtoWriter sample, ids;
+		//pprof wants the innermost frame first.
+		for(int i=(int)stack.size()-1; i>=0; i--) {
+			int key = stack[i];
+			map<int, int>::const_iterator li = locations.find(key);
+			int locId;
+			if(li != locations.end()) {
+				locId = li->second;
+			} else {
+				locId = (int)locations.size() + 1;
+				locations[key] = locId;
+
+				string name = frameName(key);
+				string fileName;
+				int line = 0;
+				const FuncMapping* fm = key >= 0 ? mapFunctionEx(key) : NULL;
+				LineMapping lm;
+				if(key >= 0 && mapIpEx(key, lm)) {
+					line = lm.line;
+					if(lm.file < sldFiles().size())
+						fileName = sldFiles()[lm.file].name;
+				}
+
+				map<string, int>::const_iterator fi = functions.find(name);
+				int funcId;
+				if(fi != functions.end()) {
+					funcId = fi->second;
+				} else {
+					funcId = (int)functions.size() + 1;
+					functions[name] = funcId;
+					ProtoWriter function;
+					function.intField(FUNCTION_ID, funcId);
+					function.intField(FUNCTION_NAME, st.get(name));
+					function.intField(FUNCTION_SYSTEM_NAME,
+						st.get(fm ? fm->mangledName : name));
+					function.intField(FUNCTION_FILENAME, st.get(fileName));
+					functionData.messageField(PROFILE_FUNCTION, function);
+				}
+
+				ProtoWriter location, lineData;
+				location.intField(LOCATION_ID, locId);
+				if(key >= 0)
+					location.intField(LOCATION_ADDRESS, key);
+				lineData.intField(LINE_FUNCTION_ID, funcId);
+				lineData.intField(LINE_LINE, line);
+				location.messageField(LOCATION_LINE, lineData);
+				locationData.messageField(PROFILE_LOCATION, location);
+			}
+			ids.varint(locId);
+		}
+		sample.bytesField(SAMPLE_LOCATION_ID, ids.buf);
+		ProtoWriter values;
+		values.varint(itr->second);
+		values.varint((unsigned long long)(itr->second * period));
+		sample.bytesField(SAMPLE_VALUE, values.buf);
+		profile.messageField(PROFILE_SAMPLE, sample);
+	}
+	profile.buf += locationData.buf;
+	profile.buf += functionData.buf;
+
+	writeValueType(profile, PROFILE_PERIOD_TYPE, st, "cpu", "nanoseconds");
+	profile.intField(PROFILE_PERIOD, period);
+	profile.intField(PROFILE_TIME_NANOS, (long long)mStartTime * 1000000000);
+	st.write(profile);
+
+	FILE* file = fopen(filename, "wb");
+	if(!file) {
+		LOG("Could not open %s\n", filename);
+		return;
+	}
+	fwrite(profile.buf.data(), 1, profile.buf.size(), file);
+	fclose(file);
+	LOG("Wrote %s\n", filename);
+}
@@ -0,0 +1,79 @@
+/* Copyright 2013 David Axmark
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef SAMPLINGPROFILER_H
+#define SAMPLINGPROFILER_H
+
+#include <map>
+#include <vector>
+#include <string>
+#include <time.h>
+
+#include "ThreadPoolImpl.h"
+
+namespace Core {
+	class VMCore;
+}
+
+//Statistical profiler.
+//A timer thread periodically copies the core's IP and fake call stack.
+//When stopped, the samples are resolved through the SLD and written as
+//folded stacks (<base>.folded, for flamegraph.pl) and as an uncompressed
+//pprof profile.proto (<base>.pb).
+//
+//The call stack is written by the core thread and read by the timer thread
+//without locking. A sample taken during a call or return may be off by a frame,
+//which is fine for statistics. The core does no extra work for the profiler.
+class SamplingProfiler {
+public:
+	SamplingProfiler();
+	~SamplingProfiler();
+
+	//Starts sampling the core every intervalMs milliseconds.
+	//core must stay valid until stop() returns.
+	void start(const Core::VMCore* core, const char* baseName, int intervalMs);
+
+	//Stops the timer thread and writes the output files.
+	//Does nothing if the profiler isn't running.
+	void stop();
+
+	bool isRunning() const { return mRunning; }
+
+private:
+	//Stack keys run from the outermost frame to the innermost.
+	//Return addresses are stored minus one, so that they map to the calling line.
+	//A syscall is stored as ~(syscall number).
+	typedef std::vector<int> Stack;
+	typedef std::map<Stack, int> StackMap;
+	StackMap mStacks;
+	int mSampleCount;
+	time_t mStartTime;
+
+	const Core::VMCore* mCore;
+	std::string mBaseName;
+	int mIntervalMs;
+	volatile bool mQuit;
+	bool mRunning;
+	MoSyncThread mThread;
+
+	void sample();
+	void run();
+	static int threadFunc(void*);
+
+	void writeFolded(const char* filename) const;
+	void writePprof(const char* filename) const;
+};
+
+#endif	//SAMPLINGPROFILER_H
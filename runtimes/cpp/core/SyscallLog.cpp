@@ -0,0 +1,328 @@
+/* Copyright 2013 David Axmark
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <string.h>
+
+#include "config_platform.h"
+#include <helpers/helpers.h>
+#include <helpers/cpp_defs.h>
+#include <helpers/asm_config.h>
+#include <base/base_errors.h>
+
+#include "Core.h"
+#include "SyscallLog.h"
+
+using namespace MoSyncError;
+using namespace Core;
+
+#define SYSCALL_LOG_MAGIC 0x4C52534D	//MSRL
+#define SYSCALL_LOG_VERSION 1
+
+#define SYSCALL_ID_ENUM_ELEM(number, reType, name, arg1, argD) SYSCALL_ID_##name = number,
+enum {
+	SYSCALLS(SYSCALL_ID_ENUM_ELEM, , , )
+};
+
+enum Kind {
+	KIND_NONE,	//deterministic; runs normally.
+	KIND_SKIP,	//not recorded; doesn't run during replay.
+	KIND_RESULT,	//r14 is recorded.
+	KIND_BUFFER,	//r14 and the buffer at i2, of size i3, are recorded.
+	KIND_CONN_ADDR,	//r14 and the MAConnAddr at i1 are recorded.
+	KIND_CONN_READ,	//like KIND_SKIP. the data is recorded with the event that completes the read.
+	KIND_EVENT,	//r14, the MAEvent at i0 and the data of completed reads are recorded.
+};
+
+//maIOCtl arguments are shifted one register: i0 is the function.
+static Kind ioctlKind(int function) {
+	switch(function) {
+	case maIOCtl_maGetBatteryCharge:
+	case maIOCtl_maAccept:
+	case maIOCtl_maFileOpen:
+	case maIOCtl_maFileExists:
+	case maIOCtl_maFileClose:
+	case maIOCtl_maFileCreate:
+	case maIOCtl_maFileDelete:
+	case maIOCtl_maFileSize:
+	case maIOCtl_maFileAvailableSpace:
+	case maIOCtl_maFileTotalSpace:
+	case maIOCtl_maFileDate:
+	case maIOCtl_maFileRename:
+	case maIOCtl_maFileTruncate:
+	case maIOCtl_maFileWrite:
+	case maIOCtl_maFileWriteFromData:
+	case maIOCtl_maFileReadToData:
+	case maIOCtl_maFileTell:
+	case maIOCtl_maFileSeek:
+	case maIOCtl_maFileListStart:
+	case maIOCtl_maFileListClose:
+	case maIOCtl_maFileSetProperty:
+		return KIND_RESULT;
+	case maIOCtl_maFileRead:	//(file, dst, len)
+	case maIOCtl_maFileListNext:	//(list, nameBuf, bufSize)
+		return KIND_BUFFER;
+	default:
+		return KIND_NONE;
+	}
+}
+
+static Kind syscallKind(int id, int function) {
+	switch(id) {
+	case SYSCALL_ID_maGetMilliSecondCount:
+	case SYSCALL_ID_maTime:
+	case SYSCALL_ID_maLocalTime:
+	case SYSCALL_ID_maGetKeys:
+	case SYSCALL_ID_maConnect:
+	case SYSCALL_ID_maHttpCreate:
+		return KIND_RESULT;
+	case SYSCALL_ID_maHttpGetResponseHeader:	//(conn, key, buffer, bufSize)
+		return KIND_BUFFER;
+	case SYSCALL_ID_maConnGetAddr:
+		return KIND_CONN_ADDR;
+	case SYSCALL_ID_maConnRead:
+	case SYSCALL_ID_maConnReadFrom:
+		return KIND_CONN_READ;
+	case SYSCALL_ID_maConnWrite:
+	case SYSCALL_ID_maConnWriteTo:
+	case SYSCALL_ID_maConnReadToData:
+	case SYSCALL_ID_maConnWriteFromData:
+	case SYSCALL_ID_maConnClose:
+	case SYSCALL_ID_maHttpSetRequestHeader:
+	case SYSCALL_ID_maHttpFinish:
+	case SYSCALL_ID_maWait:
+		return KIND_SKIP;
+	case SYSCALL_ID_maGetEvent:
+		return KIND_EVENT;
+	case SYSCALL_ID_maIOCtl:
+		return ioctlKind(function);
+	default:
+		return KIND_NONE;
+	}
+}
+
+static uint zigzag(int i) {
+	return ((uint)i << 1) ^ (uint)(i >> 31);
+}
+static int unzigzag(uint u) {
+	return (int)(u >> 1) ^ -(int)(u & 1);
+}
+
+SyscallLog::SyscallLog() : mMode(MODE_OFF), mMem(NULL), mMemSize(0), mFile(NULL),
+	mPos(0), mRecordCount(0)
+{
+}
+
+SyscallLog::~SyscallLog() {
+	if(mFile) {
+		fclose(mFile);
+		LOG("Recorded %i syscalls\n", mRecordCount);
+	}
+}
+
+bool SyscallLog::startRecording(const char* filename, uint programHash, byte* mem, uint memSize) {
+	DEBUG_ASSERT(mMode == MODE_OFF);
+	mFile = fopen(filename, "wb");
+	if(!mFile) {
+		LOG("Could not open %s\n", filename);
+		return false;
+	}
+	const uint header[] = { SYSCALL_LOG_MAGIC, SYSCALL_LOG_VERSION, programHash };
+	if(fwrite(header, sizeof(header), 1, mFile) != 1) {
+		LOG("Could not write %s\n", filename);
+		fclose(mFile);
+		mFile = NULL;
+		return false;
+	}
+	mMem = mem;
+	mMemSize = memSize;
+	mMode = MODE_RECORD;
+	LOG("Recording syscalls to %s\n", filename);
+	return true;
+}
+
+bool SyscallLog::startReplay(const char* filename, uint programHash, byte* mem, uint memSize) {
+	DEBUG_ASSERT(mMode == MODE_OFF);
+	FILE* file = fopen(filename, "rb");
+	if(!file) {
+		LOG("Could not open %s\n", filename);
+		return false;
+	}
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	uint header[3];
+	bool ok = size >= (long)sizeof(header) && fread(header, sizeof(header), 1, file) == 1;
+	if(ok) {
+		mLog.resize(size - sizeof(header));
+		ok = mLog.empty() || fread(&mLog[0], mLog.size(), 1, file) == 1;
+	}
+	fclose(file);
+	if(!ok || header[0] != SYSCALL_LOG_MAGIC || header[1] != SYSCALL_LOG_VERSION) {
+		LOG("%s is not a syscall log\n", filename);
+		return false;
+	}
+	if(header[2] != programHash) {
+		LOG("%s was recorded from another program\n", filename);
+		return false;
+	}
+	mPos = 0;
+	mMem = mem;
+	mMemSize = memSize;
+	mMode = MODE_REPLAY;
+	LOG("Replaying syscalls from %s\n", filename);
+	return true;
+}
+
+bool SyscallLog::validRange(uint address, uint len) const {
+	return address <= mMemSize && len <= mMemSize - address;
+}
+
+void SyscallLog::putVarint(uint v) {
+	while(v >= 0x80) {
+		mBuffer.push_back((byte)((v & 0x7f) | 0x80));
+		v >>= 7;
+	}
+	mBuffer.push_back((byte)v);
+}
+
+void SyscallLog::putBlock(int address, int len) {
+	putVarint(address);
+	putVarint(len);
+	mBuffer.insert(mBuffer.end(), mMem + address, mMem + address + len);
+}
+
+bool SyscallLog::getVarint(uint& v) {
+	v = 0;
+	for(int shift = 0; shift < 35; shift += 7) {
+		if(mPos >= mLog.size())
+			return false;
+		byte b = mLog[mPos++];
+		v |= (uint)(b & 0x7f) << shift;
+		if(!(b & 0x80))
+			return true;
+	}
+	return false;
+}
+
+void SyscallLog::recordSlow(int id, const int* regs) {
+	int function = regs[REG_i0];
+	Kind kind = syscallKind(id, function);
+	if(kind == KIND_NONE || kind == KIND_SKIP)
+		return;
+	if(kind == KIND_CONN_READ) {
+		PendingRead& pr(mPendingReads[regs[REG_i0]]);
+		pr.dst = regs[REG_i1];
+		pr.src = (id == SYSCALL_ID_maConnReadFrom) ? regs[REG_i3] : 0;
+		return;
+	}
+
+	//at most three blocks: an event, the data it completes and the sender's address.
+	struct Block { int address, len; } blocks[3];
+	int nBlocks = 0;
+#define ADD_BLOCK(a, l) if(validRange((a), (l))) { blocks[nBlocks].address = (a); blocks[nBlocks].len = (l); nBlocks++; }
+	int result = regs[REG_r14];
+	switch(kind) {
+	case KIND_BUFFER:
+		ADD_BLOCK(regs[REG_i2], regs[REG_i3]);
+		break;
+	case KIND_CONN_ADDR:
+		if(result >= 0) {
+			ADD_BLOCK(regs[REG_i1], (int)sizeof(MAConnAddr));
+		}
+		break;
+	case KIND_EVENT:
+		if(result && validRange(regs[REG_i0], sizeof(MAEvent))) {
+			const MAEvent& e(*(MAEvent*)(mMem + regs[REG_i0]));
+			ADD_BLOCK(regs[REG_i0], (int)sizeof(MAEvent));
+			if(e.type == EVENT_TYPE_CONN && e.conn.opType == CONNOP_READ) {
+				std::map<int, PendingRead>::iterator itr = mPendingReads.find(e.conn.handle);
+				if(itr != mPendingReads.end()) {
+					if(e.conn.result > 0) {
+						ADD_BLOCK(itr->second.dst, e.conn.result);
+						if(itr->second.src != 0) {
+							ADD_BLOCK(itr->second.src, (int)sizeof(MAConnAddr));
+						}
+					}
+					mPendingReads.erase(itr);
+				}
+			}
+		}
+		break;
+	default:
+		break;
+	}
+#undef ADD_BLOCK
+
+	mBuffer.clear();
+	putVarint(id);
+	if(id == SYSCALL_ID_maIOCtl)
+		putVarint(function);
+	putVarint(zigzag(result));
+	putVarint(nBlocks);
+	for(int i=0; i<nBlocks; i++) {
+		putBlock(blocks[i].address, blocks[i].len);
+	}
+	if(fwrite(&mBuffer[0], mBuffer.size(), 1, mFile) != 1) {
+		LOG("Could not write the syscall log; recording stopped\n");
+		fclose(mFile);
+		mFile = NULL;
+		mMode = MODE_OFF;
+		return;
+	}
+	mRecordCount++;
+}
+
+void GCCATTRIB(noreturn) SyscallLog::diverged(const char* what, int expected, int actual) {
+	LOG("Replay diverged at record %i: expected %s %i, got %i\n",
+		mRecordCount, what, expected, actual);
+	BIG_PHAT_ERROR(ERR_REPLAY_DIVERGED);
+}
+
+bool SyscallLog::replaySlow(int id, int* regs) {
+	int function = regs[REG_i0];
+	Kind kind = syscallKind(id, function);
+	if(kind == KIND_NONE)
+		return false;
+	if(kind == KIND_SKIP || kind == KIND_CONN_READ)
+		return true;
+
+	if(mPos == mLog.size()) {
+		LOG("Replay finished after %i syscalls\n", mRecordCount);
+		MoSyncExit(0);
+	}
+	uint v;
+	MYASSERT(getVarint(v), ERR_REPLAY_DIVERGED);
+	if((int)v != id)
+		diverged("syscall", v, id);
+	if(id == SYSCALL_ID_maIOCtl) {
+		MYASSERT(getVarint(v), ERR_REPLAY_DIVERGED);
+		if((int)v != function)
+			diverged("maIOCtl function", v, function);
+	}
+	MYASSERT(getVarint(v), ERR_REPLAY_DIVERGED);
+	regs[REG_r14] = unzigzag(v);
+	uint nBlocks;
+	MYASSERT(getVarint(nBlocks), ERR_REPLAY_DIVERGED);
+	for(uint i=0; i<nBlocks; i++) {
+		uint address, len;
+		MYASSERT(getVarint(address), ERR_REPLAY_DIVERGED);
+		MYASSERT(getVarint(len), ERR_REPLAY_DIVERGED);
+		MYASSERT(validRange(address, len) && len <= mLog.size() - mPos, ERR_REPLAY_DIVERGED);
+		memcpy(mMem + address, &mLog[mPos], len);
+		mPos += len;
+	}
+	mRecordCount++;
+	return true;
+}
@@ -0,0 +1,85 @@
+/* Copyright 2013 David Axmark
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef SYSCALLLOG_H
+#define SYSCALLLOG_H
+
+#include <stdio.h>
+#include <map>
+#include <vector>
+
+#include <helpers/types.h>
+
+//Records the results of the non-deterministic syscalls (time, keys, events,
+//files, connections) and replays them, so that a run can be repeated
+//exactly without the user, the network or the file system.
+//
+//Each record holds the syscall number, the maIOCtl function if any, r14,
+//and the blocks of data memory the syscall wrote. Numbers are varints.
+//Syscalls that only drive I/O whose results arrive as events (maConnRead,
+//maConnWrite, maWait...) are not recorded and are skipped during replay.
+//Everything else, graphics and resources included, runs normally.
+class SyscallLog {
+public:
+	SyscallLog();
+	~SyscallLog();
+
+	//mem is the data segment, which the recorded syscalls write to.
+	//programHash identifies the program; a log made from another program is rejected.
+	//Both return false on failure.
+	bool startRecording(const char* filename, uint programHash, byte* mem, uint memSize);
+	bool startReplay(const char* filename, uint programHash, byte* mem, uint memSize);
+
+	//Called after each syscall.
+	void record(int id, const int* regs) {
+		if(mMode == MODE_RECORD)
+			recordSlow(id, regs);
+	}
+	//Called before each syscall. If it returns true, the syscall's results
+	//have been restored and the syscall must not run.
+	bool replay(int id, int* regs) {
+		return mMode == MODE_REPLAY && replaySlow(id, regs);
+	}
+
+private:
+	enum Mode { MODE_OFF, MODE_RECORD, MODE_REPLAY };
+	Mode mMode;
+	byte* mMem;
+	uint mMemSize;
+
+	//recording
+	FILE* mFile;
+	std::vector<byte> mBuffer;
+	struct PendingRead {
+		int dst, src;	//src is the address from maConnReadFrom, or 0.
+	};
+	std::map<int, PendingRead> mPendingReads;	//by connection handle
+
+	//replay
+	std::vector<byte> mLog;
+	size_t mPos;
+	int mRecordCount;
+
+	void recordSlow(int id, const int* regs);
+	bool replaySlow(int id, int* regs);
+
+	void putVarint(uint v);
+	void putBlock(int address, int len);
+	bool getVarint(uint& v);
+	bool validRange(uint address, uint len) const;
+	void diverged(const char* what, int expected, int actual);
+};
+
+#endif	//SYSCALLLOG_H
@@ -0,0 +1,139 @@
+/* Copyright 2013 David Axmark
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <algorithm>
+
+#include "config_platform.h"
+#include <helpers/helpers.h>
+#include <helpers/TranslateSyscall.h>
+
+#include "SyscallStats.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+using namespace MoSyncError;
+using namespace std;
+
+volatile sig_atomic_t SyscallStats::sDumpRequested = 0;
+
+SyscallStats::SyscallStats() : mTimed(false), mWriting(false) {
+}
+
+void SyscallStats::init(int numSyscalls) {
+	mCounts.assign(numSyscalls, 0);
+	mTimes.assign(numSyscalls, 0);
+}
+
+void SyscallStats::start(int numSyscalls, bool timed, const char* filename) {
+	if(!isRunning())
+		init(numSyscalls);
+	mTimed = timed;
+	mWriting = true;
+	mFilename = filename ? filename : "";
+}
+
+u64 SyscallStats::getTotal() const {
+	u64 total = 0;
+	for(size_t i=0; i<mCounts.size(); i++)
+		total += mCounts[i];
+	return total;
+}
+
+u64 SyscallStats::now() {
+#ifdef _WIN32
+	static LARGE_INTEGER freq;
+	if(freq.QuadPart == 0)
+		DEBUG_ASSERT(QueryPerformanceFrequency(&freq));
+	LARGE_INTEGER li;
+	DEBUG_ASSERT(QueryPerformanceCounter(&li));
+	return (u64)((double)li.QuadPart * 1000000000.0 / (double)freq.QuadPart);
+#else
+	struct timespec ts;
+	DEBUG_ASSERT(!clock_gettime(CLOCK_MONOTONIC, &ts));
+	return (u64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+//Orders syscall ids by total time, then by count, largest first.
+struct StatOrder {
+	const vector<u64>& counts;
+	const vector<u64>& times;
+	StatOrder(const vector<u64>& c, const vector<u64>& t) : counts(c), times(t) {}
+	bool operator()(int a, int b) const {
+		if(times[a] != times[b])
+			return times[a] > times[b];
+		return counts[a] > counts[b];
+	}
+};
+
+//Writes to file, or to the log if file is NULL.
+static void writeLine(FILE* file, const char* fmt, ...) PRINTF_ATTRIB(2, 3);
+static void writeLine(FILE* file, const char* fmt, ...) {
+	char buf[256];
+	va_list args;
+	va_start(args, fmt);
+	vsnprintf(buf, sizeof(buf), fmt, args);
+	va_end(args);
+	if(file) {
+		fputs(buf, file);
+	} else {
+		LOGC("%s", buf);
+	}
+}
+
+void SyscallStats::write() const {
+	vector<int> ids;
+	u64 totalCount = 0, totalTime = 0;
+	for(size_t i=0; i<mCounts.size(); i++) {
+		if(mCounts[i] == 0)
+			continue;
+		ids.push_back((int)i);
+		totalCount += mCounts[i];
+		totalTime += mTimes[i];
+	}
+	sort(ids.begin(), ids.end(), StatOrder(mCounts, mTimes));
+
+	FILE* file = NULL;
+	if(!mFilename.empty()) {
+		file = fopen(mFilename.c_str(), "w");
+		if(!file)
+			LOG("Could not open %s\n", mFilename.c_str());
+	}
+
+	writeLine(file, "%-32s %12s %12s %10s\n", "syscall", "calls", "total ms", "avg us");
+	for(size_t i=0; i<ids.size(); i++) {
+		int id = ids[i];
+		const char* name = translateSyscall(id);
+		char num[32];
+		if(!name) {
+			sprintf(num, "syscall_%i", id);
+			name = num;
+		}
+		writeLine(file, "%-32s %12.0f %12.3f %10.3f\n", name, (double)mCounts[id],
+			mTimes[id] / 1000000.0, mTimes[id] / 1000.0 / mCounts[id]);
+	}
+	writeLine(file, "%-32s %12.0f %12.3f\n", "total", (double)totalCount, totalTime / 1000000.0);
+
+	if(file) {
+		fclose(file);
+		LOG("Wrote %s\n", mFilename.c_str());
+	}
+}
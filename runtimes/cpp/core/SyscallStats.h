@@ -0,0 +1,90 @@
+/* Copyright 2013 David Axmark
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef SYSCALLSTATS_H
+#define SYSCALLSTATS_H
+
+#include <vector>
+#include <string>
+#include <signal.h>
+
+#include <helpers/types.h>
+
+//Per-syscall call counters and, optionally, cumulative wall-clock time.
+//Kept by the core around each InvokeSysCall. The VM statistics read the same counters.
+//Syscalls that the core runs inline, like the float intrinsics,
+//don't go through InvokeSysCall and are not counted.
+class SyscallStats {
+public:
+	SyscallStats();
+
+	//Starts counting syscalls numbered [0, numSyscalls), without timing or writing them.
+	void init(int numSyscalls);
+
+	//Starts counting syscalls numbered [0, numSyscalls), and timing them if timed is true.
+	//Calls counted since init() are kept.
+	//If filename is not NULL, the counters are written there by write().
+	void start(int numSyscalls, bool timed, const char* filename);
+
+	bool isRunning() const { return !mCounts.empty(); }
+	//True after start().
+	bool isWriting() const { return mWriting; }
+
+	//Returns -1 if id is not counted.
+	s64 getCount(int id) const {
+		if((uint)id >= mCounts.size())
+			return -1;
+		return (s64)mCounts[id];
+	}
+	//The calls to all syscalls.
+	u64 getTotal() const;
+
+	//Returns the start time of the call, or 0 if it isn't timed.
+	u64 begin(int id) {
+		if((uint)id >= mCounts.size())
+			return 0;
+		if(sDumpRequested) {
+			sDumpRequested = 0;
+			if(mWriting)
+				write();
+		}
+		mCounts[id]++;
+		return mTimed ? now() : 0;
+	}
+	void end(int id, u64 startTime) {
+		if(startTime != 0)
+			mTimes[id] += now() - startTime;
+	}
+
+	//Makes the next begin() call, on any core, write(). Safe to call from a signal handler.
+	static void requestDump() { sDumpRequested = 1; }
+
+	//Writes the counters, sorted by total time and then by count,
+	//to the file given to start(), or to the log.
+	void write() const;
+
+	//Monotonic time in nanoseconds.
+	static u64 now();
+
+private:
+	std::vector<u64> mCounts;
+	std::vector<u64> mTimes;	//nanoseconds
+	bool mTimed;
+	bool mWriting;
+	std::string mFilename;	//empty for the log
+	static volatile sig_atomic_t sDumpRequested;
+};
+
+#endif	//SYSCALLSTATS_H
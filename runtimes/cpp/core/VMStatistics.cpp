@@ -0,0 +1,145 @@
+/* Copyright 2013 David Axmark
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <stdio.h>
+
+#include "config_platform.h"
+
+#ifdef VM_STATISTICS
+
+#include <helpers/helpers.h>
+#include <helpers/TranslateSyscall.h>
+#include <helpers/asm_config.h>
+
+#include "Syscall.h"
+#include "SyscallStats.h"
+#include "VMStatistics.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+using namespace MoSyncError;
+
+#define SYSCALL_ID_ENUM_ELEM(number, reType, name, arg1, argD) SYSCALL_ID_##name = number,
+enum {
+	SYSCALLS(SYSCALL_ID_ENUM_ELEM, , , )
+};
+
+VMStatistics::VMStatistics() : blocks(0), mSyscallStats(NULL),
+	mFrameSyscall(SYSCALL_ID_maUpdateScreen), mFile(NULL),
+	mIntervalMs(0), mStartTime(0), mNextDump(0)
+{
+}
+
+VMStatistics::~VMStatistics() {
+	if(mFile)
+		fclose(mFile);
+}
+
+void VMStatistics::init(const SyscallStats* syscallStats) {
+	DEBUG_ASSERT(syscallStats->isRunning());
+	mSyscallStats = syscallStats;
+	mStartTime = now();
+}
+
+bool VMStatistics::startDump(const char* filename, int intervalMs) {
+	DEBUG_ASSERT(!mFile);
+	mFile = fopen(filename, "w");
+	if(!mFile) {
+		LOG("Could not open %s\n", filename);
+		return false;
+	}
+	mIntervalMs = intervalMs;
+	mNextDump = 0;
+	LOG("Writing VM statistics to %s\n", filename);
+	return true;
+}
+
+u64 VMStatistics::now() {
+#ifdef _WIN32
+	return GetTickCount64();
+#else
+	struct timespec ts;
+	DEBUG_ASSERT(!clock_gettime(CLOCK_MONOTONIC, &ts));
+	return (u64)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#endif
+}
+
+void VMStatistics::dumpIfDue(Base::Syscall& syscall) {
+	u64 t = now();
+	if(t < mNextDump)
+		return;
+	mNextDump = t + mIntervalMs;
+	writeLine(syscall);
+}
+
+void VMStatistics::close(Base::Syscall& syscall) {
+	if(!mFile)
+		return;
+	writeLine(syscall);
+	fclose(mFile);
+	mFile = NULL;
+}
+
+void VMStatistics::writeLine(Base::Syscall& syscall) {
+	const Base::Syscall::Statistics& s(syscall.statistics);
+	fprintf(mFile, "{\"time\":%.0f,\"frame\":%.0f,\"blocks\":%.0f,\"syscalls\":%.0f,"
+		"\"yields\":%.0f,\"waits\":%.0f,\"waitTime\":%.0f,\"eventOverflows\":%.0f",
+		(double)(now() - mStartTime), (double)mSyscallStats->getCount(mFrameSyscall),
+		(double)blocks, (double)mSyscallStats->getTotal(),
+		(double)s.yields, (double)s.waits, (double)s.waitTime, (double)s.eventOverflows);
+#ifdef RESOURCE_MEMORY_LIMIT
+	fprintf(mFile, ",\"resourceMemory\":%u,\"imageMemory\":%u,\"binaryMemory\":%u",
+		syscall.resources.getResmem(), syscall.resources.getResmemOfType(RT_IMAGE),
+		syscall.resources.getResmemOfType(RT_BINARY));
+#endif
+	fputs(",\"syscallCounts\":{", mFile);
+	bool first = true;
+	for(int i=0; mSyscallStats->getCount(i) >= 0; i++) {
+		s64 count = mSyscallStats->getCount(i);
+		if(count == 0)
+			continue;
+		const char* name = translateSyscall(i);
+		if(name)
+			fprintf(mFile, "%s\"%s\":%.0f", first ? "" : ",", name, (double)count);
+		else
+			fprintf(mFile, "%s\"syscall_%i\":%.0f", first ? "" : ",", i, (double)count);
+		first = false;
+	}
+	fputs("}}\n", mFile);
+	fflush(mFile);
+}
+
+void VMStatistics::fill(MAVMStatistics* stats, Base::Syscall& syscall) const {
+	const Base::Syscall::Statistics& s(syscall.statistics);
+	stats->blocks = (int)blocks;
+	stats->syscalls = (int)mSyscallStats->getTotal();
+	stats->yields = (int)s.yields;
+	stats->waits = (int)s.waits;
+	stats->waitTime = (int)s.waitTime;
+	stats->eventOverflows = (int)s.eventOverflows;
+#ifdef RESOURCE_MEMORY_LIMIT
+	stats->resourceMemory = (int)syscall.resources.getResmem();
+	stats->imageMemory = (int)syscall.resources.getResmemOfType(RT_IMAGE);
+	stats->binaryMemory = (int)syscall.resources.getResmemOfType(RT_BINARY);
+#else
+	stats->resourceMemory = stats->imageMemory = stats->binaryMemory = -1;
+#endif
+}
+
+#endif	//VM_STATISTICS
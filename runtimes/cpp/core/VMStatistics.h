@@ -0,0 +1,81 @@
+/* Copyright 2013 David Axmark
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef VMSTATISTICS_H
+#define VMSTATISTICS_H
+
+#include <stdio.h>
+
+#include <helpers/types.h>
+#include <helpers/cpp_defs.h>
+
+namespace Base {
+	class Syscall;
+}
+class SyscallStats;
+
+//The core's counters: basic blocks entered, and calls to each syscall, which are
+//read from the core's SyscallStats. The platform keeps the rest in Syscall::statistics.
+//
+//Both are read by maGetVMStatistics, and can be written as JSON lines,
+//one object per line, with cumulative counters:
+//	{"time":<ms since start>,"frame":<maUpdateScreen calls>,"blocks":<n>,"syscalls":<n>,
+//	"yields":<n>,"waits":<n>,"waitTime":<ms>,"eventOverflows":<n>,
+//	"resourceMemory":<bytes>,"imageMemory":<bytes>,"binaryMemory":<bytes>,
+//	"syscallCounts":{"<name>":<n>,...}}
+//The memory fields are missing without RESOURCE_MEMORY_LIMIT,
+//and syscallCounts only lists syscalls that have been called.
+class VMStatistics {
+public:
+	VMStatistics();
+	~VMStatistics();
+
+	//Reads the syscall counters from syscallStats, which must be running.
+	void init(const SyscallStats* syscallStats);
+
+	//Appends a line to filename at maUpdateScreen, at most once per intervalMs,
+	//and a last one from close(). Returns false if the file can't be opened.
+	bool startDump(const char* filename, int intervalMs);
+
+	//Call before each syscall, after it is counted. Each maUpdateScreen ends a frame.
+	void beforeSyscall(int id, Base::Syscall& syscall) {
+		if(id == mFrameSyscall && mFile)
+			dumpIfDue(syscall);
+	}
+
+	//Writes the last line and closes the dump, if any.
+	void close(Base::Syscall& syscall);
+
+	void fill(MAVMStatistics* stats, Base::Syscall& syscall) const;
+
+	//Incremented by the interpreters on each jump, call and return, and on each
+	//conditional branch whether taken or not.
+	u64 blocks;
+
+private:
+	void dumpIfDue(Base::Syscall& syscall);
+	void writeLine(Base::Syscall& syscall);
+
+	//Monotonic time in milliseconds.
+	static u64 now();
+
+	const SyscallStats* mSyscallStats;
+	int mFrameSyscall;
+	FILE* mFile;
+	int mIntervalMs;
+	u64 mStartTime, mNextDump;
+};
+
+#endif	//VMSTATISTICS_H
@@ -22,9 +22,27 @@ struct InstructionBucket {
 
 std::vector<InstructionBucket> gInstructionUseCount;
 
+// dynamic opcode pairs and triples, indexed [a][b] and [a][b][c].
+// FAR prefixes are skipped, so a FAR JPI counts as a JPI.
+std::vector<int> gInstructionPairCount;
+std::vector<int> gInstructionTripleCount;
+const char* gInstructionNames[_ENDOP];
+int gPrevOp1, gPrevOp2;	//most recent first; _NUL if none
+
 void countInstructionUse(const char* opName, byte x) {
 	gInstructionUseCount[x].count++;
 	gInstructionUseCount[x].opName = opName;
+
+	if(x == _FAR)
+		return;
+	gInstructionNames[x] = opName;
+	if(gPrevOp1 != _NUL) {
+		gInstructionPairCount[gPrevOp1*_ENDOP + x]++;
+		if(gPrevOp2 != _NUL)
+			gInstructionTripleCount[(gPrevOp2*_ENDOP + gPrevOp1)*_ENDOP + x]++;
+	}
+	gPrevOp2 = gPrevOp1;
+	gPrevOp1 = x;
 }
 
 void initInstructionUseCount() {
@@ -33,7 +51,11 @@ void initInstructionUseCount() {
 		gInstructionUseCount[i].id = i;
 		gInstructionUseCount[i].count = 0;
 		gInstructionUseCount[i].opName = "UNUSED";
+		gInstructionNames[i] = "UNUSED";
 	}
+	gInstructionPairCount.assign(_ENDOP*_ENDOP, 0);
+	gInstructionTripleCount.assign(_ENDOP*_ENDOP*_ENDOP, 0);
+	gPrevOp1 = gPrevOp2 = _NUL;
 }
 
 static bool UDgreater ( InstructionBucket& elem1, InstructionBucket& elem2 )
@@ -41,8 +63,49 @@ static bool UDgreater ( InstructionBucket& elem1, InstructionBucket& elem2 )
    return elem1.count > elem2.count;
 }
 
+struct NgramBucket {
+	int count;
+	int ops[3];
+	static bool greater(const NgramBucket& a, const NgramBucket& b) {
+		return a.count > b.count;
+	}
+};
+
+// appends the non-zero entries of /counts/, most frequent first.
+void logNgrams(Base::WriteFileStream& file, const std::vector<int>& counts, int n) {
+	std::vector<NgramBucket> buckets;
+	for(size_t i = 0; i < counts.size(); i++) {
+		if(counts[i] == 0)
+			continue;
+		NgramBucket b;
+		b.count = counts[i];
+		int rest = (int)i;
+		for(int j = n - 1; j >= 0; j--) {
+			b.ops[j] = rest % _ENDOP;
+			rest /= _ENDOP;
+		}
+		buckets.push_back(b);
+	}
+	std::sort(buckets.begin(), buckets.end(), &NgramBucket::greater);
 
+	char temp[1024];
+	for(size_t i = 0; i < buckets.size(); i++) {
+		int len = sprintf(temp, "%i", n);
+		for(int j = 0; j < n; j++)
+			len += sprintf(temp + len, " %s", gInstructionNames[buckets[i].ops[j]]);
+		len += sprintf(temp + len, " %d\n", buckets[i].count);
+		file.write(temp, len);
+	}
+}
+
+// instruction_ngrams.txt is the input of gen_superinstructions.rb.
 void logInstructionUse() {
+	{
+		Base::WriteFileStream ngrams("instruction_ngrams.txt", false);
+		logNgrams(ngrams, gInstructionPairCount, 2);
+		logNgrams(ngrams, gInstructionTripleCount, 3);
+	}
+
 	std::sort(gInstructionUseCount.begin(),
 		gInstructionUseCount.end(), &Core::VMCoreInt::UDgreater);
 
@@ -253,17 +316,17 @@ VMLOOP_LABEL
 			fakePush(REG(REG_rt), IMM);
 		EOP;
 
-		OPC(JC_EQ) 	FETCH_RD_RS_ADDR16	if (RD == RS)	{ JMP_IMM; } 	EOP;
-		OPC(JC_NE)	FETCH_RD_RS_ADDR16	if (RD != RS)	{ JMP_IMM; }	EOP;
-		OPC(JC_GE)	FETCH_RD_RS_ADDR16	if (RD >= RS)	{ JMP_IMM; }	EOP;
-		OPC(JC_GT)	FETCH_RD_RS_ADDR16	if (RD >  RS)	{ JMP_IMM; }	EOP;
-		OPC(JC_LE)	FETCH_RD_RS_ADDR16	if (RD <= RS)	{ JMP_IMM; }	EOP;
-		OPC(JC_LT)	FETCH_RD_RS_ADDR16	if (RD <  RS)	{ JMP_IMM; }	EOP;
+		OPC(JC_EQ) 	FETCH_RD_RS_ADDR16	if (RD == RS)	{ JMP_IMM; } JC_NOT_TAKEN 	EOP;
+		OPC(JC_NE)	FETCH_RD_RS_ADDR16	if (RD != RS)	{ JMP_IMM; } JC_NOT_TAKEN	EOP;
+		OPC(JC_GE)	FETCH_RD_RS_ADDR16	if (RD >= RS)	{ JMP_IMM; } JC_NOT_TAKEN	EOP;
+		OPC(JC_GT)	FETCH_RD_RS_ADDR16	if (RD >  RS)	{ JMP_IMM; } JC_NOT_TAKEN	EOP;
+		OPC(JC_LE)	FETCH_RD_RS_ADDR16	if (RD <= RS)	{ JMP_IMM; } JC_NOT_TAKEN	EOP;
+		OPC(JC_LT)	FETCH_RD_RS_ADDR16	if (RD <  RS)	{ JMP_IMM; } JC_NOT_TAKEN	EOP;
 
-		OPC(JC_LTU)	FETCH_RD_RS_ADDR16	if (RDU <  RSU)	{ JMP_IMM; }	EOP;
-		OPC(JC_GEU)	FETCH_RD_RS_ADDR16	if (RDU >= RSU)	{ JMP_IMM; }	EOP;
-		OPC(JC_GTU)	FETCH_RD_RS_ADDR16	if (RDU >  RSU)	{ JMP_IMM; }	EOP;
-		OPC(JC_LEU)	FETCH_RD_RS_ADDR16	if (RDU <= RSU)	{ JMP_IMM; }	EOP;
+		OPC(JC_LTU)	FETCH_RD_RS_ADDR16	if (RDU <  RSU)	{ JMP_IMM; } JC_NOT_TAKEN	EOP;
+		OPC(JC_GEU)	FETCH_RD_RS_ADDR16	if (RDU >= RSU)	{ JMP_IMM; } JC_NOT_TAKEN	EOP;
+		OPC(JC_GTU)	FETCH_RD_RS_ADDR16	if (RDU >  RSU)	{ JMP_IMM; } JC_NOT_TAKEN	EOP;
+		OPC(JC_LEU)	FETCH_RD_RS_ADDR16	if (RDU <= RSU)	{ JMP_IMM; } JC_NOT_TAKEN	EOP;
 
 		OPC(JPI)		FETCH_IMM16		JMP_IMM		EOP;
 		OPC(JPR)		FETCH_RD		JMP_RD		EOP;
@@ -275,17 +338,17 @@ VMLOOP_LABEL
 				fakePush(REG(REG_rt), IMM);
 			EOP;
 
-			OPC(JC_EQ) 	FETCH_RD_RS_ADDR24	if (RD == RS)	{ JMP_IMM; } 	EOP;
-			OPC(JC_NE)		FETCH_RD_RS_ADDR24	if (RD != RS)	{ JMP_IMM; }	EOP;
-			OPC(JC_GE)		FETCH_RD_RS_ADDR24	if (RD >= RS)	{ JMP_IMM; }	EOP;
-			OPC(JC_GT)		FETCH_RD_RS_ADDR24	if (RD >  RS)	{ JMP_IMM; }	EOP;
-			OPC(JC_LE)		FETCH_RD_RS_ADDR24	if (RD <= RS)	{ JMP_IMM; }	EOP;
-			OPC(JC_LT)		FETCH_RD_RS_ADDR24	if (RD <  RS)	{ JMP_IMM; }	EOP;
+			OPC(JC_EQ) 	FETCH_RD_RS_ADDR24	if (RD == RS)	{ JMP_IMM; } JC_NOT_TAKEN 	EOP;
+			OPC(JC_NE)		FETCH_RD_RS_ADDR24	if (RD != RS)	{ JMP_IMM; } JC_NOT_TAKEN	EOP;
+			OPC(JC_GE)		FETCH_RD_RS_ADDR24	if (RD >= RS)	{ JMP_IMM; } JC_NOT_TAKEN	EOP;
+			OPC(JC_GT)		FETCH_RD_RS_ADDR24	if (RD >  RS)	{ JMP_IMM; } JC_NOT_TAKEN	EOP;
+			OPC(JC_LE)		FETCH_RD_RS_ADDR24	if (RD <= RS)	{ JMP_IMM; } JC_NOT_TAKEN	EOP;
+			OPC(JC_LT)		FETCH_RD_RS_ADDR24	if (RD <  RS)	{ JMP_IMM; } JC_NOT_TAKEN	EOP;
 
-			OPC(JC_LTU)	FETCH_RD_RS_ADDR24	if (RDU <  RSU)	{ JMP_IMM; }	EOP;
-			OPC(JC_GEU)	FETCH_RD_RS_ADDR24	if (RDU >= RSU)	{ JMP_IMM; }	EOP;
-			OPC(JC_GTU)	FETCH_RD_RS_ADDR24	if (RDU >  RSU)	{ JMP_IMM; }	EOP;
-			OPC(JC_LEU)	FETCH_RD_RS_ADDR24	if (RDU <= RSU)	{ JMP_IMM; }	EOP;
+			OPC(JC_LTU)	FETCH_RD_RS_ADDR24	if (RDU <  RSU)	{ JMP_IMM; } JC_NOT_TAKEN	EOP;
+			OPC(JC_GEU)	FETCH_RD_RS_ADDR24	if (RDU >= RSU)	{ JMP_IMM; } JC_NOT_TAKEN	EOP;
+			OPC(JC_GTU)	FETCH_RD_RS_ADDR24	if (RDU >  RSU)	{ JMP_IMM; } JC_NOT_TAKEN	EOP;
+			OPC(JC_LEU)	FETCH_RD_RS_ADDR24	if (RDU <= RSU)	{ JMP_IMM; } JC_NOT_TAKEN	EOP;
 
 			OPC(JPI)		FETCH_IMM24		JMP_IMM		EOP;
 		default:
@@ -302,11 +365,16 @@ VMLOOP_LABEL
 		OPC(SYSCALL)
 		{
 			int syscallNumber = IB;
-			fakePush((int32_t) (ip - mem_cs), -syscallNumber);
-			InvokeSysCall(syscallNumber);
-			fakePop();
-			if (VM_Yield)
-				return ip;
+#ifdef INLINE_FLOAT_SYSCALLS
+			if(!runFloatIntrinsic(syscallNumber, regs))
+#endif
+			{
+				fakePush((int32_t) (ip - mem_cs), -syscallNumber);
+				InvokeSysCall(syscallNumber);
+				fakePop();
+				if (VM_Yield)
+					return ip;
+			}
 		}
 		EOP;
 
@@ -0,0 +1,52 @@
+/* Copyright 2013 David Axmark
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Opcode pairs that the threaded core fuses into one dispatch.
+// See core_threaded.h.
+//
+// The first instruction of a pair must not transfer control:
+// no jumps, calls, RET, CASE or SYSCALL.
+//
+// To regenerate from a profile, build MoRE with COUNT_INSTRUCTION_USE, run
+// the program, then
+//   ruby gen_superinstructions.rb instruction_ngrams.txt > core_superinstructions.h
+// or define THREADED_SUPERINSTRUCTIONS_FILE to point at the generated file.
+
+#ifndef CORE_SUPERINSTRUCTIONS_H
+#define CORE_SUPERINSTRUCTIONS_H
+
+#define SUPERINSTRUCTIONS(m)\
+	m(LDI, CALLI)\
+	m(LDI, CALL)\
+	m(LDR, CALLI)\
+	m(LDI, LDI)\
+	m(LDR, LDR)\
+	m(LDW, LDW)\
+	m(STW, STW)\
+	m(LDW, ADD)\
+	m(LDW, ADDI)\
+	m(ADD, STW)\
+	m(ADDI, STW)\
+	m(SUBI, STW)\
+	m(LDI, JC_EQ)\
+	m(LDI, JC_NE)\
+	m(LDI, JC_LT)\
+	m(LDI, JC_GE)\
+	m(LDW, JC_EQ)\
+	m(LDW, JC_NE)\
+	m(ADDI, JC_NE)\
+	m(ADDI, JC_LT)
+
+#endif	//CORE_SUPERINSTRUCTIONS_H
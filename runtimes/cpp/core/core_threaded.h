@@ -0,0 +1,590 @@
+/* Copyright 2013 David Axmark
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Pre-decoded execution engine, used when USE_THREADED_CORE is defined.
+// This file is included into VMCoreInt, in the same way as core_run.h.
+//
+// LoadVM translates mem_cs into an array of fixed-width ThreadedInsn, one slot
+// per code byte, so a code address is also an index into the array.
+// Slots that don't start an instruction are left as _TDECODE and are decoded
+// on first use, which also takes care of code patched by the debugger.
+//
+// Common opcode pairs (see core_superinstructions.h) are then fused: the slot
+// of the first instruction gets a handler that runs both, while the second
+// slot stays as it was. Define THREADED_NO_FUSION to turn this off.
+//
+// With INLINE_FLOAT_SYSCALLS, a SYSCALL of a float intrinsic decodes to an op
+// of its own, which runs it without going through InvokeSysCall.
+//
+// Define THREADED_RUN_NAME before including.
+
+//****************************************
+//Decoder
+//****************************************
+#define TIB ((int)mem_cs[(a++) & CODE_SEGMENT_MASK])
+
+	// returns false if the constant index is out of range.
+	bool decodeThreadedConst(uint& a, int& imm) {
+		int index = TIB;
+#ifdef USE_VAR_INT
+		if(index > 127) {
+			index = ((index & 127) << 8) + TIB;
+		}
+#else
+		index = (index << 8) + TIB;
+#endif
+		if(index >= Head.IntLen)
+			return false;
+		imm = mem_cp[index];
+		return true;
+	}
+
+	// Decodes the instruction at code address /address/ into its slot.
+	void decodeThreaded(uint address) {
+		ThreadedInsn& t = mThreadedCode[address];
+		uint a = address;
+		int op = TIB;
+		bool far = false;
+		bool ok = true;
+		int rd = 0, rs = 0, imm = 0;
+
+		if(op == _FAR) {
+			far = true;
+			op = TIB;
+		}
+
+		switch(op) {
+		case _ADD: case _SUB: case _MUL: case _AND: case _OR: case _XOR:
+		case _DIVU: case _DIV: case _SLL: case _SRA: case _SRL:
+		case _NOT: case _NEG: case _LDR: case _XB: case _XH:
+			rd = TIB;
+			rs = TIB;
+			break;
+		case _ADDI: case _SUBI: case _MULI: case _ANDI: case _ORI: case _XORI:
+		case _DIVUI: case _DIVI: case _LDI:
+			rd = TIB;
+			ok = decodeThreadedConst(a, imm);
+			break;
+		case _SLLI: case _SRAI: case _SRLI: case _PUSH: case _POP:
+			rd = TIB;
+			imm = TIB;
+			break;
+		case _LDB: case _LDH: case _LDW: case _STB: case _STH: case _STW:
+			rd = TIB;
+			rs = TIB;
+			ok = decodeThreadedConst(a, imm);
+			break;
+		case _CALL: case _JPR:
+			rd = TIB;
+			break;
+		case _RET:
+			break;
+		case _CALLI: case _JPI:
+			if(far) {
+				imm = TIB << 16;
+				imm += TIB << 8;
+			} else {
+				imm = TIB << 8;
+			}
+			imm += TIB;
+			break;
+		case _JC_EQ: case _JC_NE: case _JC_GE: case _JC_GEU: case _JC_GT:
+		case _JC_GTU: case _JC_LE: case _JC_LEU: case _JC_LT: case _JC_LTU:
+			rd = TIB;
+			rs = TIB;
+			if(far) {
+				imm = TIB << 16;
+				imm += TIB << 8;
+			} else {
+				imm = TIB << 8;
+			}
+			imm += TIB;
+			break;
+		case _SYSCALL:
+			imm = TIB;
+			op = threadedSyscallOp(imm);
+			break;
+		case _CASE:
+			rd = TIB;
+			imm = TIB << 16;
+			imm += TIB << 8;
+			imm += TIB;
+			break;
+#ifdef GDB_DEBUG
+		case _DBG_OP:
+			break;
+#endif
+		default:
+			ok = false;
+		}
+
+		if(far) switch(op) {
+		case _CALLI: case _JPI:
+		case _JC_EQ: case _JC_NE: case _JC_GE: case _JC_GEU: case _JC_GT:
+		case _JC_GTU: case _JC_LE: case _JC_LEU: case _JC_LT: case _JC_LTU:
+			break;
+		default:
+			ok = false;
+		}
+
+		if(ok) {
+			t.op = (ushort)op;
+			t.rd = (byte)rd;
+			t.rs = (byte)rs;
+			t.imm = imm;
+			t.len = t.len1 = (byte)(a - address);
+		} else {
+			// keep the offending opcode for the panic log.
+			t.op = _TILLEGAL;
+			t.rd = far ? (byte)_FAR : (byte)op;
+			t.rs = (byte)op;
+			t.imm = 0;
+			t.len = t.len1 = 1;
+		}
+		t.handler = mThreadedHandlers ? mThreadedHandlers[t.op] : NULL;
+	}
+#undef TIB
+
+	// float intrinsics get an op of their own; see FloatIntrinsics.h.
+	static int threadedSyscallOp(int id) {
+#define THREADED_FLOAT_DECODE(name) case SYSCALL_ID_##name: return _FI_##name;
+		switch(id) {
+		FLOAT_INTRINSICS(THREADED_FLOAT_DECODE)
+		default:
+			return _SYSCALL;
+		}
+	}
+
+	// Turns the instruction at /address/ and the one following it into a
+	// superinstruction, if the pair is listed in core_superinstructions.h.
+	// The second instruction keeps its own slot, for jumps that land on it.
+	// Nothing is fused under GDB: a pair runs both halves before the signal
+	// check, so a single step would run two instructions.
+	void fuseThreaded(uint address) {
+#ifndef THREADED_NO_FUSION
+#ifdef GDB_DEBUG
+		if(mGdbOn)
+			return;
+#endif
+		ThreadedInsn& t = mThreadedCode[address];
+		if(t.op >= _ENDOP)
+			return;
+		uint next = address + t.len;
+		if(next >= CODE_SEGMENT_SIZE)
+			return;
+		ThreadedInsn u = mThreadedCode[next];
+		if(u.op == _TDECODE) {
+			// peek only; the slot is left for TDECODE, so it gets fused in turn.
+			decodeThreaded(next);
+			u = mThreadedCode[next];
+			resetThreaded(next, next + 1);
+		}
+		int uop = u.op;
+		int ulen = u.len;
+		if(uop >= _TFUSED_FIRST) {
+			uop = fusedFirstOp(uop);
+			ulen = u.len1;
+		} else if(uop >= _ENDOP) {
+			return;
+		}
+		ushort f = mThreadedFuse[t.op][uop];
+		if(f == 0)
+			return;
+		t.rd2 = u.rd;
+		t.rs2 = u.rs;
+		t.imm2 = u.imm;
+		t.len1 = t.len;
+		t.len = (byte)(t.len + ulen);
+		t.op = f;
+		t.handler = mThreadedHandlers ? mThreadedHandlers[f] : NULL;
+#endif
+	}
+
+	// returns the opcode of the first half of a fused op.
+	static int fusedFirstOp(int op) {
+#define THREADED_FUSED_FIRST_ELEM(a, b) _##a,
+		static const byte sFirst[] = {
+			SUPERINSTRUCTIONS(THREADED_FUSED_FIRST_ELEM)
+			_NUL
+		};
+		return sFirst[op - _TFUSED_FIRST];
+	}
+
+	void resetThreaded(uint start, uint end) {
+		for(uint i = start; i < end; i++) {
+			mThreadedCode[i].op = _TDECODE;
+			mThreadedCode[i].handler = mThreadedHandlers ? mThreadedHandlers[_TDECODE] : NULL;
+		}
+	}
+
+	// Called from LoadVM, after mem_cs and mem_cp have been loaded.
+	void predecodeThreaded() {
+		delete[] mThreadedCode;
+		mThreadedCode = new ThreadedInsn[CODE_SEGMENT_SIZE + THREADED_CODE_PAD];
+		if(!mThreadedCode) BIG_PHAT_ERROR(ERR_OOM);
+#if THREADED_DISPATCH_GOTO
+		RunThreaded(NULL);	//fetch the handler table
+#endif
+		resetThreaded(0, CODE_SEGMENT_SIZE + THREADED_CODE_PAD);
+
+		// linear sweep; anything it misses will be decoded on demand.
+		uint address = 0;
+		while(address < (uint)Head.CodeLen) {
+			decodeThreaded(address);
+			address += mThreadedCode[address].len;
+		}
+
+#ifndef THREADED_NO_FUSION
+		memset(mThreadedFuse, 0, sizeof(mThreadedFuse));
+#define THREADED_FUSE_ELEM(a, b) mThreadedFuse[_##a][_##b] = _F_##a##_##b;
+		SUPERINSTRUCTIONS(THREADED_FUSE_ELEM);
+
+		address = 0;
+		while(address < (uint)Head.CodeLen) {
+			uint len = mThreadedCode[address].len;
+			fuseThreaded(address);
+			address += len;
+		}
+#endif
+	}
+
+	// Drops pre-decoded instructions overlapping a range of code that has changed.
+	void InvalidateCode(int address, int length) {
+		if(mThreadedCode == NULL)
+			return;
+		uint start = uint(address) > THREADED_MAX_FUSED_LEN ? address - THREADED_MAX_FUSED_LEN : 0;
+		uint end = MIN(uint(address + length), CODE_SEGMENT_SIZE);
+		resetThreaded(start, end);
+	}
+
+	//****************************************
+	//Definitions
+	//****************************************
+#ifdef UPDATE_IP
+#define THREADED_UPDATE_IP IP = uint(pc - mThreadedCode);
+#else
+#define THREADED_UPDATE_IP
+#endif
+#ifdef MEMORY_DEBUG
+#define THREADED_COUNT_INST InstCount++;
+#else
+#define THREADED_COUNT_INST
+#endif
+#if defined(INSTRUCTION_PROFILING) && defined(UPDATE_IP) && defined(MEMORY_DEBUG)
+#define THREADED_PROFILE_INST instruction_count[IP]++;
+#else
+#define THREADED_PROFILE_INST
+#endif
+#ifdef LOG_STATE_CHANGE
+#define THREADED_LOG_STATE logStateChange((int)(pc - mThreadedCode));
+#else
+#define THREADED_LOG_STATE
+#endif
+#define THREADED_PROLOGUE THREADED_UPDATE_IP THREADED_COUNT_INST THREADED_PROFILE_INST THREADED_LOG_STATE
+
+#ifdef GDB_DEBUG
+#define THREADED_CHECK_SIGNAL if(mGdbSignal) { IP = uint(pc - mThreadedCode);\
+	waitForRemote(mGdbSignal); pc = mThreadedCode + (IP & CODE_SEGMENT_MASK); }
+#else
+#define THREADED_CHECK_SIGNAL
+#endif
+
+#define TFETCH rd = pc->rd; rs = pc->rs; imm32 = pc->imm; pc += pc->len;
+
+#ifdef MEMORY_DEBUG
+#define TJMP_GENERIC(address) dumpJump(address); if(uint(address) >= CODE_SEGMENT_SIZE) {\
+	LOG("\nIllegal jump to 0x%04X\n", (uint)address); BIG_PHAT_ERROR(ERR_IMEM_OOB); }\
+	pc = mThreadedCode + (address); BLOCK_ENTER(uint(pc - mThreadedCode))
+#else
+#define TJMP_GENERIC(address) pc = mThreadedCode + ((address) & CODE_SEGMENT_MASK);\
+	BLOCK_ENTER(uint(pc - mThreadedCode))
+#endif
+#if defined(BLOCK_PROFILING) || defined(VM_STATISTICS)
+#define TJC_NOT_TAKEN else { BLOCK_ENTER(uint(pc - mThreadedCode)) }
+#else
+#define TJC_NOT_TAKEN
+#endif
+
+#define	TJMP_IMM	TJMP_GENERIC(IMM)
+#define	TJMP_RD	TJMP_GENERIC(RD)
+#define	TCALL_IMM	REG(REG_rt) = (int32_t) (pc - mThreadedCode); TJMP_IMM;
+#define	TCALL_RD	REG(REG_rt) = (int32_t) (pc - mThreadedCode); TJMP_RD;
+
+// Instruction bodies, shared by the single and fused handlers.
+// rd, rs and imm32 must be set up and pc must point past the instruction.
+#define TB_ADD	ARITH(rd, RD, +, RS);
+#define TB_ADDI	ARITH(rd, RD, +, IMM);
+#define TB_SUB	ARITH(rd, RD, -, RS);
+#define TB_SUBI	ARITH(rd, RD, -, IMM);
+#define TB_MUL	ARITH(rd, RD, *, RS);
+#define TB_MULI	ARITH(rd, RD, *, IMM);
+#define TB_AND	ARITH(rd, RD, &, RS);
+#define TB_ANDI	ARITH(rd, RD, &, IMM);
+#define TB_OR	ARITH(rd, RD, |, RS);
+#define TB_ORI	ARITH(rd, RD, |, IMM);
+#define TB_XOR	ARITH(rd, RD, ^, RS);
+#define TB_XORI	ARITH(rd, RD, ^, IMM);
+#define TB_DIVU	DIVIDE(rd, RDU, RSU);
+#define TB_DIVUI	DIVIDE(rd, RDU, IMMU);
+#define TB_DIV	DIVIDE(rd, RD, RS);
+#define TB_DIVI	DIVIDE(rd, RD, IMM);
+#define TB_SLL	ARITH(rd, RDU, <<, RSU);
+#define TB_SLLI	ARITH(rd, RDU, <<, IMMU);
+#define TB_SRA	ARITH(rd, RD, >>, RS);
+#define TB_SRAI	ARITH(rd, RD, >>, IMM);
+#define TB_SRL	ARITH(rd, RDU, >>, RSU);
+#define TB_SRLI	ARITH(rd, RDU, >>, IMMU);
+
+#define TB_NOT	WRITE_REG(rd, ~RS);
+#define TB_NEG	WRITE_REG(rd, -RS);
+
+#define TB_PUSH {\
+	byte r = rd;\
+	unsigned n = imm32;\
+	if(rd < 2 || int(rd) + n > 32) {\
+		DUMPINT(rd);\
+		DUMPINT(n);\
+		BIG_PHAT_ERROR(ERR_ILLEGAL_INSTRUCTION_FORM);\
+	}\
+	do {\
+		ARITH(REG_sp, regs[REG_sp], -, 4);\
+		MEM(int32_t, REG(REG_sp), WRITE) = REG(r);\
+		r++;\
+	} while(--n);\
+}
+
+#define TB_POP {\
+	byte r = rd;\
+	unsigned n = imm32;\
+	if(rd > 31 || int(rd) - n < 1)\
+		BIG_PHAT_ERROR(ERR_ILLEGAL_INSTRUCTION_FORM);\
+	do {\
+		REG(r) = MEM(int32_t, REG(REG_sp), READ);\
+		ARITH(REG_sp, regs[REG_sp], +, 4);\
+		r--;\
+	} while(--n);\
+}
+
+#define TB_LDB	WRITE_REG(rd, MEM(char, RS + IMM, READ));
+#define TB_LDH	WRITE_REG(rd, MEM(short, RS + IMM, READ));
+#define TB_LDW	WRITE_REG(rd, MEM(int32_t, RS + IMM, READ));
+#define TB_STB	MEM(byte, RD + IMM, WRITE) = RS;
+#define TB_STH	MEM(unsigned short, RD + IMM, WRITE) = RS;
+#define TB_STW	MEM(unsigned int, RD + IMM, WRITE) = RS;
+
+#define TB_LDI	WRITE_REG(rd, IMM);
+#define TB_LDR	WRITE_REG(rd, RS);
+
+#define TB_RET	fakePop(); TJMP_GENERIC(REG(REG_rt));
+#define TB_CALL	TCALL_RD	fakePush(REG(REG_rt), RD);
+#define TB_CALLI	TCALL_IMM	fakePush(REG(REG_rt), IMM);
+
+#define TB_JC_EQ	if (RD == RS)	{ TJMP_IMM; } TJC_NOT_TAKEN
+#define TB_JC_NE	if (RD != RS)	{ TJMP_IMM; } TJC_NOT_TAKEN
+#define TB_JC_GE	if (RD >= RS)	{ TJMP_IMM; } TJC_NOT_TAKEN
+#define TB_JC_GT	if (RD >  RS)	{ TJMP_IMM; } TJC_NOT_TAKEN
+#define TB_JC_LE	if (RD <= RS)	{ TJMP_IMM; } TJC_NOT_TAKEN
+#define TB_JC_LT	if (RD <  RS)	{ TJMP_IMM; } TJC_NOT_TAKEN
+#define TB_JC_LTU	if (RDU <  RSU)	{ TJMP_IMM; } TJC_NOT_TAKEN
+#define TB_JC_GEU	if (RDU >= RSU)	{ TJMP_IMM; } TJC_NOT_TAKEN
+#define TB_JC_GTU	if (RDU >  RSU)	{ TJMP_IMM; } TJC_NOT_TAKEN
+#define TB_JC_LEU	if (RDU <= RSU)	{ TJMP_IMM; } TJC_NOT_TAKEN
+
+#define TB_JPI	TJMP_IMM
+#define TB_JPR	TJMP_RD
+
+#define TB_XB	RD = ((RS & 0x80) == 0) ? (RS & 0xFF) : (RS | ~0xFF);
+#define TB_XH	RD = ((RS & 0x8000) == 0) ? (RS & 0xFFFF) : (RS | ~0xFFFF);
+
+#define TB_SYSCALL {\
+	fakePush((int32_t) (pc - mThreadedCode), -IMM);\
+	InvokeSysCall(IMM);\
+	fakePop();\
+	if (VM_Yield)\
+		return pc;\
+}
+
+#define TB_CASE {\
+	imm32 <<= 2;\
+	uint CaseStart = MEM(int, imm32, READ);\
+	uint CaseLength = MEM(int, imm32 + 1*sizeof(int), READ);\
+	uint index = RD - CaseStart;\
+	if(index <= CaseLength) {\
+		int tableAddress = imm32 + 3*sizeof(int);\
+		TJMP_GENERIC(MEM(int, tableAddress + index*sizeof(int), READ));\
+	} else {\
+		int DefaultCaseAddress = MEM(int, imm32 + 2*sizeof(int), READ);\
+		TJMP_GENERIC(DefaultCaseAddress);\
+	}\
+}
+
+// operands of the second half of a fused pair. pc is advanced past both.
+#define TFETCH2 rd = pc->rd2; rs = pc->rs2; imm32 = pc->imm2; pc += pc->len;
+
+#if THREADED_DISPATCH_GOTO
+#define TOPC(opcode) T_##opcode:
+#define TEOP THREADED_CHECK_SIGNAL THREADED_PROLOGUE goto *(void*)pc->handler;
+#define TREDISPATCH goto *(void*)pc->handler;
+#define THREADED_HANDLER_ADDRESS(inst) &&T_##inst,
+#define THREADED_FUSED_HANDLER_ADDRESS(a, b) &&T_F_##a##_##b,
+#define THREADED_FLOAT_HANDLER_ADDRESS(name) &&T_FI_##name,
+#else
+#define TOPC(opcode) case _##opcode:
+#define TEOP THREADED_CHECK_SIGNAL continue;
+#define TREDISPATCH goto t_redispatch;
+#endif
+
+// falls back to the syscall for division by zero.
+#define TFLOAT_HANDLER(name) TOPC(FI_##name) TFETCH\
+	if(!runFloatIntrinsic(SYSCALL_ID_##name, regs)) TB_SYSCALL TEOP;
+
+#define TFUSED_HANDLER(a, b) TOPC(F_##a##_##b)\
+	rd = pc->rd; rs = pc->rs; imm32 = pc->imm; TB_##a TFETCH2 TB_##b TEOP;
+
+ThreadedInsn* THREADED_RUN_NAME(ThreadedInsn* pc) {
+	int rd, rs;
+	uint32_t imm32;
+
+#if THREADED_DISPATCH_GOTO
+	static const void* const sHandlers[] = {
+		&&T_NUL,
+		INSTRUCTIONS(THREADED_HANDLER_ADDRESS)
+		&&T_DBG_OP,
+		&&T_TDECODE,
+		&&T_TILLEGAL,
+		FLOAT_INTRINSICS(THREADED_FLOAT_HANDLER_ADDRESS)
+		SUPERINSTRUCTIONS(THREADED_FUSED_HANDLER_ADDRESS)
+	};
+	if(pc == NULL) {
+		mThreadedHandlers = sHandlers;
+		return NULL;
+	}
+
+	VM_Yield = 0;
+	THREADED_PROLOGUE;
+	goto *(void*)pc->handler;
+	{
+#else
+	VM_Yield = 0;
+	for(;;) {
+	THREADED_PROLOGUE;
+t_redispatch:
+	switch(pc->op) {
+#endif
+		TOPC(ADD)	TFETCH	TB_ADD	TEOP;
+		TOPC(ADDI)	TFETCH	TB_ADDI	TEOP;
+		TOPC(SUB)	TFETCH	TB_SUB	TEOP;
+		TOPC(SUBI)	TFETCH	TB_SUBI	TEOP;
+		TOPC(MUL)	TFETCH	TB_MUL	TEOP;
+		TOPC(MULI)	TFETCH	TB_MULI	TEOP;
+		TOPC(AND)	TFETCH	TB_AND	TEOP;
+		TOPC(ANDI)	TFETCH	TB_ANDI	TEOP;
+		TOPC(OR)	TFETCH	TB_OR	TEOP;
+		TOPC(ORI)	TFETCH	TB_ORI	TEOP;
+		TOPC(XOR)	TFETCH	TB_XOR	TEOP;
+		TOPC(XORI)	TFETCH	TB_XORI	TEOP;
+		TOPC(DIVU)	TFETCH	TB_DIVU	TEOP;
+		TOPC(DIVUI)	TFETCH	TB_DIVUI	TEOP;
+		TOPC(DIV)	TFETCH	TB_DIV	TEOP;
+		TOPC(DIVI)	TFETCH	TB_DIVI	TEOP;
+		TOPC(SLL)	TFETCH	TB_SLL	TEOP;
+		TOPC(SLLI)	TFETCH	TB_SLLI	TEOP;
+		TOPC(SRA)	TFETCH	TB_SRA	TEOP;
+		TOPC(SRAI)	TFETCH	TB_SRAI	TEOP;
+		TOPC(SRL)	TFETCH	TB_SRL	TEOP;
+		TOPC(SRLI)	TFETCH	TB_SRLI	TEOP;
+
+		TOPC(NOT)	TFETCH	TB_NOT	TEOP;
+		TOPC(NEG)	TFETCH	TB_NEG	TEOP;
+
+		TOPC(PUSH)	TFETCH	TB_PUSH	TEOP;
+		TOPC(POP)	TFETCH	TB_POP	TEOP;
+
+		TOPC(LDB)	TFETCH	TB_LDB	TEOP;
+		TOPC(LDH)	TFETCH	TB_LDH	TEOP;
+		TOPC(LDW)	TFETCH	TB_LDW	TEOP;
+		TOPC(STB)	TFETCH	TB_STB	TEOP;
+		TOPC(STH)	TFETCH	TB_STH	TEOP;
+		TOPC(STW)	TFETCH	TB_STW	TEOP;
+
+		TOPC(LDI)	TFETCH	TB_LDI	TEOP;
+		TOPC(LDR)	TFETCH	TB_LDR	TEOP;
+
+		TOPC(RET)	TB_RET	TEOP;
+
+		TOPC(CALL)	TFETCH	TB_CALL	TEOP;
+		TOPC(CALLI)	TFETCH	TB_CALLI	TEOP;
+
+		TOPC(JC_EQ)	TFETCH	TB_JC_EQ	TEOP;
+		TOPC(JC_NE)	TFETCH	TB_JC_NE	TEOP;
+		TOPC(JC_GE)	TFETCH	TB_JC_GE	TEOP;
+		TOPC(JC_GT)	TFETCH	TB_JC_GT	TEOP;
+		TOPC(JC_LE)	TFETCH	TB_JC_LE	TEOP;
+		TOPC(JC_LT)	TFETCH	TB_JC_LT	TEOP;
+
+		TOPC(JC_LTU)	TFETCH	TB_JC_LTU	TEOP;
+		TOPC(JC_GEU)	TFETCH	TB_JC_GEU	TEOP;
+		TOPC(JC_GTU)	TFETCH	TB_JC_GTU	TEOP;
+		TOPC(JC_LEU)	TFETCH	TB_JC_LEU	TEOP;
+
+		TOPC(JPI)	TFETCH	TB_JPI	TEOP;
+		TOPC(JPR)	TFETCH	TB_JPR	TEOP;
+
+		TOPC(XB)	TFETCH	TB_XB	TEOP;
+		TOPC(XH)	TFETCH	TB_XH	TEOP;
+
+		TOPC(SYSCALL)	TFETCH	TB_SYSCALL	TEOP;
+		TOPC(CASE)	TFETCH	TB_CASE	TEOP;
+
+		FLOAT_INTRINSICS(TFLOAT_HANDLER)
+
+		SUPERINSTRUCTIONS(TFUSED_HANDLER)
+
+		TOPC(TDECODE)
+			decodeThreaded(uint(pc - mThreadedCode));
+			fuseThreaded(uint(pc - mThreadedCode));
+			TREDISPATCH;
+
+#ifdef GDB_DEBUG
+		TOPC(DBG_OP)
+			//pc stays on the breakpoint; see the DBG_OP case in core_run.h.
+			if(mGdbOn && mGdbSignal != eStep) {
+				mGdbSignal = eBreakpoint;
+			} else {
+				DEBIG_PHAT_ERROR;
+			}
+		TEOP;
+#elif THREADED_DISPATCH_GOTO
+		T_DBG_OP:
+#endif
+
+#if THREADED_DISPATCH_GOTO
+		T_NUL:
+		T_FAR:
+		T_TILLEGAL:
+#else
+		default:
+#endif
+			if(pc->rd == _FAR) {
+				LOG("Illegal far instruction 0x%02X @ 0x%04X\n", pc->rs, (int)(pc - mThreadedCode));
+			} else {
+				LOG("Illegal instruction 0x%02X @ 0x%04X\n", pc->rs, (int)(pc - mThreadedCode));
+			}
+			BIG_PHAT_ERROR(ERR_ILLEGAL_INSTRUCTION);
+	}
+#if !THREADED_DISPATCH_GOTO
+	}
+#endif
+}
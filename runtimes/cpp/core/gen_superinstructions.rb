@@ -0,0 +1,86 @@
+#!/usr/bin/ruby
+# Copyright 2013 David Axmark
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# 	http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Generates core_superinstructions.h from one or more instruction_ngrams.txt
+# files, as written by MoRE built with COUNT_INSTRUCTION_USE.
+#
+# usage: ruby gen_superinstructions.rb [-n count] ngrams.txt... > core_superinstructions.h
+
+# instructions that end a superinstruction; they can only be the second half.
+$control = %w(CALL CALLI RET JC_EQ JC_NE JC_GE JC_GEU JC_GT JC_GTU JC_LE JC_LEU
+	JC_LT JC_LTU JPI JPR SYSCALL CASE)
+
+count = 20
+files = []
+while(arg = ARGV.shift)
+	if(arg == '-n')
+		count = ARGV.shift.to_i
+	else
+		files << arg
+	end
+end
+if(files.empty?)
+	STDERR.puts "usage: ruby gen_superinstructions.rb [-n count] ngrams.txt..."
+	exit 1
+end
+
+# pairs are counted on their own, and also once for each triple they start,
+# which favours pairs that lead into longer hot sequences.
+pairs = Hash.new(0)
+files.each do |file|
+	File.open(file).each_line do |line|
+		f = line.split
+		n = f[0].to_i
+		next if(n < 2 || f.size != n + 2)
+		ops = f[1, n]
+		c = f[n + 1].to_i
+		pairs[ops[0, 2]] += c
+		if(n == 3 && !$control.include?(ops[1]))
+			pairs[ops[1, 2]] += c / 2
+		end
+	end
+end
+
+selected = pairs.select { |ops, c| !$control.include?(ops[0]) && !ops.include?('UNUSED') }
+selected = selected.sort_by { |ops, c| -c }.first(count)
+
+puts <<EOS
+/* Copyright 2013 David Axmark
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Generated by gen_superinstructions.rb from #{files.join(', ')}.
+// See core_threaded.h.
+
+#ifndef CORE_SUPERINSTRUCTIONS_H
+#define CORE_SUPERINSTRUCTIONS_H
+
+#define SUPERINSTRUCTIONS(m)\\
+EOS
+lines = selected.collect { |ops, c| "\tm(#{ops[0]}, #{ops[1]})" }
+puts lines.join("\\\n")
+puts
+puts "#endif	//CORE_SUPERINSTRUCTIONS_H"
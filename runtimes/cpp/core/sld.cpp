@@ -15,6 +15,10 @@ limitations under the License.
 
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <algorithm>
 #include <set>
 //#include <functional>
 
@@ -30,6 +34,7 @@ limitations under the License.
 #include <helpers/intutil.h>
 
 #include <demangle/demangle.h>
+#include <demangle/demangle_cache.h>
 
 #include "sld.h"
 
@@ -56,53 +61,67 @@ struct linemap_file_line_less
 	}
 };
 
+//helpers.h has a swap template of its own; this keeps std::sort from having to choose.
+static void swap(LineMapping& a, LineMapping& b) {
+	std::swap(a, b);
+}
+
 struct funcmap_start_less
-//	: public std::binary_function<FuncMapping*, FuncMapping*, bool>
+//	: public std::binary_function<FuncMapping, FuncMapping, bool>
 {
-	bool operator()(const FuncMapping* const& l, const FuncMapping* const& r) const
+	bool operator()(const FuncMapping& l, const FuncMapping& r) const
 	{
-		return l->start < r->start;
+		return l.start < r.start;
 	}
 };
 
-struct funcmap_name_less
-//	: public std::binary_function<FuncMapping*, FuncMapping*, bool>
-{
-	bool operator()(const FuncMapping* const& l, const FuncMapping* const& r) const
-	{
-		return l->name < r->name;
-	}
+struct VarMapping {
+	int scope;
+	int start;
+	String name;
 };
 
 static Vector<FileMapping> gFiles;
 
-static std::set<LineMapping> sLineSet;	//maps addresses to lines
+//maps addresses to lines. sorted by ip; each ip is unique.
+static Vector<LineMapping> sLines;
 
-//maps lines to addresses.
-//multiple addresses may map to the same line.
-//this map will only contain the first.
-typedef std::multiset<LineMapping, linemap_file_line_less> AddressSet;
-static AddressSet gAddressSet;
+//maps lines to addresses. sorted by file and line.
+//multiple addresses may map to the same line; they keep their SLD order.
+static Vector<LineMapping> sAddresses;
 
-typedef set<FuncMapping*, funcmap_start_less> FuncMapAddr;
-static FuncMapAddr sFuncMapAddr;
+//sorted by start. each start is unique.
+static Vector<FuncMapping> sFunctions;
 
-//should probably be a hash set, for fastest lookup
-typedef set<FuncMapping*, funcmap_name_less> FuncMapName;
-static FuncMapName sFuncMapName;
+//indices into sFunctions, sorted by name.
+//if several functions have the same name, only the first is here.
+static Vector<int> sFunctionNames;
 
-struct VarMapping {
-	int scope;
-	int start;
-	String name;
-};
 //TODO: make into a set, for faster lookup.
 Vector<VarMapping> gVarMap;
 
+struct funcindex_name_less {
+	bool operator()(int l, int r) const {
+		return sFunctions[l].name < sFunctions[r].name;
+	}
+};
+
+struct funcindex_name_equal {
+	bool operator()(int l, int r) const {
+		return sFunctions[l].name == sFunctions[r].name;
+	}
+};
+
+struct funcindex_name_key_less {
+	bool operator()(int l, const char* r) const {
+		return strcmp(sFunctions[l].name.c_str(), r) < 0;
+	}
+};
+
 
 class File {
 public:
-	File(const char* filename) : file(fopen(filename, "r")) {}
+	File(const char* filename, const char* mode = "r") : file(fopen(filename, mode)) {}
 	~File() {
 		if(file)
 			fclose(file);
@@ -126,17 +145,15 @@ static bool readLine(char* dst, int maxLen, File& file) {
 const FuncMapping* mapFunctionEx(int ip) {
 	FuncMapping temp;
 	temp.start = ip;
-	FuncMapAddr::const_iterator itr = sFuncMapAddr.lower_bound(&temp);
-	if(itr == sFuncMapAddr.end())
+	//the last function that starts at or before ip.
+	Vector<FuncMapping>::const_iterator itr =
+		upper_bound(sFunctions.begin(), sFunctions.end(), temp, funcmap_start_less());
+	if(itr == sFunctions.begin())
 		return NULL;
-	if((*itr)->start > ip) {
-		if(itr == sFuncMapAddr.begin())
-			return NULL;
-		itr--;
-	}
-	DEBUG_ASSERT((*itr)->start <= ip);
-	if((*itr)->stop >= ip)
-		return *itr;
+	itr--;
+	DEBUG_ASSERT(itr->start <= ip);
+	if(itr->stop >= ip)
+		return &*itr;
 	else
 		return NULL;
 }
@@ -155,24 +172,13 @@ int mapFunctionStart(int ip) {
 	return fm->start;
 }
 
-#if 0
-int mapFunction(const char* name) {
-	for(size_t i=0; i<gFuncMap.size(); i++) {
-		FuncMapping& fm(gFuncMap[i]);
-		if(strcmp(name, fm.name.c_str()) == 0)
-			return fm.start;
-	}
-	return -1;
-}
-#endif
 int mapFunction(const char* name) {
-	FuncMapping temp;
-	temp.name = name;
-	FuncMapName::const_iterator itr = sFuncMapName.find(&temp);
-	if(itr == sFuncMapName.end())
+	Vector<int>::const_iterator itr = lower_bound(sFunctionNames.begin(), sFunctionNames.end(),
+		name, funcindex_name_key_less());
+	if(itr == sFunctionNames.end() || sFunctions[*itr].name != name)
 		return -1;
 	else
-		return (*itr)->start;
+		return sFunctions[*itr].start;
 }
 
 int mapVariable(const char* name, int scope) {
@@ -187,26 +193,22 @@ int mapVariable(const char* name, int scope) {
 int nextSldEntry(int address) {
 	LineMapping key;
 	key.ip = address;
-	set<LineMapping>::iterator itr = sLineSet.find(key);
-	if(itr == sLineSet.end())
+	Vector<LineMapping>::const_iterator itr = lower_bound(sLines.begin(), sLines.end(), key);
+	if(itr == sLines.end() || itr->ip != address)
 		return -1;
 	itr++;
-	if(itr == sLineSet.end())
+	if(itr == sLines.end())
 		return -1;
 	return itr->ip;
 }
 
 void clearSLD() {
-	FuncMapAddr::iterator itr = sFuncMapAddr.begin();
-	while(itr != sFuncMapAddr.end()) {
-		delete *itr;
-		itr++;
-	}
-	sFuncMapAddr.clear();
-	sFuncMapName.clear();
-	sLineSet.clear();
-	gAddressSet.clear();
+	sFunctions.clear();
+	sFunctionNames.clear();
+	sLines.clear();
+	sAddresses.clear();
 	gFiles.clear();
+	gVarMap.clear();
 }
 
 static int fileIndexFromScope(int scope) {
@@ -217,9 +219,26 @@ static int fileIndexFromScope(int scope) {
 	return -1;
 }
 
-bool loadSLD(const char* filename) {
-	clearSLD();
+//Builds the tables that the text SLD doesn't have in order.
+static bool sortSLD() {
+	sAddresses = sLines;
+	stable_sort(sAddresses.begin(), sAddresses.end(), linemap_file_line_less());
+	sort(sLines.begin(), sLines.end());
+	for(size_t i=1; i<sLines.size(); i++) {
+		TEST(sLines[i-1].ip != sLines[i].ip);
+	}
+
+	sFunctionNames.resize(sFunctions.size());
+	for(size_t i=0; i<sFunctions.size(); i++) {
+		sFunctionNames[i] = (int)i;
+	}
+	stable_sort(sFunctionNames.begin(), sFunctionNames.end(), funcindex_name_less());
+	sFunctionNames.erase(unique(sFunctionNames.begin(), sFunctionNames.end(), funcindex_name_equal()),
+		sFunctionNames.end());
+	return true;
+}
 
+static bool parseSLD(const char* filename) {
 	File file(filename);
 	char buffer[BUFSIZE];
 
@@ -265,11 +284,9 @@ bool loadSLD(const char* filename) {
 		LineMapping m;
 		if(sscanf(buffer, "%x:%i:%" PFZT "i", &m.ip, &m.line, &m.file) != 3)
 			break;
-		std::pair<std::set<LineMapping>::iterator, bool> res = sLineSet.insert(m);
-		TEST(res.second);
-		gAddressSet.insert(m);
+		sLines.push_back(m);
 	}
-	//LOG("Found %i lines\n", gLineMap.size());
+	//LOG("Found %i lines\n", sLines.size());
 
 	//read function map
 	FAILIF(strcmp(buffer, "FUNCTIONS") != 0);
@@ -289,13 +306,26 @@ bool loadSLD(const char* filename) {
 			FAIL;
 		}
 		lastStop = fm.stop;
-		FuncMapping* fmp = new FuncMapping(fm);
+		//functions are in address order; an empty function may share its start with the next one.
+		if(!sFunctions.empty() && sFunctions.back().start == fm.start)
+			continue;
 		if(buffer[0] == '_')
-			fmp->name = buffer + 1;	//skip the extra '_'.
+			fm.mangledName = buffer + 1;	//skip the extra '_'.
 		else
-			fmp->name = buffer;
-		sFuncMapAddr.insert(fmp);
-		sFuncMapName.insert(fmp);
+			fm.mangledName = buffer;
+		sFunctions.push_back(fm);
+	}
+
+	//names that can't be demangled are kept as they are.
+	if(!sFunctions.empty()) {
+		vector<const char*> mangled(sFunctions.size()), demangled(sFunctions.size());
+		for(size_t i=0; i<sFunctions.size(); i++) {
+			mangled[i] = sFunctions[i].mangledName.c_str();
+		}
+		demangle_batch(&mangled[0], &demangled[0], (int)mangled.size(), DMGL_PARAMS);
+		for(size_t i=0; i<sFunctions.size(); i++) {
+			sFunctions[i].name = demangled[i];
+		}
 	}
 
 	//read variable map
@@ -323,12 +353,232 @@ bool loadSLD(const char* filename) {
 		}
 	}
 
-	for(FuncMapAddr::iterator itr = sFuncMapAddr.begin(); itr != sFuncMapAddr.end(); itr++) {
-		const char *mangledName = cplus_demangle_v3((*itr)->name.c_str(), DMGL_PARAMS);
-		/* Only update names that we could mangle */
-		if(mangledName != NULL) {
-			(*itr)->name = mangledName;
+	return sortSLD();
+}
+
+//The binary cache, "<sld>.cache", holds the tables exactly as they are in memory,
+//so loading it needs no parsing, sorting or demangling.
+//It is rebuilt whenever the SLD's size or modification time differs from the ones it was made from.
+//
+//All fields are native ints. After the header:
+//	files: scope, name
+//	lines: ip, line, file; in ip order.
+//	addresses: ip, line, file; in file and line order.
+//	functions: start, stop, name, mangledName; in start order.
+//	function names: function index; in name order.
+//	variables: scope, start, name
+//	strings: zero-terminated. string fields above are offsets into this block.
+#define SLD_CACHE_MAGIC 0x43444C53	//SLDC
+#define SLD_CACHE_VERSION 1
+
+struct SldCacheHeader {
+	int magic, version;
+	int sldSize, sldTimeLow, sldTimeHigh;
+	int nFiles, nLines, nFunctions, nFunctionNames, nVariables, stringSize;
+};
+
+struct SldStamp {
+	int size, timeLow, timeHigh;
+};
+
+static bool getSldStamp(const char* filename, SldStamp& stamp) {
+	struct stat st;
+	if(stat(filename, &st) != 0)
+		return false;
+	long long mtime = st.st_mtime;
+	stamp.size = (int)st.st_size;
+	stamp.timeLow = (int)mtime;
+	stamp.timeHigh = (int)(mtime >> 32);
+	return true;
+}
+
+class CacheWriter {
+public:
+	void putInt(int i) {
+		mInts.push_back(i);
+	}
+	void putString(const String& s) {
+		putInt((int)mStrings.size());
+		mStrings.insert(mStrings.end(), s.c_str(), s.c_str() + s.size() + 1);
+	}
+	void putLines(const Vector<LineMapping>& lines) {
+		for(size_t i=0; i<lines.size(); i++) {
+			putInt(lines[i].ip);
+			putInt(lines[i].line);
+			putInt((int)lines[i].file);
+		}
+	}
+	bool write(const char* filename, SldCacheHeader& h) {
+		h.stringSize = (int)mStrings.size();
+		File file(filename, "wb");
+		if(!file.file)
+			return false;
+		bool ok = fwrite(&h, sizeof(h), 1, file.file) == 1 &&
+			(mInts.empty() || fwrite(&mInts[0], mInts.size() * sizeof(int), 1, file.file) == 1) &&
+			(mStrings.empty() || fwrite(&mStrings[0], mStrings.size(), 1, file.file) == 1);
+		return ok;
+	}
+private:
+	Vector<int> mInts;
+	Vector<char> mStrings;
+};
+
+class CacheReader {
+public:
+	CacheReader(const int* ints, size_t nInts, const char* strings, size_t stringSize)
+		: mInts(ints), mEnd(ints + nInts), mStrings(strings), mStringSize(stringSize), mOk(true) {}
+	int getInt() {
+		if(mInts == mEnd) {
+			mOk = false;
+			return 0;
+		}
+		return *mInts++;
+	}
+	String getString() {
+		uint offset = getInt();
+		if(offset >= mStringSize) {
+			mOk = false;
+			return String();
 		}
+		return String(mStrings + offset);
+	}
+	void getLines(Vector<LineMapping>& lines, size_t count, size_t nFiles) {
+		lines.resize(count);
+		for(size_t i=0; i<count && mOk; i++) {
+			lines[i].ip = getInt();
+			lines[i].line = getInt();
+			lines[i].file = (uint)getInt();
+			if(lines[i].file >= nFiles)
+				mOk = false;
+		}
+	}
+	bool ok() const { return mOk && mInts == mEnd; }
+private:
+	const int* mInts;
+	const int* mEnd;
+	const char* mStrings;
+	size_t mStringSize;
+	bool mOk;
+};
+
+static bool writeSldCache(const char* cacheName, const SldStamp& stamp) {
+	CacheWriter w;
+	for(size_t i=0; i<gFiles.size(); i++) {
+		w.putInt(gFiles[i].scope);
+		w.putString(gFiles[i].name);
+	}
+	w.putLines(sLines);
+	w.putLines(sAddresses);
+	for(size_t i=0; i<sFunctions.size(); i++) {
+		const FuncMapping& fm(sFunctions[i]);
+		w.putInt(fm.start);
+		w.putInt(fm.stop);
+		w.putString(fm.name);
+		w.putString(fm.mangledName);
+	}
+	for(size_t i=0; i<sFunctionNames.size(); i++) {
+		w.putInt(sFunctionNames[i]);
+	}
+	for(size_t i=0; i<gVarMap.size(); i++) {
+		w.putInt(gVarMap[i].scope);
+		w.putInt(gVarMap[i].start);
+		w.putString(gVarMap[i].name);
+	}
+
+	SldCacheHeader h;
+	h.magic = SLD_CACHE_MAGIC;
+	h.version = SLD_CACHE_VERSION;
+	h.sldSize = stamp.size;
+	h.sldTimeLow = stamp.timeLow;
+	h.sldTimeHigh = stamp.timeHigh;
+	h.nFiles = (int)gFiles.size();
+	h.nLines = (int)sLines.size();
+	h.nFunctions = (int)sFunctions.size();
+	h.nFunctionNames = (int)sFunctionNames.size();
+	h.nVariables = (int)gVarMap.size();
+	if(!w.write(cacheName, h)) {
+		remove(cacheName);
+		return false;
+	}
+	return true;
+}
+
+//Returns false if the cache is missing, stale or broken. The tables may then be partly filled.
+static bool readSldCache(const char* cacheName, const SldStamp& stamp) {
+	File file(cacheName, "rb");
+	if(!file.file)
+		return false;
+	SldCacheHeader h;
+	if(fread(&h, sizeof(h), 1, file.file) != 1)
+		return false;
+	if(h.magic != SLD_CACHE_MAGIC || h.version != SLD_CACHE_VERSION ||
+		h.sldSize != stamp.size || h.sldTimeLow != stamp.timeLow || h.sldTimeHigh != stamp.timeHigh)
+		return false;
+	if(h.nFiles < 0 || h.nLines < 0 || h.nFunctions < 0 || h.nFunctionNames < 0 ||
+		h.nVariables < 0 || h.stringSize < 0)
+		return false;
+
+	size_t nInts = (size_t)h.nFiles * 2 + (size_t)h.nLines * 6 + (size_t)h.nFunctions * 4 +
+		(size_t)h.nFunctionNames + (size_t)h.nVariables * 3;
+	//the whole file in one read. not mapped: every table is copied into Vectors and Strings
+	//anyway, and sld.cpp is also built on Windows.
+	Vector<int> data(nInts + (h.stringSize + sizeof(int) - 1) / sizeof(int) + 1);
+	size_t size = nInts * sizeof(int) + h.stringSize;
+	if(size != 0 && fread(&data[0], size, 1, file.file) != 1)
+		return false;
+	if(fgetc(file.file) != EOF)
+		return false;
+	const char* strings = (char*)&data[nInts];
+	if(h.stringSize != 0 && strings[h.stringSize - 1] != 0)
+		return false;
+
+	CacheReader r(&data[0], nInts, strings, h.stringSize);
+	gFiles.resize(h.nFiles);
+	for(int i=0; i<h.nFiles; i++) {
+		gFiles[i].scope = r.getInt();
+		gFiles[i].name = r.getString();
+	}
+	r.getLines(sLines, h.nLines, h.nFiles);
+	r.getLines(sAddresses, h.nLines, h.nFiles);
+	sFunctions.resize(h.nFunctions);
+	for(int i=0; i<h.nFunctions; i++) {
+		FuncMapping& fm(sFunctions[i]);
+		fm.start = r.getInt();
+		fm.stop = r.getInt();
+		fm.name = r.getString();
+		fm.mangledName = r.getString();
+	}
+	sFunctionNames.resize(h.nFunctionNames);
+	for(int i=0; i<h.nFunctionNames; i++) {
+		sFunctionNames[i] = r.getInt();
+		if((uint)sFunctionNames[i] >= (uint)h.nFunctions)
+			return false;
+	}
+	gVarMap.resize(h.nVariables);
+	for(int i=0; i<h.nVariables; i++) {
+		gVarMap[i].scope = r.getInt();
+		gVarMap[i].start = r.getInt();
+		gVarMap[i].name = r.getString();
+	}
+	return r.ok();
+}
+
+bool loadSLD(const char* filename) {
+	clearSLD();
+
+	SldStamp stamp = { 0, 0, 0 };
+	bool haveStamp = getSldStamp(filename, stamp);
+	String cacheName = String(filename) + ".cache";
+	if(haveStamp) {
+		if(readSldCache(cacheName.c_str(), stamp))
+			return true;
+		clearSLD();
+	}
+
+	if(!parseSLD(filename))
+		return false;
+	if(haveStamp && !writeSldCache(cacheName.c_str(), stamp)) {
+		LOG("Could not write %s\n", cacheName.c_str());
 	}
 	return true;
 }
@@ -337,17 +587,10 @@ bool mapIpEx(int inIp, LineMapping& lm) {
 	//find mapping with ip equal to or less than inIp.
 	LineMapping key;
 	key.ip = inIp;
-	set<LineMapping>::const_iterator itr = sLineSet.lower_bound(key);
-	//lower_bound returns >=, instead of <=. So we do this:
-	if(itr == sLineSet.end()) {
-		if(sLineSet.empty())
-			return false;
-		itr--;
-	} else if(itr->ip > inIp) {
-		itr--;
-		if(itr == sLineSet.begin())
-			return false;
-	}
+	Vector<LineMapping>::const_iterator itr = upper_bound(sLines.begin(), sLines.end(), key);
+	if(itr == sLines.begin())
+		return false;
+	itr--;
 
 	lm = *itr;
 	return true;
@@ -378,7 +621,7 @@ const char* getMapFileLineError(int ret) {
 }
 
 int mapFileLine(const char* filename, int lineNumber, vector<int>& addresses) {
-	if(gAddressSet.size() == 0 || gFiles.size() == 0) {
+	if(sAddresses.size() == 0 || gFiles.size() == 0) {
 		return ERR_NOMAP;
 	}
 	size_t fileIndex;
@@ -393,23 +636,24 @@ int mapFileLine(const char* filename, int lineNumber, vector<int>& addresses) {
 	lm.file = fileIndex;
 	lm.line = lineNumber;
 
-	AddressSet::const_iterator itr = gAddressSet.lower_bound(lm);
+	Vector<LineMapping>::const_iterator itr =
+		lower_bound(sAddresses.begin(), sAddresses.end(), lm, linemap_file_line_less());
 
 	addresses.clear();
 
 	set<int> foundFunctions;
 
 	// find first valid line
-	while(itr!=gAddressSet.end() && itr->file==fileIndex && itr->line<lineNumber) {
+	while(itr!=sAddresses.end() && itr->file==fileIndex && itr->line<lineNumber) {
 		itr++;
 	}
-	if(itr==gAddressSet.end()) {
+	if(itr==sAddresses.end()) {
 		return ERR_NOLINE;
 	}
 
 	lineNumber = itr->line;
 
-	while(itr!=gAddressSet.end() && itr->file==fileIndex && itr->line==lineNumber) {
+	while(itr!=sAddresses.end() && itr->file==fileIndex && itr->line==lineNumber) {
 		const FuncMapping* fm = mapFunctionEx(itr->ip);
 		if(foundFunctions.find(fm->start) == foundFunctions.end()) {
 			addresses.push_back(itr->ip);
@@ -34,6 +34,8 @@ bool loadFunctionMap(const char* filename);
 void clearFunctionMap();
 #endif
 
+//Also writes a binary copy of the tables to "<filename>.cache", and loads that instead
+//of parsing the text file for as long as the file's size and modification time stay the same.
 bool loadSLD(const char* filename);
 void clearSLD();
 
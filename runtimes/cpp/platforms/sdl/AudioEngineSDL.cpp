@@ -26,6 +26,7 @@ limitations under the License.
 #include "SDLSoundAudioSource.h"
 #endif
 #include "sdl_stream.h"
+#include "TimelineTrace.h"
 
 #define DEFAULT_AUDIOBUF_SAMPLES 1024*4
 #define MY_SAMPLE_RATE 44100
@@ -43,6 +44,10 @@ namespace AudioEngine {
 
 	static void soundCallback(void *userdata, Uint8 *buf,int len) {
 		//MutexHandler m(&gMutex);
+#ifdef TIMELINE_TRACE
+		TimelineTrace::nameThread("SDL audio");
+#endif
+		TRACE_SPAN_ARG("soundCallback", "audio", "bytes", len);
 
 		int numSamples = len>>2;
 		memset(gTempBuffer, 0, DEFAULT_AUDIOBUF_SAMPLES*2*sizeof(Uint32));
@@ -34,7 +34,14 @@ limitations under the License.
 #include <core/sld.h>
 #include <core/extensions.h>
 #include <base/Syscall.h>
+#include <base/TimelineTrace.h>
 #include <helpers/helpers.h>
+#ifdef VM_SNAPSHOTS
+#include <helpers/TranslateSyscall.h>
+#endif
+#if defined(SYSCALL_STATISTICS) && !defined(WIN32)
+#include <signal.h>
+#endif
 
 #include "../sdl_syscall.h"
 #include "../report.h"
@@ -54,10 +61,24 @@ static int gReloadHandle = 0;
 
 struct ReloadException { ReloadException() {} };
 
+//The atexit handlers run on the thread that calls exit(), which may be one of
+//SDL's timer threads, where the thread-local gCore is NULL.
+//This points to the VM thread's gCore, which follows reloads.
+static Core::VMCore** gExitCore = NULL;
+
 static void DeleteCore() {
-	Core::DeleteCore(gCore);
+	if(gExitCore == NULL)
+		return;
+	Core::DeleteCore(*gExitCore);
+	*gExitCore = NULL;
 }
 
+#if defined(SYSCALL_STATISTICS) && !defined(WIN32)
+static void dumpSyscallStats(int) {
+	Core::RequestSyscallStatsDump();
+}
+#endif
+
 int main2(int argc, char **argv);
 
 #if defined(WIN32) && !defined(_MSC_VER)
@@ -100,6 +121,32 @@ int main2(int argc, char **argv) {
 #ifdef GDB_DEBUG
 	bool gdb = false;
 #endif
+#ifdef VM_SNAPSHOTS
+	const char* snapshotFile = NULL;
+	const char* snapshotSyscall = "maWait";
+#endif
+#ifdef SAMPLING_PROFILER
+	const char* profileFile = NULL;
+	int profileInterval = 1;
+#endif
+#ifdef SYSCALL_STATISTICS
+	const char* syscallStatsFile = NULL;
+	bool syscallStatsTimed = true;
+#endif
+#ifdef VM_STATISTICS
+	const char* vmStatsFile = NULL;
+	int vmStatsInterval = 0;
+#endif
+#ifdef TIMELINE_TRACE
+	const char* traceFile = NULL;
+#endif
+#ifdef BLOCK_PROFILING
+	const char* blockProfileFile = NULL;
+#endif
+#ifdef SYSCALL_RECORDING
+	const char* recordFile = NULL;
+	const char* replayFile = NULL;
+#endif
 #ifdef EMULATOR
 	bool allowDivZero = false;
 #endif
@@ -141,6 +188,41 @@ int main2(int argc, char **argv) {
 				"  -resmem <bytes:integer>                set resource memory limit.\n"
 				"  -gdb                                   start gdb stub.\n"
 				"  -x <filename:string>                   load extension config file.\n"
+#ifdef VM_SNAPSHOTS
+				"  -snapshot <filename:string>            start from this snapshot. if it doesn't exist or is out of date,\n"
+				"                                         start normally and write it at the first call to the -snapshot-at syscall.\n"
+				"  -snapshot-at <syscall:string>          syscall that marks the end of initialization (default: maWait).\n"
+#endif
+#ifdef SAMPLING_PROFILER
+				"  -profile <filename:string>             sample the program and write <filename>.folded and <filename>.pb on exit.\n"
+				"  -profile-interval <ms:integer>         time between samples (default: 1).\n"
+#endif
+#ifdef SYSCALL_STATISTICS
+				"  -syscall-stats <filename:string>       count calls to each syscall and the time spent in them,\n"
+				"                                         and write the counters to <filename> on exit"
+#ifndef WIN32
+				" and on SIGUSR1"
+#endif
+				".\n"
+				"  -syscall-stats-untimed                 only count calls; don't time them.\n"
+#endif
+#ifdef VM_STATISTICS
+				"  -vm-stats <filename:string>            append the VM's counters to <filename> as JSON lines, at each\n"
+				"                                         maUpdateScreen and on exit.\n"
+				"  -vm-stats-interval <ms:integer>        write at most one line per interval (default: 0, every frame).\n"
+#endif
+#ifdef TIMELINE_TRACE
+				"  -trace <filename:string>               write a timeline of every thread to <filename> on exit,\n"
+				"                                         as Chrome trace events.\n"
+#endif
+#ifdef BLOCK_PROFILING
+				"  -block-profile <filename:string>       write basic-block execution counts, by address and by source line, on exit.\n"
+#endif
+#ifdef SYSCALL_RECORDING
+				"  -record <filename:string>              record time, input, events, file and network results to <filename>.\n"
+				"  -replay <filename:string>              run the program on the results recorded in <filename>, without\n"
+				"                                         a display, sound, files or network. exits when the log ends.\n"
+#endif
 #ifdef EMULATOR
 				"  -allowdivzero                          allow floating-point division by zero. this produces ieee standard results.\n"
 				"  -timeout <seconds:integer>             close the program if it runs longer than the timeout.\n"
@@ -249,6 +331,99 @@ int main2(int argc, char **argv) {
 		} else if(strcmp(argv[i], "-gdb")==0) {
 			gdb = true;
 #endif
+#ifdef VM_SNAPSHOTS
+		} else if(strcmp(argv[i], "-snapshot")==0) {
+			i++;
+			if(i>=argc) {
+				LOG("not enough parameters for -snapshot");
+				return 1;
+			}
+			snapshotFile = argv[i];
+		} else if(strcmp(argv[i], "-snapshot-at")==0) {
+			i++;
+			if(i>=argc) {
+				LOG("not enough parameters for -snapshot-at");
+				return 1;
+			}
+			snapshotSyscall = argv[i];
+#endif
+#ifdef SAMPLING_PROFILER
+		} else if(strcmp(argv[i], "-profile")==0) {
+			i++;
+			if(i>=argc) {
+				LOG("not enough parameters for -profile");
+				return 1;
+			}
+			profileFile = argv[i];
+		} else if(strcmp(argv[i], "-profile-interval")==0) {
+			i++;
+			if(i>=argc) {
+				LOG("not enough parameters for -profile-interval");
+				return 1;
+			}
+			profileInterval = atoi(argv[i]);
+#endif
+#ifdef SYSCALL_STATISTICS
+		} else if(strcmp(argv[i], "-syscall-stats")==0) {
+			i++;
+			if(i>=argc) {
+				LOG("not enough parameters for -syscall-stats");
+				return 1;
+			}
+			syscallStatsFile = argv[i];
+		} else if(strcmp(argv[i], "-syscall-stats-untimed")==0) {
+			syscallStatsTimed = false;
+#endif
+#ifdef VM_STATISTICS
+		} else if(strcmp(argv[i], "-vm-stats")==0) {
+			i++;
+			if(i>=argc) {
+				LOG("not enough parameters for -vm-stats");
+				return 1;
+			}
+			vmStatsFile = argv[i];
+		} else if(strcmp(argv[i], "-vm-stats-interval")==0) {
+			i++;
+			if(i>=argc) {
+				LOG("not enough parameters for -vm-stats-interval");
+				return 1;
+			}
+			vmStatsInterval = atoi(argv[i]);
+#endif
+#ifdef TIMELINE_TRACE
+		} else if(strcmp(argv[i], "-trace")==0) {
+			i++;
+			if(i>=argc) {
+				LOG("not enough parameters for -trace");
+				return 1;
+			}
+			traceFile = argv[i];
+#endif
+#ifdef BLOCK_PROFILING
+		} else if(strcmp(argv[i], "-block-profile")==0) {
+			i++;
+			if(i>=argc) {
+				LOG("not enough parameters for -block-profile");
+				return 1;
+			}
+			blockProfileFile = argv[i];
+#endif
+#ifdef SYSCALL_RECORDING
+		} else if(strcmp(argv[i], "-record")==0) {
+			i++;
+			if(i>=argc) {
+				LOG("not enough parameters for -record");
+				return 1;
+			}
+			recordFile = argv[i];
+		} else if(strcmp(argv[i], "-replay")==0) {
+			i++;
+			if(i>=argc) {
+				LOG("not enough parameters for -replay");
+				return 1;
+			}
+			replayFile = argv[i];
+#endif
 #ifdef EMULATOR
 		} else if(strcmp(argv[i], "-allowdivzero")==0) {
 			allowDivZero = true;
@@ -270,6 +445,16 @@ int main2(int argc, char **argv) {
 	InitLog();
 #endif
 
+#ifdef TIMELINE_TRACE
+	//before the Syscall, so that the resources are in the timeline.
+	if(traceFile) {
+		if(!TimelineTrace::start(traceFile))
+			return 1;
+		TimelineTrace::nameThread("VM");
+		atexit(TimelineTrace::stop);
+	}
+#endif
+
 #ifdef FAKE_CALL_STACK
 	if(sldFile != NULL) {
 		MYASSERT(loadSLD(sldFile), ERR_SLD_LOAD_FAILED);
@@ -278,6 +463,20 @@ int main2(int argc, char **argv) {
 
 	Base::Syscall *syscall;
 
+#ifdef SYSCALL_RECORDING
+	if(recordFile && replayFile) {
+		LOG("-record and -replay can't be used together\n");
+		return 1;
+	}
+	//replay doesn't need a window or sound. SDL reads these when it is initialized.
+	if(replayFile) {
+		if(!getenv("SDL_VIDEODRIVER"))
+			putenv((char*)"SDL_VIDEODRIVER=dummy");
+		if(!getenv("SDL_AUDIODRIVER"))
+			putenv((char*)"SDL_AUDIODRIVER=dummy");
+	}
+#endif
+
 #ifdef __USE_FULLSCREEN__
         settings.haveSkin = false;
 #endif
@@ -302,10 +501,66 @@ int main2(int argc, char **argv) {
 		loadExtensions(xFile);
 	}
 
+#ifdef VM_SNAPSHOTS
+	if(snapshotFile) {
+		if(!Core::LoadSnapshot(gCore, snapshotFile)) {
+			int id = 1;
+			const char* name;
+			while((name = translateSyscall(id)) != NULL && strcmp(name, snapshotSyscall) != 0)
+				id++;
+			if(name == NULL) {
+				LOG("unknown syscall: \"%s\"\n", snapshotSyscall);
+				return 1;
+			}
+			Core::SetSnapshotTrigger(gCore, snapshotFile, id);
+		}
+	}
+#endif
+
+#ifdef SAMPLING_PROFILER
+	if(profileFile) {
+		Core::StartSampling(gCore, profileFile, profileInterval);
+	}
+#endif
+
+#ifdef SYSCALL_STATISTICS
+	if(syscallStatsFile) {
+		Core::StartSyscallStats(gCore, syscallStatsTimed, syscallStatsFile);
+#ifndef WIN32
+		signal(SIGUSR1, dumpSyscallStats);
+#endif
+	}
+#endif
+
+#ifdef VM_STATISTICS
+	if(vmStatsFile) {
+		if(!Core::StartStatisticsDump(gCore, vmStatsFile, vmStatsInterval))
+			return 1;
+	}
+#endif
+
+#ifdef BLOCK_PROFILING
+	if(blockProfileFile) {
+		Core::SetBlockProfileFile(gCore, blockProfileFile);
+	}
+#endif
+
+#ifdef SYSCALL_RECORDING
+	if(recordFile) {
+		if(!Core::StartSyscallRecording(gCore, recordFile))
+			return 1;
+	}
+	if(replayFile) {
+		if(!Core::StartSyscallReplay(gCore, replayFile))
+			return 1;
+	}
+#endif
+
 #ifdef ENABLE_DEBUGGER
 	Core::initDebugger(gCore, 4711);
 	atexit(Core::closeDebugger);
 #endif
+	gExitCore = &gCore;
 	atexit(DeleteCore);
 
 	while(1) {
@@ -368,6 +623,17 @@ void MoSyncError::addRuntimeSpecificPanicInfo(char* ptr, bool newLines) {
 	} else {
 		ptr += sprintf(ptr, "MoSync core.");
 	}
+#ifdef FAKE_CALL_STACK
+	int line;
+	std::string file;
+	if(gCore != NULL && mapIp(Core::GetIp(gCore), line, file)) {
+		//the panic buffers are small; keep the end of the path.
+		const char* fileName = file.c_str();
+		if(file.size() > 80)
+			fileName += file.size() - 80;
+		ptr += sprintf(ptr, " IP: %s:%i.", fileName, line);
+	}
+#endif
 	if(newLines)
 		ptr += sprintf(ptr, "\n");
 }
@@ -378,8 +644,9 @@ void Base::reportCallStack() {
 	if(gCore == NULL)
 		return;
 	maDumpCallStackEx("reportCallStack", 0);
-	report(REPORT_CALL_STACK, Core::GetFakeCallStack(gCore),
-		Core::GetFakeCallStackDepth(gCore) << 2);
+	int frames[FAKE_CALL_STACK_SIZE];
+	int n = Core::GetFakeCallStack(gCore, frames, FAKE_CALL_STACK_SIZE);
+	report(REPORT_CALL_STACK, frames, n << 2);
 }
 
 int Base::maDumpCallStackEx(const char* str, int data) {
@@ -388,9 +655,13 @@ int Base::maDumpCallStackEx(const char* str, int data) {
 	LOG("DumpCallStackEx:\n%s\n%i\n", str, data);
 	LOG("IP: 0x%x\n", Core::GetIp(gCore));
 	int depth = Core::GetFakeCallStackDepth(gCore);
-	LOG("Call stack: %i frames\n", depth);
-	const int* fcs = Core::GetFakeCallStack(gCore);
-	for(int i=0; i<depth; i++) {
+	int fcs[FAKE_CALL_STACK_SIZE];
+	int n = Core::GetFakeCallStack(gCore, fcs, FAKE_CALL_STACK_SIZE);
+	if(n < depth)
+		LOG("Call stack: %i frames, of which the innermost %i are kept\n", depth, n);
+	else
+		LOG("Call stack: %i frames\n", depth);
+	for(int i=0; i<n; i++) {
 		//todo: translate
 		int ip = fcs[i];
 		int line;
@@ -405,6 +676,42 @@ int Base::maDumpCallStackEx(const char* str, int data) {
 	return 0;
 }
 
+static void appendFrame(std::string& out, int index, int ip) {
+	char buf[64];
+	sprintf(buf, "#%i 0x%x", index, ip);
+	out += buf;
+	const char* func = mapFunction(ip);
+	if(func) {
+		out += " ";
+		out += func;
+	}
+	int line;
+	std::string file;
+	if(mapIp(ip, line, file)) {
+		sprintf(buf, ":%i", line);
+		out += " (" + file + buf + ")";
+	}
+	out += "\n";
+}
+
+void Base::getCallStackString(std::string& out) {
+	if(gCore == NULL)
+		return;
+	int depth = Core::GetFakeCallStackDepth(gCore);
+	int frames[FAKE_CALL_STACK_SIZE];
+	int n = Core::GetFakeCallStack(gCore, frames, FAKE_CALL_STACK_SIZE);
+	appendFrame(out, 0, Core::GetIp(gCore));
+	for(int i=0; i<n; i++) {
+		//return addresses point after the call; step back into it.
+		appendFrame(out, i + 1, frames[n - 1 - i] - 1);
+	}
+	if(n < depth) {
+		char buf[64];
+		sprintf(buf, "(%i outer frames not kept)\n", depth - n);
+		out += buf;
+	}
+}
+
 #endif
 
 #if 0//def INSTRUCTION_PROFILING
@@ -449,6 +756,24 @@ int Base::getRuntimeIp() {
 	return -1;
 }
 
+struct RuntimeThread {
+	Core::VMCore** core;	//the core is replaced on reload
+	Base::Syscall* syscall;
+};
+static RuntimeThread gRuntimeThread;
+
+void* Base::captureRuntimeThread() {
+	gRuntimeThread.core = &gCore;
+	gRuntimeThread.syscall = Base::gSyscall;
+	return &gRuntimeThread;
+}
+
+void Base::enterRuntimeThread(void* runtimeThread) {
+	const RuntimeThread* rt = (const RuntimeThread*)runtimeThread;
+	gCore = *rt->core;
+	Base::gSyscall = rt->syscall;
+}
+
 #if 0
 extern "C" const char* FileNameFromPath(const char* path) {
 	const char* ptr = strrchr(path, '\\');
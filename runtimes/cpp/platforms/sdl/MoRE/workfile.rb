@@ -15,8 +15,17 @@ work.instance_eval do
 	@IGNORED_FILES = ["debugger.cpp"]
 	@EXTRA_SOURCEFILES = ["#{BD}/runtimes/cpp/core/Core.cpp",
 		"#{BD}/runtimes/cpp/core/sld.cpp",
+		"#{BD}/runtimes/cpp/core/SamplingProfiler.cpp",
+		"#{BD}/runtimes/cpp/core/BlockProfile.cpp",
+		"#{BD}/runtimes/cpp/core/SyscallStats.cpp",
+		"#{BD}/runtimes/cpp/core/SyscallLog.cpp",
+		"#{BD}/runtimes/cpp/core/VMStatistics.cpp",
+		"#{BD}/runtimes/cpp/core/MappedSegment.cpp",
 		"#{BD}/runtimes/cpp/core/GdbStub.cpp",
 		"#{BD}/runtimes/cpp/core/extensions.cpp",
+		"#{BD}/runtimes/cpp/core/disassembler.cpp",
+		"#{BD}/runtimes/cpp/core/Recompiler/X64Assembler.cpp",
+		"#{BD}/runtimes/cpp/core/Recompiler/X64Recompiler.cpp",
 		"#{BD}/intlibs/helpers/intutil.cpp",
 		]
 	@EXTRA_INCLUDES += ["../../.."]
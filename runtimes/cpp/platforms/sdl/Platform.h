@@ -43,4 +43,11 @@ namespace Core {
 #define VSV_ARGPTR_DECL , va_list argptr
 #define VSV_ARGPTR_USE , argptr
 
+#ifdef THREAD_LOCAL_VM
+#include <helpers/attribute.h>
+#define VM_THREAD_LOCAL THREAD_LOCAL
+#else
+#define VM_THREAD_LOCAL
+#endif
+
 #endif
@@ -84,6 +84,7 @@ extern "C" {
 #endif
 #include "report.h"
 #include "TcpConnection.h"
+#include "TimelineTrace.h"
 #include "ConfigParser.h"
 #include "sdl_stream.h"
 #include "MoSyncDB.h"
@@ -105,7 +106,7 @@ namespace Base {
 	//Defines and declarations
 	//***************************************************************************
 
-	Syscall* gSyscall = NULL;
+	VM_THREAD_LOCAL Syscall* gSyscall = NULL;
 	bool gReload = false;
 
 #ifndef __USE_FULLSCREEN__
@@ -326,7 +327,8 @@ namespace Base {
 
 
 #ifdef EMULATOR
-	static Uint32 GCCATTRIB(noreturn) SDLCALL TimeoutCallback(Uint32 interval, void*) {
+	static Uint32 GCCATTRIB(noreturn) SDLCALL TimeoutCallback(Uint32 interval, void* runtimeThread) {
+		enterRuntimeThread(runtimeThread);
 		LOG("TimeoutCallback %i\n", interval);
 		MoSyncErrorExit(2);
 	}
@@ -485,7 +487,7 @@ namespace Base {
 
 #ifdef EMULATOR
 		if(settings.timeout != 0) {
-			DEBUG_ASSERT(NULL != SDL_AddTimer(settings.timeout * 1000, TimeoutCallback, NULL));
+			DEBUG_ASSERT(NULL != SDL_AddTimer(settings.timeout * 1000, TimeoutCallback, captureRuntimeThread()));
 		}
 #endif
 
@@ -554,6 +556,7 @@ namespace Base {
 	SDL_Surface* Syscall::loadImage(MemStream& s) {
 		int size;
 		TEST(s.length(size));
+		TRACE_SPAN_ARG("loadImage", "resources", "size", size);
 		SDL_RWops* rwops = SDL_RWFromConstMem(s.ptr(), size);
 		//SDL_Surface* surf = IMG_LoadPNG_RW(rwops);
 		//if(!surf) IMG_LoadJPG_RW(rwops);
@@ -565,6 +568,48 @@ namespace Base {
 		return surf;
 	}
 
+#ifdef VM_SNAPSHOTS
+	bool Syscall::saveImageSnapshot(Stream& out, SDL_Surface* image) {
+		const SDL_PixelFormat* fmt = image->format;
+		if(fmt->palette) {
+			LOG("Snapshot: paletted images can't be saved.\n");
+			FAIL;
+		}
+		Uint32 header[] = { image->w, image->h, fmt->BitsPerPixel, image->flags & SDL_SRCALPHA,
+			fmt->Rmask, fmt->Gmask, fmt->Bmask, fmt->Amask };
+		TEST(out.write(header, sizeof(header)));
+		TEST(SDL_LockSurface(image) == 0);
+		bool ok = true;
+		for(int y=0; y<image->h && ok; y++) {
+			ok = out.write((byte*)image->pixels + y * image->pitch, image->w * fmt->BytesPerPixel);
+		}
+		SDL_UnlockSurface(image);
+		return ok;
+	}
+
+	SDL_Surface* Syscall::loadImageSnapshot(Stream& in) {
+		Uint32 header[8];
+		TEST(in.read(header, sizeof(header)));
+		SDL_Surface* image = SDL_CreateRGBSurface(SDL_SWSURFACE | header[3], header[0], header[1],
+			header[2], header[4], header[5], header[6], header[7]);
+		TEST(image);
+		if(SDL_LockSurface(image) != 0) {
+			SDL_FreeSurface(image);
+			FAIL;
+		}
+		bool ok = true;
+		for(int y=0; y<image->h && ok; y++) {
+			ok = in.read((byte*)image->pixels + y * image->pitch, image->w * image->format->BytesPerPixel);
+		}
+		SDL_UnlockSurface(image);
+		if(!ok) {
+			SDL_FreeSurface(image);
+			FAIL;
+		}
+		return image;
+	}
+#endif	//VM_SNAPSHOTS
+
 	SDL_Surface* Syscall::loadSprite(SDL_Surface* surface, ushort left, ushort top, ushort width, ushort height, ushort cx, ushort cy) {
 		SDL_Surface* surf = SDL_CreateRGBSurface(SDL_SWSURFACE, surface->w, surface->h, surface->format->BitsPerPixel,
 			surface->format->Rmask, surface->format->Gmask, surface->format->Bmask, surface->format->Amask);
@@ -674,6 +719,29 @@ namespace Base {
 		pr.ip = Base::getRuntimeIp();
 	}
 
+	//Writes panic.report. The report's string is message, followed by the
+	//symbolized call stack, if there is one, as a second null-terminated string.
+	static void writePanicReport(int reportType, int code, const char* message) {
+		std::string text(message);
+#ifdef FAKE_CALL_STACK
+		std::string stack;
+		getCallStackString(stack);
+		if(!stack.empty()) {
+			LOG("Call stack:\n%s", stack.c_str());
+			text += '\0';
+			text += stack;
+		}
+#endif
+		int buflen = sizeof(MAPanicReport) + text.length();
+		Smartie<char> buffer(new char[buflen]);
+		MAPanicReport& pr(*(MAPanicReport*)buffer());
+		fillPanicReport(pr, reportType);
+		pr.code = code;
+		memcpy(pr.string, text.c_str(), text.length() + 1);
+		WriteFileStream file("panic.report");
+		file.write(buffer(), buflen);
+	}
+
 	static void MoSyncMessageBox(const char* msg, const char* title) {
 		if(!gShowScreen)
 			return;
@@ -790,6 +858,9 @@ namespace Base {
 					gEventOverflow = true;
 					gEventFifo.clear();
 					LOG("EventBuffer overflow!\n");
+#ifdef VM_STATISTICS
+					gSyscall->statistics.eventOverflows++;
+#endif
 				}
 				MAEvent event;
 				event.type = type;
@@ -806,6 +877,9 @@ namespace Base {
 				gEventOverflow = true;
 				gEventFifo.clear();
 				LOG("EventBuffer overflow!\n");
+#ifdef VM_STATISTICS
+				gSyscall->statistics.eventOverflows++;
+#endif
 			}
 			MAEvent event;
 			event.type = pressed ? EVENT_TYPE_KEY_PRESSED : EVENT_TYPE_KEY_RELEASED;
@@ -844,7 +918,8 @@ namespace Base {
 		gEventFifo.put(event);
 	}
 
-	static Uint32 GCCATTRIB(noreturn) SDLCALL ExitCallback(Uint32 interval, void*) {
+	static Uint32 GCCATTRIB(noreturn) SDLCALL ExitCallback(Uint32 interval, void* runtimeThread) {
+		enterRuntimeThread(runtimeThread);
 		LOG("ExitCallback %i\n", interval);
 
 		{	//dump panic report
@@ -884,7 +959,7 @@ namespace Base {
 		MAEvent event;
 		event.type = EVENT_TYPE_CLOSE;
 		gEventFifo.put(event);
-		gExitTimer = SDL_AddTimer(EVENT_CLOSE_TIMEOUT, ExitCallback, NULL);
+		gExitTimer = SDL_AddTimer(EVENT_CLOSE_TIMEOUT, ExitCallback, captureRuntimeThread());
 		DEBUG_ASSERT(NULL != gExitTimer);
 	}
 
@@ -927,6 +1002,7 @@ namespace Base {
 #endif
 
 		while((PollEventResult = FE_PollEvent(&event)) > 0) {
+			TRACE_SPAN_ARG("event", "events", "type", event.type);
 			switch(event.type) {
 			case SDL_ACTIVEEVENT:
 				LOGDT("SDL_ACTIVEEVENT");
@@ -1211,6 +1287,7 @@ namespace Base {
 
 	SYSCALL(void, maUpdateScreen()) {
 		LOGG("maUpdateScreen()\n");
+		TRACE_SPAN("maUpdateScreen", "graphics");
 		if(gClosing)
 			return;
 		MAUpdateScreen();
@@ -1619,12 +1696,19 @@ namespace Base {
 
 	SYSCALL(void, maWait(int timeout)) {
 		LOGD("maWait %i\n", timeout);
+		TRACE_SPAN_ARG("maWait", "vm", "timeout", timeout);
+#ifdef VM_STATISTICS
+		gSyscall->statistics.waits++;
+#endif
 		if(gClosing)
 			return;
 
 		if(gEventFifo.count() != 0)
 			return;
 
+#ifdef VM_STATISTICS
+		Uint32 waitStart = SDL_GetTicks();
+#endif
 		DEBUG_ASSERT(gTimerId == NULL);
 		if(timeout > 0) {
 			//LOGD("Setting timer sequence %i\n", gTimerSequence);
@@ -1653,6 +1737,9 @@ namespace Base {
 			gTimerSequence++;
 		}
 		DEBUG_ASRTZERO(SDL_UnlockMutex(gTimerMutex));
+#ifdef VM_STATISTICS
+		gSyscall->statistics.waitTime += SDL_GetTicks() - waitStart;
+#endif
 	}
 
 	SYSCALL(int, maTime()) {
@@ -2086,6 +2173,13 @@ namespace Base {
 			return SYSCALL_THIS->getMemoryProtection();
 #endif
 
+#ifdef VM_STATISTICS
+		case maIOCtl_maGetVMStatistics:
+			return SYSCALL_THIS->getVMStatistics(GVMRA(MAVMStatistics));
+		case maIOCtl_maGetSyscallCount:
+			return SYSCALL_THIS->getSyscallCount(a);
+#endif
+
 #ifdef LOGGING_ENABLED
 		case maIOCtl_maWriteLog:
 			{
@@ -2620,17 +2714,7 @@ namespace Base {
 		std::string s = "User Panic: \""+msg+"\"";
 		report(REPORT_EXIT_STRING, s.c_str(), s.length());
 
-		{	//dump panic report
-			int buflen = sizeof(MAPanicReport) + msg.length();
-			Smartie<char> buffer(new char[buflen]);
-			MAPanicReport& pr(*(MAPanicReport*)buffer());
-			fillPanicReport(pr, REPORT_USER_PANIC);
-			pr.code = result;
-			strcpy(pr.string, msg.c_str());
-			DEBUG_ASSERT(strlen(pr.string) == msg.length());
-			WriteFileStream file("panic.report");
-			file.write(buffer(), buflen);
-		}
+		writePanicReport(REPORT_USER_PANIC, result, message);
 
 		if(!gReload) {
 #ifdef __USE_FULLSCREEN__
@@ -2783,13 +2867,7 @@ void MoSyncErrorExit(int errorCode) {
 #endif
 	LOG("%s", buffer);
 
-	{	//dump panic report
-		MAPanicReport pr;
-		fillPanicReport(pr, REPORT_PANIC);
-		pr.code = errorCode;
-		WriteFileStream file("panic.report");
-		file.write(&pr, sizeof(pr));
-	}
+	writePanicReport(REPORT_PANIC, errorCode, "");
 
 	report(REPORT_EXIT_STRING, repBuf, strlen(repBuf));
 
@@ -138,6 +138,14 @@ int Base::getRuntimeIp() {
 	return -1;
 }
 
+void* Base::captureRuntimeThread() {
+	return gSyscall;
+}
+
+void Base::enterRuntimeThread(void* runtimeThread) {
+	gSyscall = (Syscall*)runtimeThread;
+}
+
 void Base::reportCallStack() {
 }
 
@@ -145,6 +153,9 @@ int Base::maDumpCallStackEx(const char*, int) {
 	return -1;
 }
 
+void Base::getCallStackString(std::string&) {
+}
+
 #ifdef MEMORY_PROTECTION
 void Base::Syscall::protectMemory(int start, int length) {
 }
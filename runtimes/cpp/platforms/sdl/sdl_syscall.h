@@ -13,6 +13,8 @@ See the License for the specific language governing permissions and
 limitations under the License.
 */
 
+#include "Platform.h"
+
 #define FE_ADD_EVENT (SDL_USEREVENT + 1)
 #define FE_TIMER (SDL_USEREVENT + 2)
 #define FE_DEFLUX_BINARY (SDL_USEREVENT + 3)
@@ -22,7 +24,7 @@ limitations under the License.
 
 namespace Base {
 	class Syscall;
-	extern Syscall* gSyscall;
+	extern VM_THREAD_LOCAL Syscall* gSyscall;
 	extern bool gReload;
 
 #if defined(_MSC_VER) || defined(__SYMBIAN32__)
@@ -35,7 +37,15 @@ void __attribute((noreturn)) reloadProgram();
 
 	void reportCallStack();
 	int maDumpCallStackEx(const char*, int);
+	//Appends the symbolized call stack, innermost frame first, one frame per line.
+	void getCallStackString(std::string& out);
 	int getRuntimeIp();
+	//SDL runs timer callbacks on a thread of its own, where the thread-local
+	//VM pointers are NULL. A callback that reports on the VM gets the result of
+	//captureRuntimeThread(), called on the VM thread, as its userdata,
+	//and passes it to enterRuntimeThread() first.
+	void* captureRuntimeThread();
+	void enterRuntimeThread(void* runtimeThread);
 	bool MAProcessEvents();
 }
 using namespace Base;
@@ -0,0 +1,136 @@
+#!/usr/bin/ruby
+
+# Copyright 2013 David Axmark
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# 	http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Runs threadedCore.c on MoRE with the switch interpreter and with the threaded one.
+# Both runs must exit with the same code. Then both are single-stepped through the
+# GDB stub, and the registers must match after every step.
+
+require 'fileutils'
+require 'socket'
+require './settings.rb'
+require '../../../rules/util.rb'
+
+MOSYNCDIR = ENV['MOSYNCDIR']
+BUILD_DIR = 'build'
+
+FileUtils.mkdir_p(BUILD_DIR)
+
+def build_program
+	sh "#{MOSYNCDIR}/bin/xgcc -g -Werror -S threadedCore.c -o #{BUILD_DIR}/threadedCore.s -I#{MOSYNCDIR}/include"
+	sh "#{MOSYNCDIR}/bin/pipe-tool -B #{BUILD_DIR}/program #{BUILD_DIR}/threadedCore.s #{MOSYNCDIR}/lib/pipe_release/mastd.lib"
+	open("#{BUILD_DIR}/resources.lst", 'w') do |file|
+		file.puts('.res')
+		file.puts('.label "start"')
+	end
+	FileUtils.cd(BUILD_DIR) do
+		sh "#{MOSYNCDIR}/bin/pipe-tool -R resources resources.lst"
+	end
+end
+
+def more_command(more, gdb)
+	return "#{more} -noscreen -program #{BUILD_DIR}/program -resource #{BUILD_DIR}/resources#{gdb ? ' -gdb' : ''}"
+end
+
+# Returns the exit code of a run without the debugger.
+def run_plain(more)
+	cmd = more_command(more, false)
+	puts cmd
+	system(cmd)
+	return $?.exitstatus
+end
+
+# Just enough of the GDB remote protocol to step and read registers.
+class GdbRemote
+	def initialize(port)
+		50.times do
+			begin
+				@socket = TCPSocket.new('localhost', port)
+				return
+			rescue Errno::ECONNREFUSED
+				sleep 0.1
+			end
+		end
+		error "Could not connect to the GDB stub on port #{port}"
+	end
+
+	def send_packet(data)
+		sum = 0
+		data.each_byte do |b| sum += b end
+		@socket.write("$#{data}##{'%02x' % (sum & 0xff)}")
+	end
+
+	# acks are skipped.
+	def read_packet
+		c = @socket.read(1) until(c == '$')
+		data = ''
+		while((c = @socket.read(1)) != '#')
+			data << c
+		end
+		@socket.read(2)
+		@socket.write('+')
+		return data
+	end
+
+	def request(data)
+		send_packet(data)
+		return read_packet
+	end
+
+	def close
+		@socket.close
+	end
+end
+
+# Steps through the program. Returns the register dump after each step,
+# followed by the exit packet if the program exits within max_steps.
+def run_stepped(more)
+	cmd = more_command(more, true)
+	puts cmd
+	pid = spawn(cmd)
+	gdb = GdbRemote.new(SETTINGS[:gdb_port])
+	trace = []
+	SETTINGS[:max_steps].times do
+		stop = gdb.request('s')
+		if(stop[0, 1] == 'W')
+			trace << stop
+			break
+		end
+		trace << gdb.request('g')
+	end
+	gdb.close
+	Process.kill('KILL', pid)
+	Process.wait(pid)
+	return trace
+end
+
+build_program
+
+switchCode = run_plain(SETTINGS[:switch_more])
+threadedCode = run_plain(SETTINGS[:threaded_more])
+puts "Exit codes: switch #{switchCode}, threaded #{threadedCode}"
+error 'Exit codes differ' if(switchCode != threadedCode)
+
+switchTrace = run_stepped(SETTINGS[:switch_more])
+threadedTrace = run_stepped(SETTINGS[:threaded_more])
+switchTrace.each_with_index do |regs, i|
+	if(regs != threadedTrace[i])
+		puts "switch:   #{regs}"
+		puts "threaded: #{threadedTrace[i]}"
+		error "Step #{i + 1} differs"
+	end
+end
+error "Step #{switchTrace.size + 1} differs" if(threadedTrace.size != switchTrace.size)
+puts "#{switchTrace.size} steps match."
@@ -0,0 +1,24 @@
+# Copyright 2013 David Axmark
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# 	http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+SETTINGS = {
+	# MoRE built with the switch interpreter, and with USE_THREADED_CORE.
+	# Both need GDB_DEBUG.
+	:switch_more => '/mosync/bin/MoRE',
+	:threaded_more => '/mosync-threaded/bin/MoRE',
+	# the GDB stub's port; see GdbStub::setupDebugConnection.
+	:gdb_port => 50000,
+	# stop comparing single steps after this many.
+	:max_steps => 100000,
+}
@@ -0,0 +1,108 @@
+/* Copyright 2013 David Axmark
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// Exercises every kind of VM instruction and returns a checksum of the results,
+// so that compare.rb can check the threaded core against the switch core.
+// The result must not depend on time, input or anything else outside the program.
+
+#include <ma.h>
+
+static volatile int sSeed = 12345;
+
+static unsigned sSum;
+
+static void mix(unsigned x) {
+	sSum = (sSum << 5) + (sSum >> 27) + x;
+}
+
+static int fib(int n) {
+	if(n < 2)
+		return n;
+	return fib(n - 1) + fib(n - 2);
+}
+
+// dense enough for a CASE table.
+static int classify(int x) {
+	switch(x & 15) {
+	case 0: return 3;
+	case 1: return x * 7;
+	case 2: return x >> 2;
+	case 3: return -x;
+	case 4: return ~x;
+	case 5: return x ^ 0x5555;
+	case 6: return x | 0x100;
+	case 7: return x & 0xff;
+	case 9: return x / 3;
+	case 10: return x % 7;
+	default: return x + 1;
+	}
+}
+
+static void arithmetic(void) {
+	int a = sSeed, b = sSeed / 7 + 3;
+	unsigned ua = (unsigned)a * 2654435761u, ub = (unsigned)b;
+	int i;
+	for(i = 0; i < 200; i++) {
+		a = a * 31 + b;
+		b = (b ^ a) - (a >> 3);
+		ua = (ua >> 1) + (ua << 7) - ub;
+		ub = ub / ((ua & 15) + 1) + ua % 13;
+		mix(a);
+		mix(b + (a < b) + (ua > ub));
+		mix(classify(a));
+		mix((unsigned)(signed char)a + (unsigned)(short)b);
+	}
+}
+
+static void memory(void) {
+	static char bytes[64];
+	static short halves[64];
+	static int words[64];
+	int i;
+	for(i = 0; i < 64; i++) {
+		bytes[i] = (char)(sSeed * i);
+		halves[i] = (short)(sSeed * i * 3);
+		words[i] = sSeed * i * 5;
+	}
+	for(i = 1; i < 64; i++) {
+		bytes[i] += bytes[i - 1];
+		halves[i] -= halves[i - 1];
+		words[i] ^= words[i - 1];
+		mix(bytes[i] + halves[i] + words[i]);
+	}
+}
+
+static void floats(void) {
+	double d = sSeed / 1000.0;
+	float f = (float)sSeed / 77.0f;
+	int i;
+	for(i = 0; i < 50; i++) {
+		d = d * 1.5 - f / 3.0;
+		f = f * 0.75f + (float)i;
+		if(d > 1e6 || d < -1e6)
+			d /= 1024.0;
+		mix((int)d);
+		mix((int)f);
+		mix(d < f);
+	}
+}
+
+int MAMain(void) {
+	arithmetic();
+	memory();
+	floats();
+	mix(fib(15));
+	return (int)((sSum ^ (sSum >> 8) ^ (sSum >> 16) ^ (sSum >> 24)) & 0xff);
+}
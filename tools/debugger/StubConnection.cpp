@@ -19,6 +19,7 @@ limitations under the License.
 #include <vector>
 
 #include "config.h"
+#include "helpers/helpers.h"
 #include "helpers/log.h"
 #include "helpers/smartie.h"
 
@@ -34,13 +35,21 @@ limitations under the License.
 
 using namespace std;
 
+//the largest number of bytes requested by one packet, unless the stub's PacketSize is smaller.
+//the hex reply must fit in StubConnLow's buffer. a multiple of the page size.
+#define MAX_READ_PACKET_BYTES (256 * 1024)
+
 //******************************************************************************
 // statics
 //******************************************************************************
 
 static StubConnection::AckCallback sReadMemoryCallback;
-static int sReadMemoryLen;
+static int sReadMemorySrc, sReadMemoryLen;
 static byte* sReadMemoryDst;
+static vector<MemoryRange> sReadRanges;	//the pages that aren't cached yet
+static size_t sNextReadRange;	//the first one not yet requested
+static size_t sPacketRangeStart;	//the first one requested by the current packet
+static int sPacketBytes;	//the number of bytes requested by the current packet
 static StubConnection::AckCallback sWriteMemoryCallback;
 static vector<StubConnection::AckCallback> sContinueListeners;
 static vector<StubConnection::AckCallback> sStopListeners;
@@ -48,6 +57,7 @@ static bool sRunning = false;
 static Registers sCachedReg;
 static bool sCachedRegValid = false;
 static bool sIdle = true;
+static int sMaxReadPacketBytes;	//set from the stub's qSupported reply
 static Functor sFunctor = { NULL, 0, false, "unknown", 0 };
 
 //globals
@@ -59,8 +69,12 @@ bool isRegValid() {
 }
 
 //static void stepAck();
+static void querySupportedAck();
+static bool querySupportedPacket(const char* data, int len);
 static void getRegistersAck();
 static bool getRegistersPacket(const char* data, int len);
+static void sendReadMemoryPacket();
+static void readMemoryDone();
 static void readMemoryAck();
 static bool readMemoryPacket(const char* data, int len);
 static void writeMemoryAck();
@@ -106,7 +120,33 @@ void StubConnection::connect(const std::string& hostname, u16 port, AckCallback
 
 	sFunctor.f = (void*)cb;
 	sFunctor.hasParam = false;
+	unIdle();
+	StubConnLow::sendPacket("qSupported", querySupportedAck);
+}
+
+static void querySupportedAck() {
+	StubConnLow::expectPacket(querySupportedPacket);
+}
+
+//the stub's PacketSize limits the reply to a memory read.
+//stubs that don't report one get MAX_READ_PACKET_BYTES.
+static bool querySupportedPacket(const char* data, int len) {
+	sMaxReadPacketBytes = MAX_READ_PACKET_BYTES;
+	const char* ps = strstr(data, "PacketSize=");
+	if(ps) {
+		int packetSize = strtoul(ps + strlen("PacketSize="), NULL, 16);
+		//two hex digits per byte, in whole pages.
+		int bytes = (packetSize / 2) & ~(MEMORY_PAGE_SIZE - 1);
+		if(bytes < MEMORY_PAGE_SIZE) {
+			setIdle();
+			error("Stub packet size 0x%x is too small", packetSize);
+			return true;
+		}
+		sMaxReadPacketBytes = MIN(bytes, MAX_READ_PACKET_BYTES);
+	}
+	setIdle();
 	getRegisters();
+	return true;
 }
 
 void StubConnection::handleUnexpectedPacket(const char* data, int len) {
@@ -270,51 +310,109 @@ static bool getRegistersPacket(const char* data, int len) {
 
 static void cacheContinue() {
 	sCachedRegValid = false;
-	clearMemoryCacheBits();
+	clearMemoryCache();
 }
 
 //******************************************************************************
 // readMemory
 //******************************************************************************
 
+//Reads go through the page cache in gMemBuf. The uncached pages are requested
+//all at once: with 'm' if they're contiguous, with 'y' (a list of ranges) if not.
 void StubConnection::readMemory(void* dst, int src, int len, AckCallback cb) {
 	_ASSERT(len > 0);
 	_ASSERT(src > 0);
 	_ASSERT(src+len <= gMemSize);
-	if(isMemoryCached(src, len)) { cb(); return; }
 
 	sReadMemoryCallback = cb;
+	sReadMemorySrc = src;
 	sReadMemoryLen = len;
 	sReadMemoryDst = (byte*)dst;
-	char buffer[64];
-	sprintf(buffer, "m%X,%X", src, len);
+	if(getUncachedMemoryRanges(src, len, sReadRanges)) {
+		readMemoryDone();
+		return;
+	}
+	//split ranges that are too large for one packet.
+	for(size_t i=0; i<sReadRanges.size(); i++) {
+		MemoryRange& r(sReadRanges[i]);
+		if(r.len > sMaxReadPacketBytes) {
+			MemoryRange rest = { r.src + sMaxReadPacketBytes, r.len - sMaxReadPacketBytes };
+			r.len = sMaxReadPacketBytes;
+			sReadRanges.insert(sReadRanges.begin() + i + 1, rest);
+		}
+	}
+	sNextReadRange = 0;
 	unIdle();
-	StubConnLow::sendPacket(buffer, readMemoryAck);
+	sendReadMemoryPacket();
 }
+
+static void sendReadMemoryPacket() {
+	sPacketRangeStart = sNextReadRange;
+	sPacketBytes = 0;
+	string packet;
+	char buffer[64];
+	while(sNextReadRange < sReadRanges.size()) {
+		const MemoryRange& r(sReadRanges[sNextReadRange]);
+		if(sPacketBytes + r.len > sMaxReadPacketBytes)
+			break;
+		sprintf(buffer, "%s%X,%X", packet.empty() ? "" : ";", r.src, r.len);
+		packet += buffer;
+		sPacketBytes += r.len;
+		sNextReadRange++;
+	}
+	bool multi = sNextReadRange - sPacketRangeStart > 1;
+	packet.insert(0, multi ? "y" : "m");
+	StubConnLow::sendPacket(packet.c_str(), readMemoryAck);
+}
+
+static void readMemoryDone() {
+	if(sReadMemoryDst != (byte*)gMemBuf + sReadMemorySrc)
+		memcpy(sReadMemoryDst, gMemBuf + sReadMemorySrc, sReadMemoryLen);
+	sReadMemoryCallback();
+}
+
 static void readMemoryAck() {
 	StubConnLow::expectPacket(readMemoryPacket);
 }
+
+static int hexValue(char c) {
+	if(c >= '0' && c <= '9')
+		return c - '0';
+	if(c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if(c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
 static bool readMemoryPacket(const char* data, int len) {
 	//eprintf("Recieved packet, %i bytes (we want %i): '%s'\n",
-		//len, sReadMemoryLen * 2, data);
+		//len, sPacketBytes * 2, data);
 	if(checkErrorPacket(data, len))
 		return true;
-	if(len != sReadMemoryLen * 2)
+	if(len != sPacketBytes * 2)
 		return false;
 	//we also check that there are no non-hex characters
 	for(int i=0; i<len; i++) {
 		if(!isxdigit(data[i]))
 			return false;
 	}
-	//parse data, byte for byte
-	for(int i=0; i<sReadMemoryLen; i++) {
-		char buf[4];
-		memcpy(buf, data + i*2, 2);
-		buf[3] = 0;
-		sReadMemoryDst[i] = (byte)strtoul(buf, NULL, 16);
+	//parse data, byte for byte, into the cache
+	for(size_t i=sPacketRangeStart; i<sNextReadRange; i++) {
+		const MemoryRange& r(sReadRanges[i]);
+		byte* dst = (byte*)gMemBuf + r.src;
+		for(int j=0; j<r.len; j++) {
+			dst[j] = (byte)((hexValue(data[0]) << 4) | hexValue(data[1]));
+			data += 2;
+		}
+		setMemoryCached(r);
+	}
+	if(sNextReadRange < sReadRanges.size()) {
+		sendReadMemoryPacket();
+		return true;
 	}
 	setIdle();
-	sReadMemoryCallback();
+	readMemoryDone();
 	return true;
 }
 
@@ -101,6 +101,11 @@ namespace StubConnection {
 	 * address. The callback function is then called when MoRE has provided
 	 * the memory values.
 	 *
+	 * The memory is read a page at a time into gMemBuf, with read-ahead,
+	 * and stays cached until the program continues. Only the pages not
+	 * already cached are requested, in as few packets as possible.
+	 * If everything is cached, cb is called right away.
+	 *
 	 * @param dst Buffer to store the memory values.
 	 * @param src Start address of the memory to read.
 	 * @param len Length of the memory to read in bytes.
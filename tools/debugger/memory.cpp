@@ -22,8 +22,7 @@ limitations under the License.
 int gMemSize = 0;
 char* gMemBuf = NULL;
 
-#define CACHED_MEM_BITS_SIZE ((sizeof(int)*gMemSize*8+32)>>5)
-static int *sCachedMemBits = NULL;
+static std::vector<bool> sCachedPages;
 
 //******************************************************************************
 // init
@@ -33,25 +32,52 @@ void setMemSize(int size) {
 	gMemSize = size;
 	SAFE_DELETE(gMemBuf);
 	gMemBuf = new char[size];
-	sCachedMemBits = new int[CACHED_MEM_BITS_SIZE];
-	clearMemoryCacheBits();
+	sCachedPages.resize((size + MEMORY_PAGE_SIZE - 1) / MEMORY_PAGE_SIZE);
+	clearMemoryCache();
 }
 
-void clearMemoryCacheBits() {
-	memset(sCachedMemBits, 0, CACHED_MEM_BITS_SIZE);
+void clearMemoryCache() {
+	sCachedPages.assign(sCachedPages.size(), false);
 }
 
-bool isMemoryCached(int src, int len) {
-	int numSet = 0;
-	for(int i = src; i < src+len; i++) {
-		int j_hi = i>>5;
-		int j_lo = 1<<(i&((1<<5)-1));
-		if(!(sCachedMemBits[j_hi]&j_lo)) {
-			sCachedMemBits[j_hi]|=j_lo;
-		} else {
-			numSet++;
-		}
+//******************************************************************************
+// pages
+//******************************************************************************
+
+static void addPage(int page, std::vector<MemoryRange>& ranges) {
+	int start = page * MEMORY_PAGE_SIZE;
+	int len = MIN(MEMORY_PAGE_SIZE, gMemSize - start);
+	if(!ranges.empty() && ranges.back().src + ranges.back().len == start) {
+		ranges.back().len += len;
+	} else {
+		MemoryRange r = { start, len };
+		ranges.push_back(r);
+	}
+}
+
+bool getUncachedMemoryRanges(int src, int len, std::vector<MemoryRange>& ranges) {
+	ranges.clear();
+	int first = src / MEMORY_PAGE_SIZE;
+	int last = (src + len - 1) / MEMORY_PAGE_SIZE;
+	for(int page = first; page <= last; page++) {
+		if(!sCachedPages[page])
+			addPage(page, ranges);
+	}
+	if(ranges.empty())
+		return true;
+	int nPages = (int)sCachedPages.size();
+	for(int page = last + 1; page <= last + MEMORY_READ_AHEAD_PAGES && page < nPages; page++) {
+		if(sCachedPages[page])
+			break;
+		addPage(page, ranges);
+	}
+	return false;
+}
+
+void setMemoryCached(const MemoryRange& range) {
+	int first = range.src / MEMORY_PAGE_SIZE;
+	int last = (range.src + range.len - 1) / MEMORY_PAGE_SIZE;
+	for(int page = first; page <= last; page++) {
+		sCachedPages[page] = true;
 	}
-	if(numSet==len) return true;
-	else return false;
 }
@@ -16,9 +16,30 @@ limitations under the License.
 #ifndef _MEMORY_H_
 #define _MEMORY_H_
 
+#include <vector>
+
 extern int gMemSize;
 extern char* gMemBuf;
 
+/**
+ * Memory is cached in pages of this many bytes. Reads are rounded out to
+ * whole pages.
+ */
+#define MEMORY_PAGE_SIZE 512
+
+/**
+ * The number of pages following a read that are fetched along with it,
+ * if they are not already cached.
+ */
+#define MEMORY_READ_AHEAD_PAGES 2
+
+/**
+ * A range of memory, starting at src, len bytes long.
+ */
+struct MemoryRange {
+	int src, len;
+};
+
 /**
  * Sets the size of the memory being cached and initializes the memory module.
  *
@@ -29,17 +50,26 @@ void setMemSize(int size);
 /**
  * Clears the all cached memory locations.
  */
-void clearMemoryCacheBits();
+void clearMemoryCache();
+
+/**
+ * Finds the pages of the given memory locations that are not cached,
+ * plus the read-ahead pages, and merges adjacent pages into ranges.
+ *
+ * @param src Address of the beginning of the memory locations.
+ * @param len The range of the bytes.
+ * @param ranges Receives the ranges that must be read. Cleared first.
+ * @return True if the specified memory locations are all cached, in which
+ *         case ranges is empty.
+ */
+bool getUncachedMemoryRanges(int src, int len, std::vector<MemoryRange>& ranges);
 
 /**
- * Checks if the given memory locations are cached. After this call the 
- * specified memory locations will be marked as cached, i.e. assuming a call
- * to chache them will be made after this call.
+ * Marks the pages of a range returned by getUncachedMemoryRanges() as cached.
+ * Call this when the range has been read into gMemBuf.
  *
- * @param src Address of the beginning of the cached locations.
- * @param len The range of the bytes being cached.
- * @return True if the specified memory locations was cached, false otherwise.
+ * @param range The range that was read.
  */
-bool isMemoryCached(int src, int len);
+void setMemoryCached(const MemoryRange& range);
 
 #endif /* _MEMORY_H_ */
@@ -44,6 +44,7 @@ static void outputAsmConfigLst(const Interface& maapi);
 static void outputAsmConfigH(const Interface& maapi);
 static void outputDllDefine(const Interface& maapi);
 static void outputInvokeSyscallCpp(const Interface& maapi);
+static void outputInvokeSyscallTableCpp(const Interface& maapi);
 static void outputInvokeSyscallArmRecompiler(const Interface& maapi);
 static void outputInvokeSyscallJava(const Interface& maapi);
 static void outputSyscallStaticJava(const Interface& maapi);
@@ -193,6 +194,7 @@ int main() {
 		copy("maapi_defs.h", "../../intlibs/helpers/");
 
 		copy("Output/invoke_syscall_cpp.h", "../../runtimes/cpp/core/");
+		copy("Output/invoke_syscall_table_cpp.h", "../../runtimes/cpp/core/");
 		copy("Output/syscall_static_cpp.h", "../../runtimes/cpp/platforms/iphone/Classes/");
 		copy("Output/invoke_syscall_arm_recompiler.h", "../../runtimes/cpp/core/");
 		copy("Output/asm_config.h", "../../intlibs/helpers/");
@@ -1043,6 +1045,7 @@ static void outputRuntimeBuilderFiles(const Interface& maapi) {
 	outputAsmConfigH(maapi);
 	outputDllDefine(maapi);
 	outputInvokeSyscallCpp(maapi);
+	outputInvokeSyscallTableCpp(maapi);
 	outputInvokeSyscallArmRecompiler(maapi);
 	outputInvokeSyscallJava(maapi);
 //	outputInvokeSyscallJavascript(maapi);
@@ -1282,6 +1285,37 @@ void streamInvokePrefix(ostream& stream, const Function& f) {
 	stream << "case " << f.number << ":\n";
 }
 
+static void streamInvokeFunctionPrefix(ostream& stream, const Function& f) {
+	stream << "void ISC_" << f.name << "()\n";
+}
+
+// One member function per syscall, ISC_<name>, with the same argument decoding
+// as invoke_syscall_cpp.h, followed by SYSCALL_TABLE(m, bad), which expands to
+// m(name) for each syscall number and to bad for the numbers that are unused.
+static void outputInvokeSyscallTableCpp(const Interface& maapi) {
+	ofstream stream("Output/invoke_syscall_table_cpp.h");
+	streamInvokeSyscall(stream, maapi, false, 0, streamInvokeFunctionPrefix);
+
+	vector<const Function*> byNumber;
+	for(size_t i=0; i<maapi.functions.size(); i++) {
+		const Function& f(maapi.functions[i]);
+		if((size_t)f.number >= byNumber.size())
+			byNumber.resize(f.number + 1, NULL);
+		byNumber[f.number] = &f;
+	}
+
+	stream << "\n#define SYSCALL_TABLE_SIZE " << byNumber.size() << "\n\n";
+	stream << "#define SYSCALL_TABLE(m, bad)\\\n";
+	for(size_t i=0; i<byNumber.size(); i++) {
+		if(byNumber[i])
+			stream << "\tm(" << byNumber[i]->name << ")";
+		else
+			stream << "\tbad";
+		stream << "\t/* " << i << " */\\\n";
+	}
+	stream << "\n";
+}
+
 static void outputInvokeSyscallJava(const Interface& maapi) {
 	ofstream stream("Output/invoke_syscall_java.h");
 	streamInvokeSyscall(stream, maapi, true);
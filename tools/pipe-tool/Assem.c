@@ -78,6 +78,11 @@ void AsmMain()
 		printf("pass %i. %i known symbols.\n", p, CountUsedSymbols());
 		if (AsmPass(p))
 			break;
+
+		// Settle the far branches without doing more passes
+
+		if (p > 1)
+			RelaxCode();
 	}
 
 	if (p == 32)
@@ -90,6 +95,8 @@ void AsmMain()
 
 	AsmPass(p+1);
 
+	CloseRelax();
+
 //-------------------------
 //  Do dependency search
 //-------------------------
@@ -243,6 +250,10 @@ int AsmPass(int thisPass)
 	if (INFO)
 		printf("Pass %d\n", thisPass);
 
+	// Record the branches, for RelaxCode
+
+	RelaxBegin(thisPass > 1 && !Final_Pass);
+
 	// Set the pass number in script variable
 
 	RedefENum("__pass",thisPass);
@@ -283,6 +294,9 @@ int AsmPass(int thisPass)
 	if (BssIP  != pBssIP)
 		return 0;			// Build not ready yet
 
+	if (!RelaxSettled())
+		return 0;			// Branches not laid out as relaxed
+
 	return 1;				// Build ready
 }
 
@@ -360,18 +360,243 @@ void RebuildEmitStabs(int ip)
 //
 //****************************************
 
+//****************************************
+//	  Function layout from a profile
+//****************************************
+
+// With -layout=file, the functions that have executed in a MoRE
+// block profile (-block-profile) are emitted first, hottest first,
+// so that the code a program spends its time in ends up together.
+// The F records list them by SLD name, which is the symbol name
+// without its leading '_'.
+
+typedef struct
+{
+	char	*Name;
+	int		Rank;
+} LAYOUT_ENTRY;
+
+static LAYOUT_ENTRY *LayoutList;
+static int LayoutCount;
+
+static ArrayStore LayoutOrder;			// Pairs of rank and code ip
+static ArrayStore LayoutDone;			// Set for each code ip already emitted
+
+int LayoutCompareName(const void *a, const void *b)
+{
+	return strcmp(((const LAYOUT_ENTRY *) a)->Name, ((const LAYOUT_ENTRY *) b)->Name);
+}
+
+int LayoutCompareRank(const void *a, const void *b)
+{
+	const int *x = (const int *) a;
+	const int *y = (const int *) b;
+
+	if (x[0] != y[0])
+		return x[0] - y[0];
+
+	return x[1] - y[1];
+}
+
+//****************************************
+//	   Read the F records of a profile
+//****************************************
+
+void LoadLayout(char *FileName)
+{
+	char line[1024];
+	char name[1024];
+	double calls, instructions;
+	int version = 0;
+	int size = 0;
+	FILE *f;
+
+	LayoutList = NULL;
+	LayoutCount = 0;
+
+	f = fopen(FileName, "r");
+
+	if (!f)
+		Error(Error_Fatal, "Could not open layout profile '%s'", FileName);
+
+	if (!fgets(line, sizeof(line), f) || sscanf(line, "MOSYNC_BLOCK_PROFILE\t%d", &version) != 1)
+		Error(Error_Fatal, "'%s' is not a block profile", FileName);
+
+	if (version != 1)
+		Error(Error_Fatal, "Block profile '%s' has unsupported version %d", FileName, version);
+
+	while (fgets(line, sizeof(line), f))
+	{
+		if (line[0] != 'F' || line[1] != '\t')
+			continue;
+
+		if (sscanf(line + 2, "%1023[^\t]\t%lf\t%lf", name, &calls, &instructions) != 3)
+			continue;
+
+		// Records are hottest first; the rest never ran
+
+		if (instructions <= 0)
+			break;
+
+		if (LayoutCount == size)
+		{
+			size = size * 2 + 256;
+
+			if (LayoutList)
+				LayoutList = (LAYOUT_ENTRY *) ReallocPtr((char *) LayoutList, size * sizeof(LAYOUT_ENTRY));
+			else
+				LayoutList = (LAYOUT_ENTRY *) NewPtr(size * sizeof(LAYOUT_ENTRY));
+
+			if (!LayoutList)
+				Error(Error_Fatal, "Out of memory reading layout profile");
+		}
+
+		LayoutList[LayoutCount].Name = NewPtr(strlen(name) + 1);
+		strcpy(LayoutList[LayoutCount].Name, name);
+		LayoutList[LayoutCount].Rank = LayoutCount;
+		LayoutCount++;
+	}
+
+	fclose(f);
+
+	if (LayoutCount)
+		qsort(LayoutList, LayoutCount, sizeof(LAYOUT_ENTRY), LayoutCompareName);
+}
+
+//****************************************
+//
+//****************************************
+
+void DisposeLayout()
+{
+	int n;
+
+	for (n=0;n<LayoutCount;n++)
+		DisposePtr(LayoutList[n].Name);
+
+	if (LayoutList)
+		DisposePtr((char *) LayoutList);
+
+	LayoutList = NULL;
+	LayoutCount = 0;
+}
+
+//****************************************
+//	  Get a function's profile rank
+//****************************************
+
+int LayoutRank(SYMBOL *sym)
+{
+	LAYOUT_ENTRY key;
+	LAYOUT_ENTRY *entry;
+	char name[1024];
+
+	if (!LayoutCount)
+		return -1;
+
+	key.Name = sym->Name;
+
+	if (key.Name[0] == '_')
+		key.Name++;
+
+	entry = (LAYOUT_ENTRY *) bsearch(&key, LayoutList, LayoutCount, sizeof(LAYOUT_ENTRY), LayoutCompareName);
+
+	// A program built from rebuild.s names its functions name_scope
+
+	if (!entry && strlen(key.Name) < sizeof(name) - 16)
+	{
+		sprintf(name, "%s_%d", key.Name, sym->LocalScope);
+		key.Name = name;
+		entry = (LAYOUT_ENTRY *) bsearch(&key, LayoutList, LayoutCount, sizeof(LAYOUT_ENTRY), LayoutCompareName);
+	}
+
+	if (!entry)
+		return -1;
+
+	return entry->Rank;
+}
+
+//****************************************
+//	 Emit the profiled functions first
+//****************************************
+
+int Rebuild_LayoutCode()
+{
+	SYMBOL *sym;
+	int *order;
+	int rank;
+	int count = 0;
+	int n;
+
+	ArrayInit(&LayoutOrder, sizeof(int), 0);
+	ArrayInit(&LayoutDone, sizeof(char), 0);
+
+	LoadLayout(LayoutName);
+
+	for (n=0;n<CodeIP+1;n++)
+	{
+		sym = (SYMBOL *) ArrayGet(&CodeLabelArray, n);
+
+		if (!sym || sym->LabelType < label_Function)
+			continue;
+
+		if (!(sym->Flags & SymFlag_Ref) && !ArgSkipElim)
+			continue;
+
+		rank = LayoutRank(sym);
+
+		if (rank < 0)
+			continue;
+
+		ArraySet(&LayoutOrder, count * 2, rank);
+		ArraySet(&LayoutOrder, count * 2 + 1, n);
+		count++;
+	}
+
+	if (count)
+	{
+		order = (int *) ArrayPtr(&LayoutOrder, 0);
+		qsort(order, count, 2 * sizeof(int), LayoutCompareRank);
+
+		for (n=0;n<count;n++)
+		{
+			sym = (SYMBOL *) ArrayGet(&CodeLabelArray, order[n * 2 + 1]);
+			RebuildFunc(sym);
+			ArraySet(&LayoutDone, order[n * 2 + 1], 1);
+		}
+	}
+
+	if (INFO)
+		printf("Layout: %d of %d profiled functions placed first\n", count, LayoutCount);
+
+	DisposeLayout();
+	ArrayDispose(&LayoutOrder);
+
+	return count;
+}
+
+//****************************************
+//
+//****************************************
+
 void Rebuild_Code()
 {
 	SYMBOL *sym;
 	int n;
 	int c = 0;
 
+	if (ArgLayout)
+		c += Rebuild_LayoutCode();
+
 	for (n=0;n<CodeIP+1;n++)
 	{
 		sym = (SYMBOL *) ArrayGet(&CodeLabelArray, n);
 
 		if (sym)
 		{
+			if (ArgLayout && ArrayGet(&LayoutDone, n))
+				continue;
+
 			if ((sym->Flags & SymFlag_Ref) || ArgSkipElim)
 			{
 				if (sym->LabelType >= label_Function)
@@ -384,6 +609,9 @@ void Rebuild_Code()
 		}
 	}
 
+	if (ArgLayout)
+		ArrayDispose(&LayoutDone);
+
 	CRPRINT("Processed %d functions\n", c);
 }
 
@@ -404,6 +404,7 @@ short Directives()
 			Error(Error_Fatal, ".org has illegal address");
 
 		CodeIP = v;
+		RelaxInvalidate();
 //!		CodePtr = &CodeMem[v];
 		printf("*Warning* org %x\n", v);
 		return 1;
@@ -99,7 +99,7 @@ void gDisposePtr(unsigned char *thisPtr)
 
 typedef struct
 {
-	char	magic[4];			// 0x89 'M' 'A' 'O'
+	char	magic[4];			// 0x89 'M' 'A' 'O', or 'I' if indexed
 	int		id[2];				// The ID
 	int		numobj;				// Number of objects	
 } MA_LIB;
@@ -112,6 +112,21 @@ typedef struct
 	int dsize;
 } MA_OBJ;
 
+// An indexed library has one object per member, after an
+// index object that holds an MA_MEMBER for each member,
+// followed by the names it defines and the names it uses
+
+typedef struct
+{
+	int		offset;				// Of the member's MA_OBJ, from the first member
+	int		size;				// Uncompressed size
+	int		flags;
+	int		numdefs;			// Zero terminated names
+	int		numrefs;
+} MA_MEMBER;
+
+#define LIB_MEMBER_KEEP		1	// Load with the library (ctors, dtors, thunks)
+
 //****************************************
 //
 //****************************************
@@ -261,6 +276,17 @@ int AddSourceFile(char *FileName, int local_scope)
 	if (file_length == 0)
 		return 0;
 
+	// When linking, indexed libraries are loaded member by member
+
+	if (LibraryOnDemand() && IsIndexedLibrary(SrcFile))
+	{
+		v = AddLibraryIndex(SrcFile, FileName, local_scope);
+		fclose(SrcFile);
+		return v;
+	}
+
+	MarkLibraryMember();
+
 	if (local_scope)
 		AddSourceText(".localscope +\r\n");
 
@@ -321,13 +347,24 @@ int AddSourceFile(char *FileName, int local_scope)
 		if (head.magic[2] != 'A')
 			return 0;				// unknown format
 
-		if (head.magic[3] != 'O')
+		if (head.magic[3] != 'O' && head.magic[3] != 'I')
 			return 0;				// unknown format
 
 		// Step onto the first object
 		
 		memptr += sizeof(MA_LIB);
 
+		// Skip the index, all the members are loaded
+
+		if (head.magic[3] == 'I')
+		{
+			if (file_length < sizeof(MA_LIB) + sizeof(MA_OBJ))
+				return 0;
+
+			memcpy(&thisObj, memptr, sizeof(MA_OBJ));
+			memptr += sizeof(MA_OBJ) + thisObj.csize;
+		}
+
 		// Looks ok
 				
 		for (n=0;n<head.numobj;n++)
@@ -340,8 +377,12 @@ int AddSourceFile(char *FileName, int local_scope)
 			// insert another local id
 
 			if (n != 0)
-			if (local_scope)
-				AddSourceText(".localscope +\r\n");
+			{
+				if (head.magic[3] == 'I')
+					MarkLibraryMember();			// Members start with their own
+				else if (local_scope)
+					AddSourceText(".localscope +\r\n");
+			}
 
 			// Check file will fit in to memory buffer
 
@@ -388,6 +429,914 @@ int AddSourceFile(char *FileName, int local_scope)
 	return 0;
 }
 
+//****************************************
+//		  Indexed Libraries
+//
+// -L keeps each input file as a member,
+// and indexes the globals each member
+// defines and the names it uses. When
+// linking, only the index is read, then
+// the members that define names the
+// program uses are loaded, and those
+// that they use in turn.
+//
+// The names used are every identifier
+// in the member that it doesn't define
+// itself, which may be more than it
+// needs but never less.
+//****************************************
+
+#define LIB_PROGRAM		-2			// Defined by the program, not a library
+#define LIBTOK_REF		0
+#define LIBTOK_DEF		1
+#define LIBTOK_LABEL	2
+
+typedef struct
+{
+	int		Name;			// Offset in LibNamePool
+	int		Len;
+	uint	Hash;
+	int		Member;			// First member that defines it, -1 if none
+	int		Def;			// Last member that defined, labelled or
+	int		Label;			// used it
+	int		Ref;
+} LibName;
+
+typedef struct
+{
+	int		Lib;
+	int		Offset;
+	int		Size;
+	int		Flags;
+	int		Refs;			// First name used, in LibRefs
+	int		NumRefs;
+	int		Used;
+} LibMember;
+
+typedef struct
+{
+	char	*File;
+	int		Pos;			// Where the members go in the source buffer
+	int		Base;			// File offset of the first member
+	int		First;			// First member in LibMembers
+	int		Count;
+} LibIndex;
+
+static LibName *LibNames = 0;
+static int LibNameCount = 0;
+static int LibNameMax = 0;
+
+static int *LibNameHash = 0;		// Name index + 1, 0 if free
+static uint LibNameHashSize = 0;
+
+static char *LibNamePool = 0;
+static int LibNamePoolUsed = 0;
+static int LibNamePoolMax = 0;
+
+static LibMember *LibMembers = 0;
+static int LibMemberCount = 0;
+static int LibMemberMax = 0;
+
+static LibIndex *LibIndexes = 0;
+static int LibIndexCount = 0;
+static int LibIndexMax = 0;
+
+static ArrayStore LibMarks;			// Start of each member, in -L mode
+static ArrayStore LibDefList;		// Names of the member being scanned
+static ArrayStore LibRefList;
+static ArrayStore LibRefs;			// Names used by the loaded members
+static ArrayStore LibStack;			// Members to follow
+
+static char *LibIndexData = 0;		// Index of the library being written
+static int LibIndexDataLen = 0;
+static int LibIndexDataMax = 0;
+
+//****************************************
+//	  Load libraries member by member ?
+//****************************************
+
+int LibraryOnDemand()
+{
+	return ArgBuild && !ArgWholeLibs;
+}
+
+//****************************************
+//	  Check for an indexed library
+//****************************************
+
+int IsIndexedLibrary(FILE *SrcFile)
+{
+	unsigned char magic[4];
+	int res;
+
+	fseek(SrcFile,0,SEEK_SET);
+	res = fread(magic, 1, 4, SrcFile);
+	fseek(SrcFile,0,SEEK_SET);
+
+	if (res != 4)
+		return 0;
+
+	return magic[0] == 0x89 && magic[1] == 'M' && magic[2] == 'A' && magic[3] == 'I';
+}
+
+//****************************************
+//	   Start a member in -L mode
+//****************************************
+
+void MarkLibraryMember()
+{
+	if (ArgLink)
+		ArrayAppend(&LibMarks, SourceIdx);
+}
+
+//****************************************
+//		  Library name table
+//****************************************
+
+void InitLibNames()
+{
+	LibNameHashSize = 4096;
+	LibNameHash = (int *) NewPtrClear(sizeof(int) * LibNameHashSize);
+
+	if (!LibNameHash)
+		Error(Error_Fatal, "Out of memory for the library index");
+
+	LibNameCount = 0;
+	LibNamePoolUsed = 0;
+
+	ArrayInit(&LibDefList, sizeof(int), 4096);
+	ArrayInit(&LibRefList, sizeof(int), 4096);
+	ArrayInit(&LibRefs, sizeof(int), 4096);
+	ArrayInit(&LibStack, sizeof(int), 4096);
+}
+
+void DisposeLibNames()
+{
+	if (LibNameHash)
+		DisposePtr((char *) LibNameHash);
+
+	if (LibNames)
+		DisposePtr((char *) LibNames);
+
+	if (LibNamePool)
+		DisposePtr(LibNamePool);
+
+	LibNameHash = 0;
+	LibNames = 0;
+	LibNamePool = 0;
+	LibNameHashSize = 0;
+	LibNameCount = LibNameMax = 0;
+	LibNamePoolUsed = LibNamePoolMax = 0;
+
+	ArrayDispose(&LibDefList);
+	ArrayDispose(&LibRefList);
+	ArrayDispose(&LibRefs);
+	ArrayDispose(&LibStack);
+}
+
+// Names are kept the way GetAsmName reads them, with '.' as '_'
+
+uint HashLibName(char *name, int len)
+{
+	uint v = 2166136261u;
+	int n;
+
+	for (n=0;n<len;n++)
+	{
+		v ^= (name[n] == '.') ? '_' : (unsigned char) name[n];
+		v *= 16777619u;
+	}
+
+	return v;
+}
+
+// Returns the slot of the name, or the free slot where it would go
+
+uint FindLibNameSlot(char *name, int len, uint hash)
+{
+	LibName *entry;
+	char *s;
+	uint n = hash & (LibNameHashSize - 1);
+	int i;
+
+	while (1)
+	{
+		if (!LibNameHash[n])
+			return n;
+
+		entry = &LibNames[LibNameHash[n] - 1];
+
+		if (entry->Hash == hash && entry->Len == len)
+		{
+			s = &LibNamePool[entry->Name];
+
+			for (i=0;i<len;i++)
+			{
+				if (s[i] != ((name[i] == '.') ? '_' : name[i]))
+					break;
+			}
+
+			if (i == len)
+				return n;
+		}
+
+		n = (n + 1) & (LibNameHashSize - 1);
+	}
+}
+
+void GrowLibNameHash()
+{
+	int *oldHash = LibNameHash;
+	uint oldSize = LibNameHashSize;
+	uint n, i;
+
+	LibNameHashSize *= 2;
+	LibNameHash = (int *) NewPtrClear(sizeof(int) * LibNameHashSize);
+
+	if (!LibNameHash)
+		Error(Error_Fatal, "Out of memory for the library index");
+
+	for (n=0;n<oldSize;n++)
+	{
+		if (!oldHash[n])
+			continue;
+
+		i = LibNames[oldHash[n] - 1].Hash & (LibNameHashSize - 1);
+
+		while (LibNameHash[i])
+			i = (i + 1) & (LibNameHashSize - 1);
+
+		LibNameHash[i] = oldHash[n];
+	}
+
+	DisposePtr((char *) oldHash);
+}
+
+// Returns the index of the name, or -1
+
+int LookupLibName(char *name, int len)
+{
+	uint slot;
+
+	if (!LibNameHash)
+		return -1;
+
+	slot = FindLibNameSlot(name, len, HashLibName(name, len));
+	return LibNameHash[slot] - 1;
+}
+
+// Returns the index of the name, adding it if needed
+
+int AddLibName(char *name, int len)
+{
+	LibName *entry;
+	uint hash = HashLibName(name, len);
+	uint slot = FindLibNameSlot(name, len, hash);
+	char *s;
+	int n;
+
+	if (LibNameHash[slot])
+		return LibNameHash[slot] - 1;
+
+	if ((uint) (LibNameCount + 1) * 2 > LibNameHashSize)
+	{
+		GrowLibNameHash();
+		slot = FindLibNameSlot(name, len, hash);
+	}
+
+	if (LibNameCount >= LibNameMax)
+	{
+		LibNameMax = LibNameMax ? LibNameMax * 2 : 4096;
+
+		if (LibNames)
+			LibNames = (LibName *) ReallocPtr((char *) LibNames, sizeof(LibName) * LibNameMax);
+		else
+			LibNames = (LibName *) NewPtr(sizeof(LibName) * LibNameMax);
+
+		if (!LibNames)
+			Error(Error_Fatal, "Out of memory for the library index");
+	}
+
+	if (LibNamePoolUsed + len + 1 > LibNamePoolMax)
+	{
+		LibNamePoolMax = LibNamePoolMax ? LibNamePoolMax * 2 : 64*1024;
+
+		while (LibNamePoolUsed + len + 1 > LibNamePoolMax)
+			LibNamePoolMax *= 2;
+
+		if (LibNamePool)
+			LibNamePool = ReallocPtr(LibNamePool, LibNamePoolMax);
+		else
+			LibNamePool = NewPtr(LibNamePoolMax);
+
+		if (!LibNamePool)
+			Error(Error_Fatal, "Out of memory for the library index");
+	}
+
+	s = &LibNamePool[LibNamePoolUsed];
+
+	for (n=0;n<len;n++)
+		s[n] = (name[n] == '.') ? '_' : name[n];
+
+	s[len] = 0;
+
+	entry = &LibNames[LibNameCount];
+
+	entry->Name = LibNamePoolUsed;
+	entry->Len = len;
+	entry->Hash = hash;
+	entry->Member = -1;
+	entry->Def = -1;
+	entry->Label = -1;
+	entry->Ref = -1;
+
+	LibNamePoolUsed += len + 1;
+	LibNameHash[slot] = ++LibNameCount;
+	return LibNameCount - 1;
+}
+
+//****************************************
+//	  Record a name found in a member
+//****************************************
+
+void AddLibToken(char *name, int len, int kind, int member)
+{
+	LibName *entry;
+	int n;
+
+	// Names in the program only matter if a library defines them
+
+	if (member == LIB_PROGRAM)
+	{
+		n = LookupLibName(name, len);
+
+		if (n == -1)
+			return;
+
+		entry = &LibNames[n];
+
+		if (kind == LIBTOK_DEF)
+			entry->Member = LIB_PROGRAM;
+
+		if (kind == LIBTOK_REF && entry->Ref != LIB_PROGRAM)
+		{
+			entry->Ref = LIB_PROGRAM;
+			ArrayAppend(&LibRefList, n);
+		}
+		return;
+	}
+
+	n = AddLibName(name, len);
+	entry = &LibNames[n];
+
+	switch(kind)
+	{
+		case LIBTOK_DEF:
+		if (entry->Def != member)
+		{
+			entry->Def = member;
+			ArrayAppend(&LibDefList, n);
+		}
+		break;
+
+		case LIBTOK_LABEL:
+		entry->Label = member;
+		break;
+
+		case LIBTOK_REF:
+		if (entry->Ref != member)
+		{
+			entry->Ref = member;
+			ArrayAppend(&LibRefList, n);
+		}
+		break;
+	}
+}
+
+int LibWord(char *name, int len, char *word)
+{
+	return (int) strlen(word) == len && memcmp(name, word, len) == 0;
+}
+
+//****************************************
+//	  Find the names in a member's text
+//	  Returns the member flags
+//****************************************
+
+int ScanLibText(char *text, int len, int member)
+{
+	char *name;
+	int p = 0;
+	int start, c, kind;
+	int first = 1;				// No name yet on this line
+	int next = LIBTOK_REF;		// What the next name on the line is
+	int flags = 0;
+
+	while (p < len)
+	{
+		c = (unsigned char) text[p];
+
+		if (c == '\n')
+		{
+			first = 1;
+			next = LIBTOK_REF;
+			p++;
+			continue;
+		}
+
+		if (!asmsymf(c))
+		{
+			p++;
+
+			// Skip numbers whole, so that 0x1f isn't a name
+
+			if (isdigit(c))
+			{
+				while (p < len && asmsym((unsigned char) text[p]))
+					p++;
+			}
+			continue;
+		}
+
+		start = p;
+
+		while (p < len && asmsym((unsigned char) text[p]))
+			p++;
+
+		name = &text[start];
+
+		// Directives
+
+		if (start > 0 && text[start-1] == '.')
+		{
+			first = 0;
+
+			if (LibWord(name, p - start, "global") || LibWord(name, p - start, "globl") ||
+				LibWord(name, p - start, "weak") || LibWord(name, p - start, "comm"))
+				next = LIBTOK_DEF;
+
+			if (LibWord(name, p - start, "func"))
+				next = LIBTOK_LABEL;
+
+			if (LibWord(name, p - start, "set"))
+			{
+				next = LIBTOK_DEF;
+
+				while (p < len && (text[p] == ' ' || text[p] == '\t'))
+					p++;
+
+				// Thunks are looked up by number
+
+				if (p < len && text[p] == '%')
+				{
+					flags |= LIB_MEMBER_KEEP;
+					next = LIBTOK_REF;
+				}
+			}
+
+			if (LibWord(name, p - start, "ctor") || LibWord(name, p - start, "dtor") ||
+				LibWord(name, p - start, "ctors") || LibWord(name, p - start, "dtors"))
+				flags |= LIB_MEMBER_KEEP;
+
+			continue;
+		}
+
+		kind = next;
+
+		if (kind == LIBTOK_REF && first && p < len && text[p] == ':')
+			kind = LIBTOK_LABEL;
+
+		next = LIBTOK_REF;
+		first = 0;
+
+		AddLibToken(name, p - start, kind, member);
+	}
+
+	return flags;
+}
+
+//****************************************
+//		Add to the index being built
+//****************************************
+
+void AddLibIndexData(void *data, int len)
+{
+	if (LibIndexDataLen + len > LibIndexDataMax)
+	{
+		LibIndexDataMax = LibIndexDataMax ? LibIndexDataMax * 2 : 64*1024;
+
+		while (LibIndexDataLen + len > LibIndexDataMax)
+			LibIndexDataMax *= 2;
+
+		if (LibIndexData)
+			LibIndexData = ReallocPtr(LibIndexData, LibIndexDataMax);
+		else
+			LibIndexData = NewPtr(LibIndexDataMax);
+
+		if (!LibIndexData)
+			Error(Error_Fatal, "Out of memory for the library index");
+	}
+
+	memcpy(&LibIndexData[LibIndexDataLen], data, len);
+	LibIndexDataLen += len;
+}
+
+void AddLibIndexNames(ArrayStore *list, int member)
+{
+	LibName *entry;
+	int count = ArrayGetPosition(list);
+	int n;
+
+	for (n=0;n<count;n++)
+	{
+		entry = &LibNames[ArrayGet(list, n)];
+
+		if (member < 0 || (entry->Def != member && entry->Label != member))
+			AddLibIndexData(&LibNamePool[entry->Name], entry->Len + 1);
+	}
+}
+
+//****************************************
+//	 Index a member of the library being
+//	 written, returns the member flags
+//****************************************
+
+int IndexLibraryMember(int member, int start, int end, int offset)
+{
+	MA_MEMBER head;
+	LibName *entry;
+	int count, n;
+
+	ArraySetPosition(&LibDefList, 0);
+	ArraySetPosition(&LibRefList, 0);
+
+	head.offset = offset;
+	head.size = end - start;
+	head.flags = ScanLibText((char *) &SourceTop[start], end - start, member);
+
+	// The first member has the .library line of the build
+
+	if (member == 0)
+		head.flags |= LIB_MEMBER_KEEP;
+
+	head.numdefs = ArrayGetPosition(&LibDefList);
+	head.numrefs = 0;
+
+	count = ArrayGetPosition(&LibRefList);
+
+	for (n=0;n<count;n++)
+	{
+		entry = &LibNames[ArrayGet(&LibRefList, n)];
+
+		if (entry->Def != member && entry->Label != member)
+			head.numrefs++;
+	}
+
+	AddLibIndexData(&head, sizeof(MA_MEMBER));
+	AddLibIndexNames(&LibDefList, -1);
+	AddLibIndexNames(&LibRefList, member);
+	return head.flags;
+}
+
+//****************************************
+//	  Read the index of a library, and
+//	  leave room for its members
+//****************************************
+
+int AddLibraryIndex(FILE *SrcFile, char *FileName, int local_scope)
+{
+	MA_LIB head;
+	MA_OBJ thisObj;
+	MA_MEMBER member;
+	LibMember *mem;
+	LibIndex *lib;
+	unsigned char *cdata;
+	char *index, *p, *end;
+	int len, n, i, name;
+
+	if (fread(&head, 1, sizeof(MA_LIB), SrcFile) != sizeof(MA_LIB))
+		return 0;
+
+	if (fread(&thisObj, 1, sizeof(MA_OBJ), SrcFile) != sizeof(MA_OBJ))
+		return 0;
+
+	if (head.numobj <= 0 || thisObj.csize < 0 || thisObj.dsize < 0)
+		return 0;
+
+	cdata = gNewPtr(thisObj.csize);
+	index = (char *) gNewPtr(thisObj.dsize + 1);
+
+	if (!cdata || !index)
+		return 0;
+
+	if (fread(cdata, 1, thisObj.csize, SrcFile) != (size_t) thisObj.csize)
+		return 0;
+
+#ifdef USE_ZLIB
+	len = ZLibUncompress((unsigned char *) index, thisObj.dsize, cdata, thisObj.csize);
+#else
+	len = FreeImage_ZLibUncompress((unsigned char *) index, thisObj.dsize, cdata, thisObj.csize);
+#endif
+
+	gDisposePtr(cdata);
+
+	if (len != thisObj.dsize)
+		return 0;
+
+	index[len] = 0;
+
+	if (!LibNameHash)
+		InitLibNames();
+
+	// Add the library
+
+	if (LibIndexCount >= LibIndexMax)
+	{
+		LibIndexMax = LibIndexMax ? LibIndexMax * 2 : 64;
+
+		if (LibIndexes)
+			LibIndexes = (LibIndex *) ReallocPtr((char *) LibIndexes, sizeof(LibIndex) * LibIndexMax);
+		else
+			LibIndexes = (LibIndex *) NewPtr(sizeof(LibIndex) * LibIndexMax);
+
+		if (!LibIndexes)
+			Error(Error_Fatal, "Out of memory for the library index");
+	}
+
+	lib = &LibIndexes[LibIndexCount];
+
+	lib->File = (char *) gNewPtr(strlen(FileName) + 1);
+
+	if (!lib->File)
+		return 0;
+
+	strcpy(lib->File, FileName);
+
+	lib->Base = sizeof(MA_LIB) + sizeof(MA_OBJ) + thisObj.csize;
+	lib->First = LibMemberCount;
+	lib->Count = head.numobj;
+
+	// Add its members
+
+	p = index;
+	end = index + len;
+
+	for (n=0;n<head.numobj;n++)
+	{
+		if (p + sizeof(MA_MEMBER) > end)
+			return 0;
+
+		memcpy(&member, p, sizeof(MA_MEMBER));
+		p += sizeof(MA_MEMBER);
+
+		if (LibMemberCount >= LibMemberMax)
+		{
+			LibMemberMax = LibMemberMax ? LibMemberMax * 2 : 1024;
+
+			if (LibMembers)
+				LibMembers = (LibMember *) ReallocPtr((char *) LibMembers, sizeof(LibMember) * LibMemberMax);
+			else
+				LibMembers = (LibMember *) NewPtr(sizeof(LibMember) * LibMemberMax);
+
+			if (!LibMembers)
+				Error(Error_Fatal, "Out of memory for the library index");
+		}
+
+		mem = &LibMembers[LibMemberCount];
+
+		mem->Lib = LibIndexCount;
+		mem->Offset = member.offset;
+		mem->Size = member.size;
+		mem->Flags = member.flags;
+		mem->Refs = ArrayGetPosition(&LibRefs);
+		mem->NumRefs = member.numrefs;
+		mem->Used = 0;
+
+		for (i=0;i<member.numdefs + member.numrefs;i++)
+		{
+			if (p >= end)
+				return 0;
+
+			len = strlen(p);
+			name = AddLibName(p, len);
+			p += len + 1;
+
+			if (i >= member.numdefs)
+				ArrayAppend(&LibRefs, name);
+			else if (LibNames[name].Member == -1)
+				LibNames[name].Member = LibMemberCount;
+		}
+
+		LibMemberCount++;
+	}
+
+	gDisposePtr((unsigned char *) index);
+
+	// The members go here, once it is known which are used
+
+	if (local_scope)
+		AddSourceText(".localscope +\r\n");
+
+	AddSourceText("\r\n.lfile '%s'\r\n", FileName);
+
+	lib->Pos = SourceIdx;
+	LibIndexCount++;
+	return 1;
+}
+
+//****************************************
+//		  Mark a member as used
+//****************************************
+
+void UseLibMember(int member)
+{
+	if (member < 0 || LibMembers[member].Used)
+		return;
+
+	LibMembers[member].Used = 1;
+	ArrayAppend(&LibStack, member);
+}
+
+//****************************************
+//	  Load the members of the indexed
+//	  libraries that the program uses
+//****************************************
+
+int LoadLibraryMembers()
+{
+	LibIndex *lib;
+	LibMember *mem;
+	MA_OBJ thisObj;
+	FILE *SrcFile;
+	unsigned char *cdata = 0;
+	int cdataLen = 0;
+	int total, size, used, pos, len;
+	int n, m, i;
+
+	if (!LibIndexCount)
+		return 1;
+
+	// Find the names used by the program, and what it defines itself
+
+	ArraySetPosition(&LibRefList, 0);
+	ScanLibText((char *) SourceTop, SourceIdx, LIB_PROGRAM);
+
+	n = LookupLibName(Code_EntryPoint, strlen(Code_EntryPoint));
+
+	if (n != -1)
+		UseLibMember(LibNames[n].Member);
+
+	for (n=0;n<ArrayGetPosition(&LibRefList);n++)
+		UseLibMember(LibNames[ArrayGet(&LibRefList, n)].Member);
+
+	for (n=0;n<LibMemberCount;n++)
+	{
+		if (LibMembers[n].Flags & LIB_MEMBER_KEEP)
+			UseLibMember(n);
+	}
+
+	// Follow the names used by each member loaded
+
+	while (ArrayGetPosition(&LibStack))
+	{
+		ArraySetPosition(&LibStack, ArrayGetPosition(&LibStack) - 1);
+		mem = &LibMembers[ArrayGet(&LibStack, ArrayGetPosition(&LibStack))];
+
+		for (n=0;n<mem->NumRefs;n++)
+			UseLibMember(LibNames[ArrayGet(&LibRefs, mem->Refs + n)].Member);
+	}
+
+	// Insert the members, from the last library, so that
+	// the positions of the earlier ones stay the same
+
+	total = 0;
+
+	for (n=0;n<LibMemberCount;n++)
+	{
+		if (LibMembers[n].Used)
+			total += LibMembers[n].Size;
+	}
+
+	if (!ExpandSource(total))
+		return 0;
+
+	for (n=LibIndexCount-1;n>=0;n--)
+	{
+		lib = &LibIndexes[n];
+
+		size = 0;
+		used = 0;
+
+		for (m=lib->First;m<lib->First+lib->Count;m++)
+		{
+			if (LibMembers[m].Used)
+			{
+				size += LibMembers[m].Size;
+				used++;
+			}
+		}
+
+		memmove(&SourceTop[lib->Pos + size], &SourceTop[lib->Pos], SourceIdx - lib->Pos);
+		SourceIdx += size;
+
+		SrcFile = fopen(lib->File, "rb");
+
+		if (!SrcFile)
+		{
+			printf("failed to load '%s'\n", lib->File);
+			return 0;
+		}
+
+		pos = lib->Pos;
+
+		for (m=lib->First;m<lib->First+lib->Count;m++)
+		{
+			mem = &LibMembers[m];
+
+			if (!mem->Used)
+				continue;
+
+			fseek(SrcFile, lib->Base + mem->Offset, SEEK_SET);
+
+			i = fread(&thisObj, 1, sizeof(MA_OBJ), SrcFile);
+
+			if (i != sizeof(MA_OBJ) || thisObj.dsize != mem->Size || thisObj.csize < 0)
+				break;
+
+			if (thisObj.csize > cdataLen)
+			{
+				if (cdata)
+					gDisposePtr(cdata);
+
+				cdataLen = thisObj.csize;
+				cdata = gNewPtr(cdataLen);
+
+				if (!cdata)
+					break;
+			}
+
+			if (fread(cdata, 1, thisObj.csize, SrcFile) != (size_t) thisObj.csize)
+				break;
+
+#ifdef USE_ZLIB
+			len = ZLibUncompress(&SourceTop[pos], thisObj.dsize, cdata, thisObj.csize);
+#else
+			len = FreeImage_ZLibUncompress(&SourceTop[pos], thisObj.dsize, cdata, thisObj.csize);
+#endif
+
+			if (len != thisObj.dsize)
+				break;
+
+			pos += len;
+		}
+
+		fclose(SrcFile);
+
+		if (m != lib->First + lib->Count)
+		{
+			printf("failed to load '%s'\n", lib->File);
+			return 0;
+		}
+
+		if (INFO)
+			printf("Loaded %d of %d members of '%s'\n", used, lib->Count, lib->File);
+	}
+
+	if (cdata)
+		gDisposePtr(cdata);
+
+	DisposeLibraryIndex();
+	return 1;
+}
+
+//****************************************
+//		  Free the library index
+//****************************************
+
+void DisposeLibraryIndex()
+{
+	int n;
+
+	for (n=0;n<LibIndexCount;n++)
+	{
+		if (LibIndexes[n].File)
+			gDisposePtr((unsigned char *) LibIndexes[n].File);
+	}
+
+	if (LibIndexes)
+		DisposePtr((char *) LibIndexes);
+
+	if (LibMembers)
+		DisposePtr((char *) LibMembers);
+
+	LibIndexes = 0;
+	LibMembers = 0;
+	LibIndexCount = LibIndexMax = 0;
+	LibMemberCount = LibMemberMax = 0;
+
+	DisposeLibNames();
+}
+
 //****************************************
 //
 //****************************************
@@ -508,6 +1457,8 @@ int InitLibrarian()
 	if (!v)
 		return 0;
 
+	ArrayInit(&LibMarks, sizeof(int), 1024);
+
 	LibFileCount = 0;
 	return 1;
 }
@@ -533,6 +1484,13 @@ void DisposeLibrarian()
 	int n;
 
 	DisposeSourceInput();
+	ArrayDispose(&LibMarks);
+
+	if (LibIndexData)
+		DisposePtr(LibIndexData);
+
+	LibIndexData = 0;
+	LibIndexDataLen = LibIndexDataMax = 0;
 
 	if (!LibFileCount)
 		return;
@@ -622,63 +1580,136 @@ int WriteLibrarian(char *outfile)
 	MA_LIB head;		// Deal with compressed object file
 	MA_OBJ thisObj;
 	
-	unsigned char *cptr,*cptrtop;
-	//int dlen,clen;
-	int res;
+	unsigned char **cdata;
+	int *csize;
+	unsigned char *cindex;
+	int count, start, end, offset;
+	int n, res, ok;
 
-	cptrtop = cptr = gNewPtrClear(SourceIdx * 2);
-	
-	if (!cptrtop)
+	// Compress each member, and index it
+
+	count = ArrayGetPosition(&LibMarks) + 1;
+
+	cdata = (unsigned char **) gNewPtrClear(sizeof(unsigned char *) * count);
+	csize = (int *) gNewPtrClear(sizeof(int) * count);
+
+	if (!cdata || !csize)
 		return 0;
-	
-	SrcFile = fopen(outfile,"wb");
 
-	if (!SrcFile)
+	InitLibNames();
+
+	LibIndexDataLen = 0;
+	offset = 0;
+	start = 0;
+
+	for (n=0;n<count;n++)
+	{
+		end = (n < count - 1) ? (int) ArrayGet(&LibMarks, n) : SourceIdx;
+
+		IndexLibraryMember(n, start, end, offset);
+
+		cdata[n] = gNewPtr((end - start) * 2 + 64);
+
+		if (!cdata[n])
+			return 0;
+
+#ifdef USE_ZLIB
+		csize[n] = ZLibCompress(cdata[n], (end - start) * 2 + 64, &SourceTop[start], end - start);
+#else
+		csize[n] = FreeImage_ZLibCompress(cdata[n], (end - start) * 2 + 64, &SourceTop[start], end - start);
+#endif
+
+		if (!csize[n])
+			return 0;
+
+		offset += sizeof(MA_OBJ) + csize[n];
+		start = end;
+	}
+
+	DisposeLibNames();
+
+	cindex = gNewPtr(LibIndexDataLen * 2 + 64);
+
+	if (!cindex)
 		return 0;
 
-	thisObj.dsize = SourceIdx;
+	thisObj.dsize = LibIndexDataLen;
 
 #ifdef USE_ZLIB
-	thisObj.csize = ZLibCompress(cptr, SourceIdx * 2, SourceTop, SourceIdx);
+	thisObj.csize = ZLibCompress(cindex, LibIndexDataLen * 2 + 64, (unsigned char *) LibIndexData, LibIndexDataLen);
 #else
-	thisObj.csize = FreeImage_ZLibCompress(cptr, SourceIdx * 2, SourceTop, SourceIdx);
+	thisObj.csize = FreeImage_ZLibCompress(cindex, LibIndexDataLen * 2 + 64, (unsigned char *) LibIndexData, LibIndexDataLen);
 #endif
 
-	if (thisObj.csize)
+	if (!thisObj.csize)
+		return 0;
+
+	SrcFile = fopen(outfile,"wb");
+
+	if (!SrcFile)
+		return 0;
+
+	// Set up header
+	
+	head.magic[0] = 0x89;
+	head.magic[1] = 'M';
+	head.magic[2] = 'A';
+	head.magic[3] = 'I';
+
+	head.id[0] = 0;
+	head.id[1] = 0;
+	
+	head.numobj = count;
+
+	// Save lib header, then the index
+	
+	ok = 1;
+
+	res = fwrite(&head, 1, sizeof(head), SrcFile);
+	if(res != sizeof(head))
+		ok = 0;
+
+	res = fwrite(&thisObj, 1, sizeof(thisObj), SrcFile);
+	if(res != sizeof(thisObj))
+		ok = 0;
+
+	res = fwrite(cindex, 1, thisObj.csize, SrcFile);
+	if(res != thisObj.csize)
+		ok = 0;
+
+	// Save the members
+
+	start = 0;
+
+	for (n=0;n<count;n++)
 	{
-		// Set up header
-		
-		head.magic[0] = 0x89;
-		head.magic[1] = 'M';
-		head.magic[2] = 'A';
-		head.magic[3] = 'O';
+		end = (n < count - 1) ? (int) ArrayGet(&LibMarks, n) : SourceIdx;
 
-		head.id[0] = 0;
-		head.id[1] = 0;
-		
-		head.numobj = 1;
-		
-		// Save lib header
-		
-		res = fwrite(&head, 1, sizeof(head), SrcFile);
-		if(res != sizeof(head))
-			return 0;
+		thisObj.dsize = end - start;
+		thisObj.csize = csize[n];
 
-		// Save object header
 		res = fwrite(&thisObj, 1, sizeof(thisObj), SrcFile);
 		if(res != sizeof(thisObj))
-			return 0;
+			ok = 0;
 
-		// Save the data
-		res = fwrite(cptr, 1, thisObj.csize, SrcFile);
-		if(res != sizeof(thisObj.csize))
-			return 0;
+		res = fwrite(cdata[n], 1, csize[n], SrcFile);
+		if(res != csize[n])
+			ok = 0;
+
+		gDisposePtr(cdata[n]);
+		start = end;
 	}
-	
-	gDisposePtr(cptrtop);
+
 	fclose(SrcFile);
-	
-	printf("Created '%s'\n", outfile);
+
+	gDisposePtr(cindex);
+	gDisposePtr((unsigned char *) cdata);
+	gDisposePtr((unsigned char *) csize);
+
+	if (!ok)
+		return 0;
+
+	printf("Created '%s' (%d members)\n", outfile, count);
 	return 1;
 }
 
@@ -271,12 +271,26 @@ int main(int argc,char *argv[])
 			continue;
 		}
 
+		if (Token("layout="))
+		{
+			ArgLayout = 1;
+			GetCmdString();
+			strcpy(LayoutName, Name);
+			continue;
+		}
+
 		if (Token("no-verify"))
 		{
 			ArgVerifierOff = 1;
 			continue;
 		}
 
+		if (Token("whole-libs"))
+		{
+			ArgWholeLibs = 1;
+			continue;
+		}
+
 		if (Token("master-dump"))
 		{
 			ArgMasterDump = 1;
@@ -640,6 +654,11 @@ int main(int argc,char *argv[])
 		
 	}
 
+	// Add the members of indexed libraries that the program uses
+
+	if (!LoadLibraryMembers())
+		ExitApp(1);
+
 	if (ArgDumpFile)
 	{
 		TerminateSourceFile(1);
@@ -740,7 +759,10 @@ Build application (-B) options:\n\
   -sld=file            output source/line translation\n\
   -stabs=file          output debug information\n\
   -elim                eliminate unreferenced code/data\n\
+  -layout=file         with -elim, place the functions that ran in a MoRE\n\
+                       block profile first, hottest first\n\
   -no-verify           prevent code verification\n\
+  -whole-libs          load every member of the input libraries\n\
   -java                build a Java class file\n\
   -gcj=flags           for -java option: set flags for GCJ\n\
   -cpp                 build C++ source code\n\
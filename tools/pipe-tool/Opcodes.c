@@ -1348,6 +1348,8 @@ void WriteOpcode(char *AsmName, int field)
 
 	if (field & use_addr)
 	{
+		RelaxAddBranch(StartCodeIP, imm, GetLastSymbolRef(), farop);
+
 		if (farop)
 		{
 			*CodePtr++ = (char)(imm >> 16);
@@ -0,0 +1,330 @@
+/* Copyright 2013 David Axmark
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+//*********************************************************************************************
+//				  PIP-e II Assembler Branch Relaxation
+//
+// The only code whose size depends on addresses is a branch or call
+// to a target above 0xffff, which takes a _FAR prefix and a third
+// address byte. Constant indices are fixed at 16 bits (SizeConstOpt).
+//
+// Each pass records its branches. If a pass didn't settle, RelaxCode
+// finds the branch sizes that agree with the label addresses they
+// produce, and moves the code labels there, so the next pass is
+// normally the last one. That pass must lay out every branch as
+// predicted, else the assembler keeps on with normal passes.
+//*********************************************************************************************
+
+#include "compile.h"
+
+#define RELAX_MAX_ITER		64
+#define RELAX_FAR_GROWTH	2			// _FAR prefix and third address byte
+
+typedef struct
+{
+	int		IP;				// Address of the branch
+	int		Target;			// Target address, if Sym is NULL
+	SYMBOL	*Sym;			// Code label targeted
+	int		Far;
+} RelaxEntry;
+
+static RelaxEntry *RelaxRec;		// Branches of this pass
+static int RelaxRecCount;
+static int RelaxRecMax;
+
+static RelaxEntry *RelaxPred;		// Branches predicted by RelaxCode
+static int RelaxPredCount;
+static int RelaxPredMax;
+
+static int RelaxRecording;
+static int RelaxBroken;				// The pass can't be relaxed
+static int RelaxPredicted;			// This pass is checked against RelaxPred
+static int RelaxMismatch;
+
+static int *RelaxShift;
+
+//****************************************
+//		  Free the relax records
+//****************************************
+
+void CloseRelax()
+{
+	if (RelaxRec)
+		DisposePtr((char *) RelaxRec);
+
+	if (RelaxPred)
+		DisposePtr((char *) RelaxPred);
+
+	if (RelaxShift)
+		DisposePtr((char *) RelaxShift);
+
+	RelaxRec = RelaxPred = 0;
+	RelaxShift = 0;
+	RelaxRecCount = RelaxRecMax = 0;
+	RelaxPredCount = RelaxPredMax = 0;
+	RelaxRecording = RelaxPredicted = 0;
+}
+
+//****************************************
+//	  Start recording branches for a pass
+//****************************************
+
+void RelaxBegin(int record)
+{
+	RelaxRecCount = 0;
+	RelaxRecording = record;
+	RelaxBroken = 0;
+	RelaxMismatch = 0;
+
+	if (!record)
+		RelaxPredicted = 0;
+}
+
+//****************************************
+//	 Stop relaxing the pass (eg on .org)
+//****************************************
+
+void RelaxInvalidate()
+{
+	RelaxBroken = 1;
+}
+
+//****************************************
+//	Record a branch written by WriteOpcode
+//	 sym is the label the target came from
+//****************************************
+
+void RelaxAddBranch(int ip, int target, SYMBOL *sym, int far)
+{
+	RelaxEntry *entry;
+
+	if (!RelaxRecording)
+		return;
+
+	if (RelaxRecCount >= RelaxRecMax)
+	{
+		RelaxRecMax = RelaxRecMax ? RelaxRecMax * 2 : 4096;
+
+		if (RelaxRec)
+			RelaxRec = (RelaxEntry *) ReallocPtr((char *) RelaxRec, sizeof(RelaxEntry) * RelaxRecMax);
+		else
+			RelaxRec = (RelaxEntry *) NewPtr(sizeof(RelaxEntry) * RelaxRecMax);
+
+		if (!RelaxRec)
+			Error(Error_Fatal, "Out of memory for branch relaxation");
+	}
+
+	if (sym && (sym->Section != section_Enum || sym->Type != SECT_code))
+		sym = 0;
+
+	entry = &RelaxRec[RelaxRecCount];
+
+	entry->IP = ip;
+	entry->Target = target;
+	entry->Sym = sym;
+	entry->Far = far;
+
+	// Check the layout predicted for this pass
+
+	if (RelaxPredicted)
+	{
+		if (RelaxRecCount >= RelaxPredCount)
+			RelaxMismatch = 1;
+		else if (RelaxPred[RelaxRecCount].IP != ip || RelaxPred[RelaxRecCount].Far != far)
+			RelaxMismatch = 1;
+	}
+
+	RelaxRecCount++;
+}
+
+//****************************************
+//	 Check if the pass had the layout
+//	 that RelaxCode predicted for it
+//****************************************
+
+int RelaxSettled()
+{
+	if (!RelaxPredicted)
+		return 1;
+
+	if (RelaxBroken || RelaxMismatch)
+		return 0;
+
+	return RelaxRecCount == RelaxPredCount;
+}
+
+//****************************************
+//	  Address after the relaxed branches
+//****************************************
+
+int RelaxAddr(int addr)
+{
+	int lo = 0;
+	int hi = RelaxRecCount;
+	int mid;
+
+	// Count the branches that start below addr
+
+	while (lo < hi)
+	{
+		mid = (lo + hi) >> 1;
+
+		if (RelaxRec[mid].IP < addr)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return addr + RelaxShift[lo];
+}
+
+//****************************************
+//	Settle the branches of the last pass
+//	  and move the code labels to match
+//****************************************
+
+void RelaxCode()
+{
+	RelaxEntry *entry;
+	SYMBOL *Sym;
+	char *farNew;
+	int iter, changed, target, far;
+	int n, max, moved;
+
+	RelaxRecording = 0;
+	RelaxPredicted = 0;
+
+	if (RelaxBroken)
+		return;
+
+	// The branches must be in address order
+
+	for (n=1;n<RelaxRecCount;n++)
+	{
+		if (RelaxRec[n].IP <= RelaxRec[n-1].IP)
+			return;
+	}
+
+	if (RelaxShift)
+		DisposePtr((char *) RelaxShift);
+
+	RelaxShift = (int *) NewPtr(sizeof(int) * (RelaxRecCount + 1));
+	farNew = NewPtr(RelaxRecCount + 1);
+
+	if (!RelaxShift || !farNew)
+		Error(Error_Fatal, "Out of memory for branch relaxation");
+
+	for (n=0;n<RelaxRecCount;n++)
+		farNew[n] = (char) RelaxRec[n].Far;
+
+	// Iterate on the branches alone, until no size changes
+
+	for (iter=0;iter<RELAX_MAX_ITER;iter++)
+	{
+		RelaxShift[0] = 0;
+
+		for (n=0;n<RelaxRecCount;n++)
+			RelaxShift[n+1] = RelaxShift[n] + (farNew[n] - RelaxRec[n].Far) * RELAX_FAR_GROWTH;
+
+		changed = 0;
+
+		for (n=0;n<RelaxRecCount;n++)
+		{
+			entry = &RelaxRec[n];
+
+			if (entry->Sym)
+				target = RelaxAddr(entry->Sym->Value);
+			else
+				target = entry->Target;
+
+			far = (target & 0xffff0000) ? 1 : 0;
+
+			if (far != farNew[n])
+			{
+				farNew[n] = (char) far;
+				changed = 1;
+			}
+		}
+
+		if (!changed)
+			break;
+	}
+
+	if (iter == RELAX_MAX_ITER)
+	{
+		DisposePtr(farNew);
+		return;
+	}
+
+	// Move the code labels and function ends
+
+	moved = 0;
+	changed = 0;
+
+	for (n=0;n<RelaxRecCount;n++)
+	{
+		if (farNew[n] != RelaxRec[n].Far)
+			changed = 1;
+	}
+
+	if (changed)
+	{
+		Sym = SymTab;
+		n = SYMMAX;
+
+		do
+		{
+			if (Sym->Section == section_Enum && Sym->Type == SECT_code)
+			{
+				Sym->Value = RelaxAddr(Sym->Value);
+
+				if (Sym->EndIP)
+					Sym->EndIP = RelaxAddr(Sym->EndIP);
+
+				moved++;
+			}
+
+			Sym++;
+		}
+		while(--n);
+	}
+
+	CodeIP = RelaxAddr(CodeIP);
+
+	// Keep the layout the next pass should have
+
+	for (n=0;n<RelaxRecCount;n++)
+	{
+		RelaxRec[n].IP += RelaxShift[n];
+		RelaxRec[n].Far = farNew[n];
+	}
+
+	DisposePtr(farNew);
+
+	entry = RelaxPred;
+	RelaxPred = RelaxRec;
+	RelaxRec = entry;
+
+	max = RelaxPredMax;
+	RelaxPredMax = RelaxRecMax;
+	RelaxRecMax = max;
+
+	RelaxPredCount = RelaxRecCount;
+	RelaxRecCount = 0;
+	RelaxPredicted = 1;
+
+	if (INFO)
+		printf("Relaxed %d branches in %d steps, moved %d labels\n", RelaxPredCount, iter, moved);
+}
@@ -48,12 +48,6 @@ char *Sect_Strings[] =
 //	Initialises Symbol table to null.
 //****************************************
 
-#define SYMBOL_HASH_SIZE 32749			// Prime
-
-#ifdef USE_HASHING
-BucketArray SymbolHash;
-#endif
-
 SYMBOL *NextFreeSym;
 int NextSymbolCount;
 
@@ -88,8 +82,10 @@ int InitSymbolTable(void)
 	}
 	while(--n);
 
+	InitNames();
+
 #ifdef USE_HASHING
-	BucketArrayInit(&SymbolHash, SYMBOL_HASH_SIZE);
+	InitSymbolHash();
 #endif
 
 	NextFreeSym = SymTab;
@@ -107,10 +103,11 @@ void CloseSymbolTable(void)
 {
 
 #ifdef USE_HASHING
-	BucketArrayDispose(&SymbolHash);
+	CloseSymbolHash();
 #endif
 
 	DisposeSymbols();
+	CloseNames();
 
 	if (SymTab)
 		DisposePtr((char *) SymTab);
@@ -220,79 +217,378 @@ SYMBOL * GetSymbol(int num)
 }
 */
 //****************************************
-//			  Hash Symbol
-// Returns the entry point into hash table
+//			  Symbol Names
+//
+// Each distinct name is stored once, in
+// large blocks, and found through an
+// open addressing table. Symbols with the
+// same name share the name pointer, so
+// the symbol index compares names by
+// pointer.
 //****************************************
 
-//#define HASHFUNC(vv) ((vv * 1103515245) + 12345)
+#define NAME_BLOCK_SIZE		(64*1024)
+#define NAME_TABLE_MIN		4096			// Power of two
 
-int HashSymbol(char *string, int scope, int section)
+typedef struct
 {
-	uint v, n;
-	uint len;
+	char	*Name;			// NULL if the slot is free
+	uint	Hash;
+	int		Len;
+} NameEntry;
 
-	len = strlen(string);
+static NameEntry *NameTable;
+static uint NameTableSize;
+static uint NameCount;
 
-	v = 41;
-	v += HASHFUNC(scope);
-	v += HASHFUNC(section);
-	v += HASHFUNC(len);
+static char *NameBlock;						// Starts with a link to the previous block
+static int NameBlockUsed;
 
-	for (n=0;n<len;n++)
-		v += HASHFUNC(string[n]);
+void InitNames(void)
+{
+	NameTableSize = NAME_TABLE_MIN;
+	NameTable = (NameEntry *) NewPtrClear(sizeof(NameEntry) * NameTableSize);
+
+	if (!NameTable)
+		Error(Error_Fatal, "Out of symbol memory!!");
+
+	NameCount = 0;
+	NameBlock = 0;
+	NameBlockUsed = 0;
+}
+
+void CloseNames(void)
+{
+	char *prev;
+
+	while (NameBlock)
+	{
+		prev = *(char **) NameBlock;
+		DisposePtr(NameBlock);
+		NameBlock = prev;
+	}
+
+	if (NameTable)
+		DisposePtr((char *) NameTable);
+
+	NameTable = 0;
+	NameTableSize = 0;
+	NameCount = 0;
+}
+
+// FNV-1a
+
+uint HashName(char *string, int *len)
+{
+	uint v = 2166136261u;
+	char *p = string;
+
+	while (*p)
+	{
+		v ^= (unsigned char) *p++;
+		v *= 16777619u;
+	}
+
+	*len = p - string;
+	return v;
+}
+
+// Returns the slot of the name in NameTable, or the free slot where it would go
+
+uint FindNameSlot(char *string, uint hash, int len)
+{
+	NameEntry *entry;
+	uint n = hash & (NameTableSize - 1);
+
+	while (1)
+	{
+		entry = &NameTable[n];
+
+		if (!entry->Name)
+			return n;
+
+		if (entry->Hash == hash && entry->Len == len && memcmp(entry->Name, string, len) == 0)
+			return n;
+
+		n = (n + 1) & (NameTableSize - 1);
+	}
+}
+
+void GrowNames(void)
+{
+	NameEntry *oldTable = NameTable;
+	uint oldSize = NameTableSize;
+	uint n, i;
+
+	NameTableSize *= 2;
+	NameTable = (NameEntry *) NewPtrClear(sizeof(NameEntry) * NameTableSize);
+
+	if (!NameTable)
+		Error(Error_Fatal, "Out of symbol memory!!");
+
+	// Names are unique, so each entry goes in the first free slot
+
+	for (n=0;n<oldSize;n++)
+	{
+		if (!oldTable[n].Name)
+			continue;
+
+		i = oldTable[n].Hash & (NameTableSize - 1);
+
+		while (NameTable[i].Name)
+			i = (i + 1) & (NameTableSize - 1);
+
+		NameTable[i] = oldTable[n];
+	}
+
+	DisposePtr((char *) oldTable);
+}
+
+char * AllocName(char *string, int len)
+{
+	char *block;
+	char *name;
+	int size = len + 1;
+
+	// Long names get a block of their own, behind the current one
+
+	if (size > NAME_BLOCK_SIZE / 4)
+	{
+		block = NewPtr(sizeof(char *) + size);
+
+		if (!block)
+			Error(Error_Fatal, "Out of symbol memory!!");
+
+		if (NameBlock)
+		{
+			*(char **) block = *(char **) NameBlock;
+			*(char **) NameBlock = block;
+		}
+		else
+		{
+			*(char **) block = 0;
+			NameBlock = block;
+			NameBlockUsed = NAME_BLOCK_SIZE;
+		}
+
+		name = block + sizeof(char *);
+		memcpy(name, string, size);
+		return name;
+	}
+
+	if (!NameBlock || NameBlockUsed + size > NAME_BLOCK_SIZE)
+	{
+		block = NewPtr(NAME_BLOCK_SIZE);
+
+		if (!block)
+			Error(Error_Fatal, "Out of symbol memory!!");
+
+		*(char **) block = NameBlock;
+		NameBlock = block;
+		NameBlockUsed = sizeof(char *);
+	}
+
+	name = NameBlock + NameBlockUsed;
+	memcpy(name, string, size);
+	NameBlockUsed += size;
+	return name;
+}
+
+// Returns the stored copy of string, adding it if needed
+
+char * InternName(char *string, uint *hash)
+{
+	NameEntry *entry;
+	int len;
 
-	return v % SYMBOL_HASH_SIZE;
+	*hash = HashName(string, &len);
+	entry = &NameTable[FindNameSlot(string, *hash, len)];
+
+	if (entry->Name)
+		return entry->Name;
+
+	if ((NameCount + 1) * 2 > NameTableSize)
+	{
+		GrowNames();
+		entry = &NameTable[FindNameSlot(string, *hash, len)];
+	}
+
+	entry->Name = AllocName(string, len);
+	entry->Hash = *hash;
+	entry->Len = len;
+	NameCount++;
+	return entry->Name;
+}
+
+// Returns the stored copy of string, or NULL if no symbol was ever given that name
+
+char * LookupName(char *string, uint *hash)
+{
+	int len;
+
+	*hash = HashName(string, &len);
+	return NameTable[FindNameSlot(string, *hash, len)].Name;
 }
 
 //****************************************
-//  *Symbol	FindSymbols (Ptr string)
+//			  Symbol Index
 //
-//	Trys to find the Symbol at *string
-// (ASCZ terminated) returns a Ptr to a
-//  Symbol containing the Symbol data.
-// if NULL returned then the Symbol
-// was not found.
+// An open addressing table of symbols by
+// (name, scope, section). If a key is
+// stored twice, the first symbol is found.
 //****************************************
 
 #ifdef USE_HASHING
 
-SYMBOL * FindSymbolsOld(char *string,int sectionStart,int sectionEnd)
+#define SYMBOL_TABLE_MIN	4096			// Power of two
+
+typedef struct
 {
-	SYMBOL *Sym;
-	int elem, entry;
-	int	len;
+	SYMBOL	*Sym;			// NULL if the slot is free
+	uint	Hash;
+} SymbolEntry;
 
-	len = strlen(string);
+static SymbolEntry *SymbolHash;
+static uint SymbolHashSize;
+static uint SymbolHashCount;
 
-	entry = HashSymbol(string, 0, sectionStart);
-	elem = -1;
+void InitSymbolHash(void)
+{
+	SymbolHashSize = SYMBOL_TABLE_MIN;
+	SymbolHash = (SymbolEntry *) NewPtrClear(sizeof(SymbolEntry) * SymbolHashSize);
 
-	while(1)
-	{
-		elem = BucketArraySearch(&SymbolHash, entry, elem, (uint*) &Sym);
+	if (!SymbolHash)
+		Error(Error_Fatal, "Out of symbol memory!!");
 
-		if (Sym == 0)
-			return NULL;
+	SymbolHashCount = 0;
+}
 
-		if (elem == -1)
-			return NULL;
+void CloseSymbolHash(void)
+{
+	if (SymbolHash)
+		DisposePtr((char *) SymbolHash);
 
-		if ( (Sym->Len == len) &&
-			 (Sym->Section != 0)  &&
-			 (Sym->Section >= sectionStart) &&
-			 (Sym->Section <= sectionEnd) &&
-			 (strcmp(string,Sym->Name) == 0)
+	SymbolHash = 0;
+	SymbolHashSize = 0;
+	SymbolHashCount = 0;
+}
+
+uint HashSymbolKey(uint nameHash, int scope, int section)
+{
+	uint v = nameHash ^ ((uint) scope * 0x9E3779B1u) ^ ((uint) section << 24);
+
+	// murmur3 finalizer, so that nearby scopes spread out
+
+	v ^= v >> 16;
+	v *= 0x85EBCA6Bu;
+	v ^= v >> 13;
+	v *= 0xC2B2AE35u;
+	v ^= v >> 16;
+	return v;
+}
+
+// Returns the slot of the key in SymbolHash, or the free slot where it would go.
+// name must be interned.
+
+uint FindSymbolSlot(uint hash, char *name, int scope, int section)
+{
+	SymbolEntry *entry;
+	uint n = hash & (SymbolHashSize - 1);
+
+	while (1)
+	{
+		entry = &SymbolHash[n];
+
+		if (!entry->Sym)
+			return n;
+
+		if ( (entry->Hash == hash) &&
+			 (entry->Sym->Name == name) &&
+			 (entry->Sym->LocalScope == scope) &&
+			 (entry->Sym->Section == section)
 			)
-		{
-//			LastSymCount = n;
-			return Sym;
-		}
+			return n;
 
-		if (elem == 0)
-			return NULL;
+		n = (n + 1) & (SymbolHashSize - 1);
 	}
+}
 
-	return NULL;
+void GrowSymbolHash(void)
+{
+	SymbolEntry *oldTable = SymbolHash;
+	uint oldSize = SymbolHashSize;
+	uint n, i;
+
+	SymbolHashSize *= 2;
+	SymbolHash = (SymbolEntry *) NewPtrClear(sizeof(SymbolEntry) * SymbolHashSize);
+
+	if (!SymbolHash)
+		Error(Error_Fatal, "Out of symbol memory!!");
+
+	// Keys are unique, so each entry goes in the first free slot
+
+	for (n=0;n<oldSize;n++)
+	{
+		if (!oldTable[n].Sym)
+			continue;
+
+		i = oldTable[n].Hash & (SymbolHashSize - 1);
+
+		while (SymbolHash[i].Sym)
+			i = (i + 1) & (SymbolHashSize - 1);
+
+		SymbolHash[i] = oldTable[n];
+	}
+
+	DisposePtr((char *) oldTable);
+}
+
+void AddSymbolHash(SYMBOL *Sym, uint nameHash)
+{
+	SymbolEntry *entry;
+	uint hash = HashSymbolKey(nameHash, Sym->LocalScope, Sym->Section);
+
+	if ((SymbolHashCount + 1) * 2 > SymbolHashSize)
+		GrowSymbolHash();
+
+	entry = &SymbolHash[FindSymbolSlot(hash, Sym->Name, Sym->LocalScope, Sym->Section)];
+
+	if (entry->Sym)
+		return;
+
+	entry->Sym = Sym;
+	entry->Hash = hash;
+	SymbolHashCount++;
+}
+
+// name must be interned, with nameHash from InternName or LookupName
+
+SYMBOL * FindSymbolKey(char *name, uint nameHash, int section, int scope)
+{
+	uint hash = HashSymbolKey(nameHash, scope, section);
+
+	return SymbolHash[FindSymbolSlot(hash, name, scope, section)].Sym;
+}
+
+#endif
+
+//****************************************
+//  *Symbol	FindSymbols (Ptr string)
+//
+//	Trys to find the Symbol at *string
+// (ASCZ terminated) returns a Ptr to a
+//  Symbol containing the Symbol data.
+// if NULL returned then the Symbol
+// was not found.
+//****************************************
+
+#ifdef USE_HASHING
+
+// Only finds symbols in sectionStart, with scope 0
+
+SYMBOL * FindSymbolsOld(char *string,int sectionStart,int sectionEnd)
+{
+	return FindSymbols(string, sectionStart, sectionEnd, 0);
 }
 
 #else
@@ -344,44 +640,22 @@ SYMBOL * FindSymbolsOld(char *string,int sectionStart,int sectionEnd)
 
 #ifdef USE_HASHING
 
+// Only finds symbols in sectionStart
+
 SYMBOL * FindSymbols(char *string,int sectionStart,int sectionEnd, int scope)
 {
-	SYMBOL *Sym;
-	int elem, entry;
-	int	len;
-
-	len = strlen(string);
-
-	entry = HashSymbol(string, scope, sectionStart);
-	elem = -1;
-
-	while(1)
-	{
-		elem = BucketArraySearch(&SymbolHash, entry, elem, (uint*) &Sym);
-
-		if (Sym == 0)
-			return NULL;
+	char *name;
+	uint hash;
 
-		if (elem == -1)
-			return NULL;
+	if (sectionEnd < sectionStart)
+		return NULL;
 
-		if ( (Sym->LocalScope == scope) &&
-			 (Sym->Len == len) &&
-			 (Sym->Section != 0)  &&
-			 (Sym->Section >= sectionStart) &&
-			 (Sym->Section <= sectionEnd) &&
-			 (strcmp(string,Sym->Name) == 0)
-			)
-			{
-//				LastSymCount = n;
-				return Sym;
-			}
+	name = LookupName(string, &hash);
 
-		if (elem == 0)
-			return NULL;
-	}
+	if (!name)
+		return NULL;
 
-	return NULL;
+	return FindSymbolKey(name, hash, sectionStart, scope);
 }
 
 #else
@@ -503,39 +777,30 @@ SYMBOL * StoreSymbol(SYMBOL *NewSym,char *string)
 {
 	SYMBOL *Sym = FreeSymbol();
 	char *ThisName;					// Location of PTR to name
-	int StringLen;
-	int entry;
-
-	StringLen = strlen(string) + 1;	// Get length of string
+	uint hash;
 
 	// if there was not Symbol space quit
 
 	if (Sym == NULL)
 			return NULL;
 
-	// if there was no name space quit
-
-	ThisName = (char *) NewPtr((int) StringLen);
+	// Share the name with other symbols of the same name
 
-	// Copy the name to the NamesList
+	ThisName = InternName(string, &hash);
 
-	memcpy(ThisName,string,StringLen);
 	memcpy(Sym,NewSym,sizeof(SYMBOL));
 
 	// Set the Symbol data ptr
 
 	Sym->Name = ThisName;
-	Sym->Len = StringLen-1;
+	Sym->Len = strlen(ThisName);
 
 	Sym->Flags = 0;
 
 	// Add symbol to hash table
 
 #ifdef USE_HASHING
-
-	entry = HashSymbol(Sym->Name, Sym->LocalScope, Sym->Section);
-	BucketArrayAdd(&SymbolHash, entry, (int) Sym);
-
+	AddSymbolHash(Sym, hash);
 #endif
 	// Carry forward the names pointer
 
@@ -553,8 +818,9 @@ int DelSymbol(SYMBOL *ThisSym)
 
 	//OutEval("------ Undeclare '%s'\n",(char *) ThisSym->name);
 
-	if (ThisSym->Name)
-		DisposePtr((char *) ThisSym->Name);			// Give back memory
+	// The name is shared, and freed by CloseSymbolTable
+
+	ThisSym->Name = NULL;
 
 	return 1;										// Say o.k
 }
@@ -746,12 +746,15 @@ decset(int ArgSkipElim, 0)
 decset(int ArgSLD, 0)
 decset(int ArgUseStabs, 0)
 decset(int ArgWriteMeta, 0)
+decset(int ArgLayout, 0)
 
 decset(int ArgQuiet, 0)
+decset(int ArgWholeLibs, 0)
 
 dec(char SldName[256])
 dec(char StabsName[256])
 dec(char MetaFileName[256])
+dec(char LayoutName[256])
 
 decset(int ArgUseMasterDump, 0)
 
@@ -24,17 +24,64 @@ limitations under the License.
 
 int demangle_system(const char* mangled_name, const char* filename, char* buffer);
 
-char* my_demangle(const char* mangled_name) {
-	const char* filename = tmpnam(NULL);
+// Each name is passed to c++filt only once; the results are kept until exit.
+// Names that couldn't be demangled are cached too, with a NULL result.
+#define DEMANGLE_BUCKETS 256
+
+typedef struct DemangleEntry {
+	struct DemangleEntry* next;
+	char* demangled;
+	char mangled[1];	// the rest follows
+} DemangleEntry;
+
+static DemangleEntry* demangle_cache[DEMANGLE_BUCKETS];
+
+static unsigned demangle_hash(const char* name) {
+	unsigned h = 0;
+	while(*name)
+		h = h * 31 + (unsigned char)*name++;
+	return h & (DEMANGLE_BUCKETS - 1);
+}
+
+static const char* demangle_cached(const char* mangled_name) {
+	const char* filename;
 	char buffer[1024];
+	DemangleEntry* e;
+	unsigned h = demangle_hash(mangled_name);
+
+	for(e = demangle_cache[h]; e; e = e->next) {
+		if(strcmp(e->mangled, mangled_name) == 0)
+			return e->demangled;
+	}
+
+	e = (DemangleEntry*)malloc(sizeof(DemangleEntry) + strlen(mangled_name));
+	if(!e)
+		return NULL;
+	strcpy(e->mangled, mangled_name);
+	e->demangled = NULL;
+
+	filename = tmpnam(NULL);
+	if(demangle_system(mangled_name, filename, buffer) > 0) {
+		e->demangled = (char*)malloc(strlen(buffer) + 1);
+		if(e->demangled)
+			strcpy(e->demangled, buffer);
+	}
+	remove(filename);
+
+	e->next = demangle_cache[h];
+	demangle_cache[h] = e;
+	return e->demangled;
+}
+
+char* my_demangle(const char* mangled_name) {
+	const char* buffer;
 	char* newbuf;
-	int size, res;
+	int size;
 
 	last_mangled_name = mangled_name;
 
-	res = demangle_system(mangled_name, filename, buffer);
-	remove(filename);
-	if(!res)
+	buffer = demangle_cached(mangled_name);
+	if(!buffer)
 		return NULL;
 
 	size = strlen(buffer) + 1;